@@ -1,5 +1,11 @@
 #include <gtest/gtest.h>
 
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "../src/json_parser.h"
+
 /* Credit: 
 https://stackoverflow.com/questions/16491675/how-to-send-custom-message-in-google-c-testing-framework
 */
@@ -26,4 +32,21 @@ protected:
     void TearDown() override {
         // Cleanup code here, if needed
     }
+
+    // Parses a document given as text, with `parser` when it needs options
+    static std::shared_ptr<JsonValue> parse(const std::string& json, JsonParser& parser) {
+        std::istringstream in(json);
+        return parser.Parse(in);
+    }
+
+    static std::shared_ptr<JsonValue> parse(const std::string& json) {
+        JsonParser parser;
+        return parse(json, parser);
+    }
+
+    static std::string print(const JsonValue& value) {
+        std::ostringstream out;
+        out << value;
+        return out.str();
+    }
 };
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+
+#include "core.h"
+
+#include <memory>
+#include <sstream>
+#include <fstream>
+#include <string>
+
+#include "../src/json_parser.h"
+#include "../src/json_eval.h"
+#include "../src/json_document.h"
+#include "../src/json_hash.h"
+
+class DocumentTest : public EvalTest {
+protected:
+    void SetUp() override {
+        EvalTest::SetUp();
+
+        std::ifstream file(_testDirectory + "test.json");
+        ASSERT_TRUE(file.is_open());
+
+        JsonParser parser;
+        auto root = parser.TryParse(file);
+        ASSERT_TRUE(root.has_value());
+        _document = JsonDocument(*root);
+    }
+
+    static std::string eval(const JsonDocument& document, const std::string& expression) {
+        JsonEval evaluator(document.root());
+        auto result = evaluator.Query(expression);
+        if (!result) {
+            return result.error().message;
+        }
+        std::stringstream out;
+        out << **result;
+        return out.str();
+    }
+
+    static const JsonValue* node(const JsonDocument& document, const std::string& expression) {
+        return *JsonEval(document.root()).Query(expression);
+    }
+
+    JsonDocument _document{ nullptr };
+};
+
+TEST_F(DocumentTest, set_shares_unchanged_subtrees) {
+    JsonDocument edited = _document.Set("a.b[2].c", JsonString(std::string("edited")));
+
+    ASSERT_EQ(eval(edited, "a.b[2].c"), "edited");
+    ASSERT_EQ(eval(_document, "a.b[2].c"), "test");
+
+    // Only the path to the edit was copied
+    ASSERT_NE(node(edited, "a.b"), node(_document, "a.b"));
+    ASSERT_EQ(node(edited, "a.b[3]"), node(_document, "a.b[3]"));
+}
+
+TEST_F(DocumentTest, add_and_append) {
+    JsonDocument edited = _document
+        .Set("a.d", JsonNumber(5))
+        .Set("a.b[4]", JsonNumber(7));
+
+    ASSERT_EQ(eval(edited, "a.d"), "5");
+    ASSERT_EQ(eval(edited, "a.b[4]"), "7");
+    ASSERT_EQ(eval(_document, "a.b"), "[ 1, 2, { \"c\": \"test\" }, [ 11, 12 ] ]");
+}
+
+TEST_F(DocumentTest, erase) {
+    JsonDocument edited = _document.Erase("a.b[0]").Erase("a.b[1].c");
+
+    ASSERT_EQ(eval(edited, "a.b"), "[ 2, {  }, [ 11, 12 ] ]");
+    ASSERT_EQ(eval(_document, "a.b[2].c"), "test");
+}
+
+TEST_F(DocumentTest, replace_root) {
+    JsonDocument edited = _document.Set("", std::shared_ptr<JsonValue>(std::make_shared<JsonObject>()));
+    ASSERT_EQ(edited.root()->type(), JsonType::Object);
+    ASSERT_EQ(eval(_document, "a.b[1]"), "2");
+}
+
+TEST_F(DocumentTest, errors) {
+    ASSERT_FALSE(_document.TrySet("x.y", JsonNumber(1)).has_value());
+    ASSERT_FALSE(_document.TrySet("a.b[5]", JsonNumber(1)).has_value());
+    ASSERT_FALSE(_document.TryErase("a.b[4]").has_value());
+    ASSERT_FALSE(_document.TryErase("a.x").has_value());
+
+    auto notArray = _document.TrySet("a[0]", JsonNumber(1));
+    ASSERT_FALSE(notArray.has_value());
+    ASSERT_EQ(notArray.error().position, 1);
+}
+
+TEST_F(DocumentTest, wide_containers) {
+    auto text = [](int count, int edited) {
+        std::string array, object;
+        for (int i = 0; i < count; ++i) {
+            std::string value = "\"s" + std::to_string(i == edited ? -1 : i) + "\"";
+            array += (i ? ", " : "") + value;
+            object += (i ? ", \"k" : "\"k") + std::to_string(i) + "\": " + value;
+        }
+        return "{\"a\": [" + array + "], \"o\": {" + object + "}}";
+    };
+    auto parse = [](const std::string& json) {
+        std::istringstream in(json);
+        JsonParser parser;
+        parser.EnableHashing();
+        return JsonDocument(parser.Parse(in));
+    };
+
+    const int count = 100000;
+    JsonDocument document = parse(text(count, count));
+    JsonDocument edited = document
+        .Set("a[70000]", JsonString(std::string("s-1")))
+        .Set("o.k70000", JsonString(std::string("s-1")));
+
+    ASSERT_EQ(eval(edited, "a[70000]"), "s-1");
+    ASSERT_EQ(eval(document, "o.k70000"), "s70000");
+
+    // Elements and members away from the edit are still the old version's
+    ASSERT_EQ(node(edited, "a[5]"), node(document, "a[5]"));
+    ASSERT_EQ(node(edited, "o.k5"), node(document, "o.k5"));
+    ASSERT_NE(node(edited, "a[70000]"), node(document, "a[70000]"));
+
+    // The hashes kept up to date along the path match a fresh parse
+    ASSERT_EQ(JsonHash::Of(*edited.root()), JsonHash::Of(*parse(text(count, 70000)).root()));
+    ASSERT_TRUE(JsonHash::Identical(*edited.root(), *parse(text(count, 70000)).root()));
+}
@@ -0,0 +1,113 @@
+#include <gtest/gtest.h>
+
+#include "core.h"
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/json_parser.h"
+#include "../src/json_eval.h"
+#include "../src/json_extract.h"
+
+class ExtractTest : public EvalTest {
+protected:
+    static JsonExtractor::Record extract(const std::vector<std::string>& paths, const std::string& json) {
+        auto extractor = JsonExtractor::Compile(paths);
+        EXPECT_TRUE(extractor.has_value());
+        std::istringstream in(json);
+        auto record = extractor->Extract(in);
+        EXPECT_TRUE(record.has_value()) << (record ? "" : record.error().what());
+        return record ? *record : JsonExtractor::Record(paths.size());
+    }
+};
+
+TEST_F(ExtractTest, many_paths_one_pass) {
+    std::string json =
+        "{\"id\": 7, \"user\": {\"name\": \"Ann \\\"A\\\"\", \"tags\": [\"x\", \"y\"], \"geo\": {\"lat\": 1.5}},"
+        " \"items\": [{\"p\": 1}, {\"p\": 2, \"q\": [true, null]}, {\"p\": 3}], \"skip\": {\"deep\": [[[{}]]]}}";
+
+    auto record = extract({ "user.name", "items[1].q", "id", "items[2].p", "user.tags[1]", "user.geo",
+                            "missing", "items[9]", "id.x" }, json);
+
+    ASSERT_EQ(record[0], "\"Ann \\\"A\\\"\"");
+    ASSERT_EQ(record[1], "[true,null]");
+    ASSERT_EQ(record[2], "7");
+    ASSERT_EQ(record[3], "3");
+    ASSERT_EQ(record[4], "\"y\"");
+    ASSERT_EQ(record[5], "{\"lat\":1.5}");
+    ASSERT_FALSE(record[6]);
+    ASSERT_FALSE(record[7]);
+    ASSERT_FALSE(record[8]); // not an object
+}
+
+TEST_F(ExtractTest, nested_and_duplicate_paths) {
+    std::string json = "{\"a\": {\"b\": [10, {\"c\": \"d\"}]}, \"e\": 1}";
+
+    auto record = extract({ "a", "a.b[1].c", "", "a.b[0]", "a" }, json);
+    ASSERT_EQ(record[0], "{\"b\":[10,{\"c\":\"d\"}]}");
+    ASSERT_EQ(record[1], "\"d\"");
+    ASSERT_EQ(record[2], "{\"a\":{\"b\":[10,{\"c\":\"d\"}]},\"e\":1}");
+    ASSERT_EQ(record[3], "10");
+    ASSERT_EQ(record[4], record[0]);
+}
+
+TEST_F(ExtractTest, matches_evaluator) {
+    std::ifstream file(_testDirectory + "test.json");
+    ASSERT_TRUE(file.is_open());
+    std::stringstream text;
+    text << file.rdbuf();
+
+    std::vector<std::string> paths = { "a.b[0]", "a.b[2].c", "a.b[3][1]" };
+    auto record = extract(paths, text.str());
+
+    JsonParser parser;
+    std::istringstream in(text.str());
+    JsonEval evaluator(parser.Parse(in));
+    for (size_t i = 0; i < paths.size(); ++i) {
+        std::istringstream value(*record[i] + "\n"); // numbers end at a delimiter
+        JsonParser valueParser;
+        auto parsed = valueParser.ParseValue(value);
+
+        std::ostringstream expected, actual;
+        expected << *evaluator.EvaluateExpression(paths[i]);
+        actual << *parsed;
+        ASSERT_EQ(actual.str(), expected.str()) << paths[i];
+    }
+}
+
+TEST_F(ExtractTest, stops_after_last_path) {
+    // Everything after the requested values is never read, malformed or not
+    auto record = extract({ "a[1]" }, "{\"a\": [1, 2, oops");
+    ASSERT_EQ(record[0], "2");
+
+    std::ostringstream out;
+    auto extractor = JsonExtractor::Compile({ "a[1]", "b\"c" });
+    extractor->Write(out, { record[0], std::nullopt });
+    ASSERT_EQ(out.str(), "{\"a[1]\": 2, \"b\\\"c\": null}");
+}
+
+TEST_F(ExtractTest, errors) {
+    ASSERT_FALSE(JsonExtractor::Compile({ "a", "b[x]" }).has_value());
+    ASSERT_FALSE(JsonExtractor::Compile({ "a." }).has_value());
+
+    auto extractor = JsonExtractor::Compile({ "a.b", "z" });
+    std::istringstream in("{\"a\": {\"b\": 1, \"c\" 5}, \"z\": 0}");
+    auto record = extractor->Extract(in);
+    ASSERT_FALSE(record.has_value());
+    ASSERT_EQ(record.error().position, 19u);
+}
+
+TEST_F(ExtractTest, duplicate_keys) {
+    // A repeated key counts once towards the paths still to find
+    auto record = extract({ "a", "b" }, "{\"a\": 1, \"a\": 2, \"b\": 3}");
+    ASSERT_EQ(record[0], "2");
+    ASSERT_EQ(record[1], "3");
+
+    record = extract({ "a.x", "a.y", "c" }, "{\"a\": {\"x\": 1}, \"a\": {\"x\": 2, \"y\": 3}, \"c\": 4}");
+    ASSERT_EQ(record[0], "2");
+    ASSERT_EQ(record[1], "3");
+    ASSERT_EQ(record[2], "4");
+}
@@ -3,6 +3,7 @@
 #include "core.h"
 
 #include <memory>
+#include <memory_resource>
 #include <sstream>
 #include <fstream>
 #include <stdexcept>
@@ -10,6 +11,7 @@
 
 #include "../src/json_parser.h"
 #include "../src/json_eval.h"
+#include "../src/json_reader.h"
 
 class FailTest : public EvalTest {
 protected:
@@ -27,11 +29,9 @@ protected:
         file.close();
 
         JsonEval evaluator(root);
-        std::shared_ptr<JsonValue> expressionResult{};
-
-        std::string exprCopy = expression;
+        std::shared_ptr<const JsonValue> expressionResult{};
         try {
-            expressionResult = evaluator.EvaluateExpression(root, exprCopy);
+            expressionResult = evaluator.EvaluateExpression(expression);
             ADD_FAILURE() << "Expected exception was not thrown.";
         } catch (const std::runtime_error& e) {
             TEST_COUT << "Exception: " << e.what() << std::endl;
@@ -63,4 +63,175 @@ TEST_F(FailTest, index_out_of_range) {
 
 TEST_F(FailTest, index_out_of_range_negative) {
     evalExpr_Fail("test.json", "a.b[-1]");
-}
\ No newline at end of file
+}
+
+TEST_F(FailTest, error_position) {
+    std::ifstream file(_testDirectory + "test.json");
+    ASSERT_TRUE(file.is_open());
+
+    JsonParser parser;
+    auto root = parser.TryParse(file);
+    ASSERT_TRUE(root.has_value());
+
+    JsonEval evaluator(*root);
+
+    auto result = evaluator.TryEvaluateExpression("a.b[a.x]");
+    ASSERT_FALSE(result.has_value());
+    ASSERT_EQ(result.error().position, 6);
+}
+
+TEST_F(FailTest, parse_error_position) {
+    std::istringstream in("{\"a\": [1, 2 3]}");
+
+    JsonParser parser;
+    auto root = parser.TryParse(in);
+    ASSERT_FALSE(root.has_value());
+    ASSERT_EQ(root.error().line, 1);
+    ASSERT_EQ(root.error().column, 13);
+}
+
+TEST_F(FailTest, depth_limit) {
+    // Far deeper than the native stack could recurse
+    const int depth = 1000000;
+    std::string json = "{\"a\": " + std::string(depth, '[') + std::string(depth, ']') + "}";
+
+    std::istringstream in(json);
+    JsonParser parser;
+    auto root = parser.TryParse(in);
+    ASSERT_FALSE(root.has_value());
+    ASSERT_NE(root.error().message.find("maximum depth"), std::string::npos);
+
+    JsonParser::Limits limits;
+    limits.maxDepth = 4;
+    parser = JsonParser();
+    parser.SetLimits(limits);
+    std::istringstream fits("{\"a\": [[{\"b\": 1}]]}");
+    ASSERT_TRUE(parser.TryParse(fits).has_value());
+
+    parser = JsonParser();
+    parser.SetLimits(limits);
+    std::istringstream deep("{\"a\": [[{\"b\": [1]}]]}");
+    auto result = parser.TryParse(deep);
+    ASSERT_FALSE(result.has_value());
+    ASSERT_EQ(result.error().column, 15);
+}
+
+TEST_F(FailTest, size_and_string_limits) {
+    JsonParser::Limits limits;
+    limits.maxDocumentSize = 16;
+    JsonParser parser;
+    parser.SetLimits(limits);
+    std::istringstream small("{\"a\": [1, 2]}");
+    ASSERT_TRUE(parser.TryParse(small).has_value());
+
+    parser = JsonParser();
+    parser.SetLimits(limits);
+    std::istringstream large("{\"a\": [1, 2, 3, 4, 5]}");
+    auto result = parser.TryParse(large);
+    ASSERT_FALSE(result.has_value());
+    ASSERT_NE(result.error().message.find("maximum size"), std::string::npos);
+
+    limits = JsonParser::Limits();
+    limits.maxStringLength = 3;
+    parser = JsonParser();
+    parser.SetLimits(limits);
+    std::istringstream fits("{\"abc\": \"\\u00e9x\"}");
+    ASSERT_TRUE(parser.TryParse(fits).has_value());
+
+    for (const char* json : { "{\"a\": \"abcd\"}", "{\"abcd\": 1}" }) {
+        parser = JsonParser();
+        parser.SetLimits(limits);
+        std::istringstream in(json);
+        auto failed = parser.TryParse(in);
+        ASSERT_FALSE(failed.has_value()) << json;
+        ASSERT_NE(failed.error().message.find("maximum length"), std::string::npos);
+    }
+}
+
+TEST_F(FailTest, reused_parser) {
+    JsonParser::Limits limits;
+    limits.maxDocumentSize = 16;
+    JsonParser parser;
+    parser.SetLimits(limits);
+
+    // Each document gets the whole size limit and its own positions
+    for (int i = 0; i < 3; ++i) {
+        std::istringstream small("{\"a\": [1, 2]}");
+        ASSERT_TRUE(parser.TryParseValue(small).has_value()) << i;
+    }
+
+    // Errors are placed as a new parser would place them
+    std::string bad = "\n{\"a\": ]}";
+    std::istringstream in(bad);
+    auto result = parser.TryParseValue(in);
+    ASSERT_FALSE(result.has_value());
+
+    JsonParser fresh;
+    std::istringstream again(bad);
+    auto expected = fresh.TryParseValue(again);
+    ASSERT_EQ(result.error().line, 2);
+    ASSERT_EQ(result.error().line, expected.error().line);
+    ASSERT_EQ(result.error().column, expected.error().column);
+    ASSERT_EQ(result.error().position, expected.error().position);
+
+    std::istringstream good("[true]");
+    ASSERT_TRUE(parser.TryParseValue(good).has_value());
+}
+
+TEST_F(FailTest, reused_parser_after_release) {
+    // Records of a JSON Lines worker: each one's nodes are dropped with the
+    // arena before the next record is parsed
+    char initial[1024];
+    std::pmr::monotonic_buffer_resource arena(initial, sizeof(initial));
+    JsonParser parser(&arena);
+
+    // Fails inside nested containers holding more nodes than the initial buffer
+    std::string bad = "{\"a\": [";
+    for (int i = 0; i < 200; ++i) {
+        bad += "{\"k\": [0, \"" + std::string(40, 'x') + "\"]}, ";
+    }
+    bad += "{\"k\": [1, bad";
+    std::istringstream in(bad);
+    ASSERT_FALSE(parser.TryParseValue(in).has_value());
+    arena.release();
+
+    std::istringstream good("{\"a\": [{\"k\": [1]}]}");
+    auto root = parser.TryParseValue(good);
+    ASSERT_TRUE(root.has_value()) << root.error().what();
+    ASSERT_EQ((*root)->type(), JsonType::Object);
+    root->reset();
+    arena.release();
+}
+
+TEST_F(FailTest, expression_nesting_limit) {
+    std::istringstream in("{\"a\": [0]}");
+    JsonParser parser;
+    JsonEval evaluator(parser.Parse(in));
+
+    ASSERT_TRUE(evaluator.TryEvaluateExpression("a[a[a[0]]]").has_value());
+
+    std::string deep = "a[0]";
+    for (int i = 0; i < JsonEval::MaxNesting + 1; ++i) {
+        deep = "a[" + deep + "]";
+    }
+    auto result = evaluator.TryEvaluateExpression(deep);
+    ASSERT_FALSE(result.has_value());
+    ASSERT_NE(result.error().message.find("maximum depth"), std::string::npos);
+
+    std::string calls = "a";
+    for (int i = 0; i < 100000; ++i) {
+        calls = "sort(" + calls;
+    }
+    ASSERT_FALSE(evaluator.TryEvaluateExpression(calls).has_value());
+}
+
+TEST_F(FailTest, read_ahead_error) {
+    // A directory opens, but reading it fails
+    JsonReadAheadBuffer buffer(_testDirectory);
+    ASSERT_TRUE(buffer.is_open());
+    std::istream in(&buffer);
+
+    JsonParser parser;
+    ASSERT_FALSE(parser.TryParse(in).has_value());
+    ASSERT_FALSE(buffer.error().empty());
+}
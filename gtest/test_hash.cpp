@@ -0,0 +1,110 @@
+#include <gtest/gtest.h>
+
+#include "core.h"
+
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/json_parser.h"
+#include "../src/json_eval.h"
+#include "../src/json_document.h"
+#include "../src/json_hash.h"
+
+class HashTest : public EvalTest {
+protected:
+    // Hashed while parsing unless `hashing` is false
+    static std::shared_ptr<JsonValue> parse(const std::string& json, bool hashing = true) {
+        JsonParser parser;
+        parser.EnableHashing(hashing);
+        return EvalTest::parse(json, parser);
+    }
+};
+
+TEST_F(HashTest, member_order_is_ignored) {
+    auto a = parse("{\"x\": 1, \"y\": [true, null, \"s\"], \"z\": {\"k\": 2.5}}");
+    auto b = parse("{\"z\": {\"k\": 2.5}, \"y\": [true, null, \"s\"], \"x\": 1}");
+    auto c = parse("{\"x\": 1, \"y\": [null, true, \"s\"], \"z\": {\"k\": 2.5}}");
+
+    ASSERT_NE(static_cast<const JsonObject&>(*a).hash(), 0u);
+    ASSERT_TRUE(JsonHash::Equal(*a, *b));
+    ASSERT_FALSE(JsonHash::Equal(*a, *c)); // array order matters
+}
+
+TEST_F(HashTest, types_are_distinguished) {
+    ASSERT_FALSE(JsonHash::Equal(*parse("{\"a\": []}"), *parse("{\"a\": {}}")));
+    ASSERT_FALSE(JsonHash::Equal(*parse("{\"a\": \"1\"}"), *parse("{\"a\": 1}")));
+    ASSERT_FALSE(JsonHash::Equal(*parse("{\"a\": null}"), *parse("{\"a\": false}")));
+    ASSERT_TRUE(JsonHash::Equal(*parse("{\"a\": 1.0}"), *parse("{\"a\": 1}")));
+}
+
+TEST_F(HashTest, stored_matches_computed) {
+    std::string json = "{\"a\": {\"b\": [1, 2, {\"c\": \"test\"}, [11, 12]]}}";
+    auto hashed = parse(json);
+    auto plain = parse(json, false);
+
+    ASSERT_EQ(static_cast<const JsonObject&>(*plain).hash(), 0u);
+    ASSERT_EQ(JsonHash::Of(*hashed), JsonHash::Of(*plain));
+    ASSERT_EQ(JsonHash::Store(*plain), JsonHash::Of(*hashed));
+}
+
+TEST_F(HashTest, diff_skips_equal_subtrees) {
+    auto a = parse("{\"a\": {\"b\": [1, 2, {\"c\": \"test\"}]}, \"same\": [1, 2], \"gone\": 1}");
+    auto b = parse("{\"same\": [1, 2], \"a\": {\"b\": [1, 3, {\"c\": \"test\"}, 4]}, \"new\": 1}");
+
+    std::vector<std::string> changes = JsonHash::Diff(*a, *b);
+    std::sort(changes.begin(), changes.end());
+    ASSERT_EQ(changes, (std::vector<std::string>{ "a.b[1]", "a.b[3]", "gone", "new" }));
+    ASSERT_TRUE(JsonHash::Diff(*a, *a).empty());
+}
+
+TEST_F(HashTest, document_edits_keep_hashes) {
+    JsonDocument document(parse("{\"a\": {\"b\": [1, 2, {\"c\": \"test\"}]}}"));
+    JsonDocument edited = document.Set("a.b[2].c", JsonString(std::string("x")));
+
+    const JsonObject& root = static_cast<const JsonObject&>(*edited.root());
+    ASSERT_NE(root.hash(), 0u);
+    ASSERT_EQ(root.hash(), JsonHash::Of(*parse("{\"a\": {\"b\": [1, 2, {\"c\": \"x\"}]}}")));
+    ASSERT_FALSE(JsonHash::Equal(*document.root(), *edited.root()));
+}
+
+TEST_F(HashTest, query_cache) {
+    JsonQueryCache cache;
+    JsonEval first(parse("{\"a\": {\"b\": [1, 2]}, \"c\": 3}"));
+    JsonEval second(parse("{\"c\": 3, \"a\": {\"b\": [1, 2]}}"));
+
+    auto result = cache.Evaluate(first, "a.b[1]");
+    ASSERT_TRUE(result.has_value());
+    ASSERT_EQ(cache.hits(), 0u);
+
+    // Structurally equal document: served from the cache
+    auto cached = cache.Evaluate(second, "a.b[1]");
+    ASSERT_TRUE(cached.has_value());
+    ASSERT_EQ(cache.hits(), 1u);
+    ASSERT_EQ(cached->get(), result->get());
+
+    ASSERT_FALSE(cache.Evaluate(second, "x").has_value());
+    ASSERT_FALSE(cache.Evaluate(first, "x").has_value());
+    ASSERT_EQ(cache.hits(), 2u);
+}
+
+TEST_F(HashTest, query_cache_tells_integers_from_doubles) {
+    // Equal as JSON numbers, but only an integer can index
+    JsonQueryCache cache;
+    JsonEval doubles(parse("{\"i\": 1.0, \"a\": [5, 6]}"));
+    JsonEval integers(parse("{\"i\": 1, \"a\": [5, 6]}"));
+    ASSERT_EQ(JsonHash::Of(*doubles.root()), JsonHash::Of(*integers.root()));
+    ASSERT_FALSE(JsonHash::Identical(*doubles.root(), *integers.root()));
+
+    ASSERT_FALSE(cache.Evaluate(doubles, "a[i]").has_value());
+    auto result = cache.Evaluate(integers, "a[i]");
+    ASSERT_TRUE(result.has_value()) << result.error().what();
+    ASSERT_EQ(static_cast<const JsonNumber&>(**result).value(), 6);
+    ASSERT_EQ(cache.hits(), 0u);
+
+    // The entry now belongs to the integer tree
+    ASSERT_TRUE(cache.Evaluate(integers, "a[i]").has_value());
+    ASSERT_EQ(cache.hits(), 1u);
+}
@@ -0,0 +1,61 @@
+#include <gtest/gtest.h>
+
+#include "core.h"
+
+#include <sstream>
+#include <fstream>
+#include <string>
+
+#include "../src/json_index.h"
+
+class IndexTest : public EvalTest {
+protected:
+    void queryIndexed(const std::string& fileName, const std::string& expression, const std::string& expected) {
+        std::string filePath = _testDirectory + fileName;
+
+        JsonIndex::Options options;
+        options.stride = 2;
+
+        auto index = JsonIndex::Build(filePath, options);
+        ASSERT_TRUE(index.has_value()) << index.error().what();
+
+        std::ifstream file(filePath, std::ios::binary);
+        ASSERT_TRUE(file.is_open());
+
+        auto result = index->Query(file, expression);
+        ASSERT_TRUE(result.has_value()) << result.error().what();
+
+        std::stringstream out;
+        out << **result;
+        ASSERT_EQ(out.str(), expected);
+    }
+};
+
+TEST_F(IndexTest, indexed_element) {
+    queryIndexed("test.json", "a.b[2].c", "test");
+}
+
+TEST_F(IndexTest, between_strides) {
+    queryIndexed("test.json", "a.b[3][1]", "12");
+}
+
+TEST_F(IndexTest, below_indexed_depth) {
+    queryIndexed("object/01-members.json", "nested.y.z[1]", "b");
+}
+
+TEST_F(IndexTest, out_of_range) {
+    auto index = JsonIndex::Build(_testDirectory + "test.json", JsonIndex::Options());
+    ASSERT_TRUE(index.has_value());
+
+    std::ifstream file(_testDirectory + "test.json", std::ios::binary);
+    auto result = index->Query(file, "a.b[4]");
+    ASSERT_FALSE(result.has_value());
+    ASSERT_EQ(result.error().position, 3);
+}
+
+TEST_F(IndexTest, dotted_keys) {
+    // Keys that look like paths do not shadow the paths
+    queryIndexed("object/02-dotted_keys.json", "a.b", "2");
+    queryIndexed("object/02-dotted_keys.json", "c[0]", "4");
+    queryIndexed("object/02-dotted_keys.json", "d\\.e", "5");
+}
@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+
+#include "core.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/json_parser.h"
+#include "../src/json_eval.h"
+#include "../src/json_hash.h"
+#include "../src/json_intern.h"
+#include "../src/json_memory.h"
+
+class InternTest : public EvalTest {
+protected:
+    static std::shared_ptr<JsonValue> parse(const std::string& json, std::shared_ptr<JsonInternTable> table) {
+        JsonParser parser;
+        parser.SetInternTable(std::move(table));
+        return EvalTest::parse(json, parser);
+    }
+
+    // `count` log records that repeat a few values
+    static std::string records(size_t count) {
+        std::string json = "{\"log\": [";
+        for (size_t i = 0; i < count; ++i) {
+            json += std::string(i ? "," : "")
+                + "{\"host\": \"api-" + std::to_string(i % 3) + ".internal.example.com\","
+                + " \"status\": {\"code\": " + std::to_string(200 + (i % 2) * 300) + ", \"text\": \"ok\"},"
+                + " \"id\": " + std::to_string(i) + "}";
+        }
+        return json + "]}";
+    }
+};
+
+TEST_F(InternTest, repeats_share_nodes) {
+    auto table = std::make_shared<JsonInternTable>();
+    JsonEval eval(parse(records(10), table));
+
+    // Long strings and small subtrees are shared, short strings stay inline
+    ASSERT_EQ(*eval.Query("log[0].host"), *eval.Query("log[3].host"));
+    ASSERT_NE(*eval.Query("log[0].host"), *eval.Query("log[1].host"));
+    ASSERT_EQ(*eval.Query("log[0].status"), *eval.Query("log[2].status"));
+    ASSERT_NE(*eval.Query("log[0].status"), *eval.Query("log[1].status"));
+    ASSERT_NE(*eval.Query("log[0]"), *eval.Query("log[1]")); // ids differ
+
+    JsonInternTable::Stats stats = table->stats();
+    ASSERT_EQ(stats.strings, 10u);
+    ASSERT_EQ(stats.stringHits, 7u);
+    ASSERT_EQ(stats.containers, 10u + 10u + 2u); // statuses, records, the log array and the root
+    ASSERT_EQ(stats.containerHits, 8u);
+    ASSERT_GT(stats.bytesSaved, 0u);
+}
+
+TEST_F(InternTest, same_tree) {
+    std::string json = records(50);
+    auto plain = parse(json, nullptr);
+    auto deduped = parse(json, std::make_shared<JsonInternTable>());
+
+    ASSERT_EQ(JsonHash::Of(*plain), JsonHash::Of(*deduped));
+    ASSERT_TRUE(JsonHash::Diff(*plain, *deduped).empty());
+
+    std::ostringstream a, b;
+    a << *JsonEval(plain).EvaluateExpression("log[*].status.code");
+    b << *JsonEval(deduped).EvaluateExpression("log[*].status.code");
+    ASSERT_EQ(a.str(), b.str());
+
+    // Shared nodes are stored once
+    JsonMemory::Report before = JsonMemory::Measure(*plain);
+    JsonMemory::Report after = JsonMemory::Measure(*deduped);
+    for (int type = 0; type < 6; ++type) {
+        ASSERT_EQ(before.types[type].count, after.types[type].count);
+    }
+    ASSERT_LT(after.types[(int)JsonType::String].compactBytes, before.types[(int)JsonType::String].compactBytes);
+    ASSERT_LT(after.types[(int)JsonType::Object].compactBytes, before.types[(int)JsonType::Object].compactBytes);
+}
+
+TEST_F(InternTest, exact_matches_only) {
+    auto table = std::make_shared<JsonInternTable>();
+    JsonEval eval(parse("{\"a\": [{\"x\": 1}, {\"x\": 1.0}, [1], [1.0], {\"x\": 1}]}", table));
+
+    // Equal as JSON numbers but not interchangeable
+    ASSERT_NE(*eval.Query("a[0]"), *eval.Query("a[1]"));
+    ASSERT_NE(*eval.Query("a[2]"), *eval.Query("a[3]"));
+    ASSERT_EQ(*eval.Query("a[0]"), *eval.Query("a[4]"));
+}
+
+TEST_F(InternTest, large_containers_not_interned) {
+    JsonInternTable::Options options;
+    options.maxContainerSize = 2;
+    auto table = std::make_shared<JsonInternTable>(options);
+
+    JsonEval eval(parse("{\"a\": [[1, 2, 3], [1, 2, 3], [[1], [1]], [[1], [1]]]}", table));
+    ASSERT_NE(*eval.Query("a[0]"), *eval.Query("a[1]"));
+    ASSERT_EQ(*eval.Query("a[2]"), *eval.Query("a[3]"));
+
+    // Nor is anything above a container that was not
+    JsonEval nested(parse("{\"a\": [{\"b\": [1, 2, 3]}, {\"b\": [1, 2, 3]}]}", table));
+    ASSERT_NE(*nested.Query("a[0]"), *nested.Query("a[1]"));
+}
+
+TEST_F(InternTest, shared_by_threads) {
+    auto table = std::make_shared<JsonInternTable>();
+    std::string json = records(200);
+
+    std::vector<std::shared_ptr<JsonValue>> roots(4);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < roots.size(); ++t) {
+        threads.emplace_back([&, t] { roots[t] = parse(json, table); });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    // Every tree uses the same nodes, and the table outlives none of them
+    const JsonValue* status = *JsonEval(roots[0]).Query("log[0].status");
+    for (const auto& root : roots) {
+        ASSERT_EQ(*JsonEval(root).Query("log[10].status"), status);
+    }
+    ASSERT_EQ(table->stats().strings, 4 * 200u);
+    ASSERT_EQ(table->stats().stringHits, 4 * 200u - 3);
+
+    table.reset();
+    std::ostringstream out;
+    out << *JsonEval(roots[1]).EvaluateExpression("log[4].host");
+    ASSERT_EQ(out.str(), "api-1.internal.example.com");
+}
@@ -0,0 +1,154 @@
+#include <gtest/gtest.h>
+
+#include "core.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/json_parser.h"
+#include "../src/json_eval.h"
+#include "../src/json_intrinsics.h"
+
+class IntrinsicsTest : public EvalTest {
+protected:
+    static std::vector<double> numbers(const JsonValue& value) {
+        std::vector<double> result;
+        const auto& array = static_cast<const JsonArray&>(value);
+        for (size_t i = 0; i < array.size(); ++i) {
+            result.push_back(array.isPacked() ? array.number(i).value()
+                                              : static_cast<const JsonNumber*>(array.at(i))->value());
+        }
+        return result;
+    }
+
+    static std::vector<std::string> strings(const JsonValue& value) {
+        std::vector<std::string> result;
+        const auto& array = static_cast<const JsonArray&>(value);
+        for (const JsonSlot& element : array.elements()) {
+            result.emplace_back(static_cast<const JsonString*>(element.get())->value());
+        }
+        return result;
+    }
+
+    // Large enough to take the multi-threaded paths
+    static std::string randomArray(size_t size, unsigned seed) {
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<int> dist(-1000, 1000);
+        std::string json = "{\"a\": [";
+        for (size_t i = 0; i < size; ++i) {
+            json += (i ? "," : "") + std::to_string(dist(rng));
+        }
+        return json + "]}";
+    }
+};
+
+TEST_F(IntrinsicsTest, topk) {
+    JsonEval eval(parse("{\"a\": [5, 1, 9, 3, 9, 7]}"));
+
+    ASSERT_EQ(numbers(*eval.EvaluateExpression("topk(a, 3)")), (std::vector<double>{ 9, 9, 7 }));
+    ASSERT_EQ(numbers(*eval.EvaluateExpression("topk(a,0)")), std::vector<double>{});
+    ASSERT_EQ(numbers(*eval.EvaluateExpression("topk(a, 100)")), (std::vector<double>{ 9, 9, 7, 5, 3, 1 }));
+}
+
+TEST_F(IntrinsicsTest, sort_and_distinct) {
+    JsonEval eval(parse("{\"n\": [3, 1.5, -2, 3], \"s\": [\"pear\", \"apple\", \"fig\", \"apple\"]}"));
+
+    ASSERT_EQ(numbers(*eval.EvaluateExpression("sort(n)")), (std::vector<double>{ -2, 1.5, 3, 3 }));
+    ASSERT_EQ(strings(*eval.EvaluateExpression("sort(s)")), (std::vector<std::string>{ "apple", "apple", "fig", "pear" }));
+    ASSERT_EQ(numbers(*eval.EvaluateExpression("distinct(n)")), (std::vector<double>{ 3, 1.5, -2 }));
+    ASSERT_EQ(strings(*eval.EvaluateExpression("sort(distinct(s))")), (std::vector<std::string>{ "apple", "fig", "pear" }));
+}
+
+TEST_F(IntrinsicsTest, distinct_mixed_values) {
+    JsonEval eval(parse("{\"a\": [1, \"1\", true, null, 1.0, {\"k\": [2]}, true, {\"k\": [2]}, null, [1]]}"));
+
+    auto result = eval.EvaluateExpression("distinct(a)");
+    const auto& array = static_cast<const JsonArray&>(*result);
+    ASSERT_EQ(array.size(), 6u);
+    ASSERT_EQ(array.at(4)->type(), JsonType::Object);
+    ASSERT_EQ(array.at(5)->type(), JsonType::Array);
+}
+
+TEST_F(IntrinsicsTest, projection_and_sortby) {
+    JsonEval eval(parse(
+        "{\"items\": [{\"name\": \"b\", \"p\": {\"v\": 20}}, {\"name\": \"a\", \"p\": {\"v\": 5}},"
+        " {\"name\": \"c\", \"p\": {\"v\": 12}}]}"));
+
+    ASSERT_EQ(numbers(*eval.EvaluateExpression("items[*].p.v")), (std::vector<double>{ 20, 5, 12 }));
+    ASSERT_EQ(numbers(*eval.EvaluateExpression("topk(items[*].p.v, 2)")), (std::vector<double>{ 20, 12 }));
+
+    auto sorted = eval.EvaluateExpression("sortby(items[*], p.v)");
+    ASSERT_EQ(strings(*eval.EvaluateExpression("items[*].name")), (std::vector<std::string>{ "b", "a", "c" }));
+
+    // Objects of the result are the nodes of the tree
+    const auto& array = static_cast<const JsonArray&>(*sorted);
+    ASSERT_EQ(array.size(), 3u);
+    ASSERT_EQ(array.at(0), *eval.Query("items[1]"));
+    ASSERT_EQ(array.at(1), *eval.Query("items[2]"));
+    ASSERT_EQ(array.at(2), *eval.Query("items[0]"));
+}
+
+TEST_F(IntrinsicsTest, result_outlives_evaluator) {
+    std::shared_ptr<const JsonValue> result;
+    {
+        JsonEval eval(parse("{\"a\": [{\"x\": 2}, {\"x\": 1}]}"));
+        result = eval.EvaluateExpression("sortby(a, x)");
+    }
+    const auto& array = static_cast<const JsonArray&>(*result);
+    const auto& first = static_cast<const JsonObject&>(*array.at(0));
+    ASSERT_EQ(static_cast<const JsonNumber*>(first.find("x"))->value(), 1);
+}
+
+TEST_F(IntrinsicsTest, errors) {
+    JsonEval eval(parse("{\"a\": [1, \"x\"], \"b\": {\"c\": 1}, \"o\": [{\"k\": 1}, {\"j\": 2}], \"n\": [3, 1]}"));
+
+    auto expectError = [&](const std::string& expression, size_t position) {
+        auto result = eval.TryEvaluateExpression(expression);
+        ASSERT_FALSE(result) << expression;
+        ASSERT_EQ(result.error().position, position) << expression << ": " << result.error().what();
+    };
+
+    expectError("topk(a, 1)", 0);        // mixed numbers and strings
+    expectError("sort(b)", 5);           // not an array
+    expectError("max(n)", 0);            // unknown function
+    expectError("topk(n)", 6);           // missing k
+    expectError("topk(n, -1)", 8);       // negative k
+    expectError("sort(n", 6);            // missing ')'
+    expectError("sortby(o, k)", 0);      // key missing in an element
+    expectError("sortby(n, k)", 0);      // not objects
+    expectError("o[*].k", 5);            // key missing in an element
+    expectError("b[*]", 1);              // projection of an object
+    expectError("sort(n)x", 7);
+
+    // Named once, by the caller
+    ASSERT_EQ(eval.TryEvaluateExpression("sortby(n, k)").error().message, "sortby: Expected an array of objects.");
+
+    // Query() only hands out nodes of the tree
+    ASSERT_FALSE(eval.Query("sort(n)"));
+    ASSERT_FALSE(eval.Query("n[*]"));
+    ASSERT_FALSE(eval.Query("n[1]")); // packed
+    ASSERT_TRUE(eval.Query("o[1]"));
+}
+
+TEST_F(IntrinsicsTest, parallel_matches_sequential) {
+    const size_t size = JsonIntrinsics::ParallelThreshold * 4 + 17;
+    JsonEval eval(parse(randomArray(size, 7)));
+
+    std::vector<double> values = numbers(*eval.Query("a").value());
+    ASSERT_EQ(values.size(), size);
+
+    std::vector<double> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    ASSERT_EQ(numbers(*eval.EvaluateExpression("sort(a)")), sorted);
+
+    std::vector<double> top(sorted.rbegin(), sorted.rbegin() + 1000);
+    ASSERT_EQ(numbers(*eval.EvaluateExpression("topk(a, 1000)")), top);
+
+    auto distinct = numbers(*eval.EvaluateExpression("distinct(a)"));
+    ASSERT_EQ(distinct.size(), 2001u);
+    ASSERT_EQ(distinct.front(), values.front());
+}
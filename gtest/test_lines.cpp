@@ -0,0 +1,184 @@
+#include <gtest/gtest.h>
+
+#include "core.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <sstream>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/json_lines.h"
+
+class LinesTest : public EvalTest {
+protected:
+    size_t runLines(const std::string& fileName, const std::string& expression, 
+                    const JsonLines::Options& options, std::string& output)
+    {
+        std::string filePath = _testDirectory + fileName;
+        std::ifstream file(filePath);
+        if (!file.is_open()) {
+            throw std::runtime_error("Could not open file: " + filePath);
+        }
+
+        std::stringstream out;
+        std::stringstream err;
+
+        JsonLines driver(expression, options);
+        size_t failed = driver.Run(file, out, err);
+
+        if (!err.str().empty()) {
+            TEST_COUT << err.str();
+        }
+
+        output = out.str();
+        return failed;
+    }
+
+    // Output lines in sorted order, for runs that may reorder records
+    static std::vector<std::string> sortedLines(const std::string& output) {
+        std::vector<std::string> lines;
+        std::istringstream in(output);
+        for (std::string line; std::getline(in, line);) {
+            lines.push_back(line);
+        }
+        std::sort(lines.begin(), lines.end());
+        return lines;
+    }
+};
+
+TEST_F(LinesTest, ordered) {
+    JsonLines::Options options;
+    options.threads = 4;
+    options.chunkSize = 8; // several chunks per record
+
+    std::string output;
+    ASSERT_EQ(runLines("lines/01-records.jsonl", "a.b[1]", options, output), 0);
+    ASSERT_EQ(output, "true\nfalse\nnull\n");
+}
+
+TEST_F(LinesTest, unordered) {
+    JsonLines::Options options;
+    options.ordered = false;
+    options.threads = 4;
+    options.chunkSize = 8;
+
+    // Every record's result exactly once, in any order
+    std::string output;
+    ASSERT_EQ(runLines("lines/01-records.jsonl", "a.b[0]", options, output), 0);
+    ASSERT_EQ(output.back(), '\n');
+    ASSERT_EQ(sortedLines(output), (std::vector<std::string>{ "1", "2", "3" }));
+}
+
+TEST_F(LinesTest, missing_key) {
+    JsonLines::Options options;
+
+    std::string output;
+    ASSERT_EQ(runLines("lines/01-records.jsonl", "a.c", options, output), 3);
+    ASSERT_EQ(output, "");
+}
+
+namespace {
+
+// Output written by a following thread while the test reads it
+class SharedOutput : public std::stringbuf {
+public:
+    std::string text() {
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        return str();
+    }
+
+    // Waits up to five seconds for `expected`
+    bool waitFor(const std::string& expected) {
+        for (int i = 0; i < 500; ++i) {
+            if (text() == expected) {
+                return true;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    }
+
+protected:
+    // xsputn() may call overflow()
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        return std::stringbuf::xsputn(s, n);
+    }
+
+    int_type overflow(int_type ch) override {
+        std::lock_guard<std::recursive_mutex> lock(_mutex);
+        return std::stringbuf::overflow(ch);
+    }
+
+private:
+    std::recursive_mutex _mutex;
+};
+
+void append(const std::string& path, const std::string& text) {
+    std::ofstream file(path, std::ios::binary | std::ios::app);
+    file << text;
+}
+
+} // namespace
+
+TEST_F(LinesTest, follow_appended_lines) {
+    std::string path = (std::filesystem::temp_directory_path() / "json_eval_follow_test.jsonl").string();
+    std::ofstream(path, std::ios::binary) << "{\"a\": 1}\n{\"a\": 2}\n{\"a\"";
+
+    JsonLines::Options options;
+    options.pollInterval = 10;
+    JsonLines driver("a", options);
+
+    SharedOutput outBuffer, errBuffer;
+    std::ostream out(&outBuffer), err(&errBuffer);
+    JsonResult<size_t> failed = JsonError{};
+    std::thread follower([&] { failed = driver.Follow(path, out, err); });
+    struct Join { // also when an assertion returns early
+        JsonLines& driver;
+        std::thread& thread;
+        ~Join() {
+            if (thread.joinable()) {
+                driver.Stop();
+                thread.join();
+            }
+        }
+    } join{ driver, follower };
+
+    // The incomplete last line waits for its newline
+    ASSERT_TRUE(outBuffer.waitFor("1\n2\n")) << outBuffer.text();
+    append(path, ": 3}\n{\"b\": 4}\n");
+    ASSERT_TRUE(outBuffer.waitFor("1\n2\n3\n")) << outBuffer.text();
+    ASSERT_TRUE(errBuffer.waitFor("[JSON lines] Line 4: [Position: 0]: Key \"a\" was not found in parent object.\n"))
+        << errBuffer.text();
+
+    // Truncated and rewritten: read from the start again
+    std::ofstream(path, std::ios::binary | std::ios::trunc) << "{\"a\": 5}\n";
+    ASSERT_TRUE(outBuffer.waitFor("1\n2\n3\n5\n")) << outBuffer.text();
+
+    driver.Stop();
+    follower.join();
+    ASSERT_TRUE(failed.has_value());
+    ASSERT_EQ(*failed, 1u);
+
+    std::filesystem::remove(path);
+}
+
+TEST_F(LinesTest, follow_stopped_before_start) {
+    // Reads what is there, then returns
+    JsonLines driver("a.b[0]");
+    driver.Stop();
+
+    std::stringstream out, err;
+    auto failed = driver.Follow(_testDirectory + "lines/01-records.jsonl", out, err);
+    ASSERT_TRUE(failed.has_value());
+    ASSERT_EQ(*failed, 0u);
+    ASSERT_EQ(out.str(), "1\n2\n3\n");
+
+    ASSERT_FALSE(driver.Follow(_testDirectory + "lines/missing.jsonl", out, err).has_value());
+}
@@ -0,0 +1,208 @@
+#include <gtest/gtest.h>
+
+#include "core.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/json_parser.h"
+#include "../src/json_eval.h"
+#include "../src/json_document.h"
+#include "../src/json_hash.h"
+#include "../src/json_memory.h"
+#include "../src/json_path.h"
+
+class PackedTest : public EvalTest {
+protected:
+    static const JsonArray& array(const JsonEval& eval, const std::string& expression) {
+        return static_cast<const JsonArray&>(**eval.Query(expression));
+    }
+
+    template <typename T>
+    static std::vector<T> values(const JsonVector<T>& elements) {
+        return std::vector<T>(elements.begin(), elements.end());
+    }
+};
+
+TEST_F(PackedTest, parser_picks_storage) {
+    JsonEval eval(parse(
+        "{\"ints\": [3, -1, 7], \"doubles\": [1.5, 2, -0.25], \"late\": [1, 2, 3.5],"
+        " \"mixed\": [1, 2, \"x\", 4], \"empty\": [], \"nested\": [[1], [2.5]]}"));
+
+    ASSERT_EQ(array(eval, "ints").storage(), JsonArray::Storage::Integers);
+    ASSERT_EQ(array(eval, "doubles").storage(), JsonArray::Storage::Doubles);
+    ASSERT_EQ(array(eval, "late").storage(), JsonArray::Storage::Doubles);
+    ASSERT_EQ(array(eval, "mixed").storage(), JsonArray::Storage::Slots);
+    ASSERT_EQ(array(eval, "empty").storage(), JsonArray::Storage::Slots);
+    ASSERT_EQ(array(eval, "nested").storage(), JsonArray::Storage::Slots);
+    ASSERT_EQ(array(eval, "nested[1]").storage(), JsonArray::Storage::Doubles);
+
+    ASSERT_EQ(values(*array(eval, "ints").integers()), (std::vector<int32_t>{ 3, -1, 7 }));
+    ASSERT_EQ(values(*array(eval, "late").doubles()), (std::vector<double>{ 1, 2, 3.5 }));
+
+    ASSERT_EQ(print(array(eval, "ints")), "[ 3, -1, 7 ]");
+    ASSERT_EQ(print(array(eval, "late")), "[ 1, 2, 3.5 ]");
+    ASSERT_EQ(print(array(eval, "mixed")), "[ 1, 2, \"x\", 4 ]");
+}
+
+TEST_F(PackedTest, element_access) {
+    JsonEval eval(parse("{\"a\": [10, 20, 30], \"b\": [0.5, 2.0], \"i\": [2, 1]}"));
+
+    // Elements are returned by value, the array holds no nodes for them
+    ASSERT_FALSE(eval.Query("a[1]").has_value());
+    ASSERT_EQ(print(*eval.EvaluateExpression("a[1]")), "20");
+    ASSERT_EQ(array(eval, "a").at(1), nullptr);
+    ASSERT_EQ(array(eval, "a").number(1).value(), 20);
+    ASSERT_EQ(print(*JsonPath<"a[2]">::EvaluateExpression(eval.root())), "30");
+    ASSERT_FALSE(JsonPath<"a[2]">::Query(*eval.root()).has_value());
+
+    // Only integers can index, 2.0 is a double
+    ASSERT_FALSE(static_cast<const JsonNumber&>(*eval.EvaluateExpression("b[1]")).isInteger());
+    ASSERT_FALSE(eval.TryEvaluateExpression("a[b[1]]").has_value());
+    ASSERT_EQ(print(*eval.EvaluateExpression("a[i[0]]")), "30");
+    ASSERT_EQ(print(*JsonPath<"a[i[0]]">::EvaluateExpression(eval.root())), "30");
+    ASSERT_FALSE(eval.TryEvaluateExpression("a[3]").has_value());
+
+    ASSERT_EQ(print(*eval.EvaluateExpression("a[*]")), "[ 10, 20, 30 ]");
+}
+
+TEST_F(PackedTest, integers_stay_integers) {
+    JsonEval eval(parse(
+        "{\"a\": [10, 20], \"d\": [1.0, -1.0, 1, 2.5], \"m\": [1.0, \"x\", 1], \"one\": 1.0}"));
+    ASSERT_EQ(array(eval, "d").storage(), JsonArray::Storage::Doubles);
+    ASSERT_EQ(array(eval, "m").storage(), JsonArray::Storage::Slots);
+
+    // As parsed, the same in either storage and as a scalar
+    auto isInteger = [&](const std::string& expression) {
+        return static_cast<const JsonNumber&>(*eval.EvaluateExpression(expression)).isInteger();
+    };
+    ASSERT_FALSE(isInteger("d[0]"));
+    ASSERT_FALSE(isInteger("d[1]"));
+    ASSERT_TRUE(isInteger("d[2]"));
+    ASSERT_FALSE(isInteger("m[0]"));
+    ASSERT_TRUE(isInteger("m[2]"));
+
+    for (const char* index : { "a[one]", "a[d[0]]", "a[m[0]]" }) {
+        ASSERT_FALSE(eval.TryEvaluateExpression(index).has_value()) << index;
+    }
+    ASSERT_EQ(print(*eval.EvaluateExpression("a[d[2]]")), "20");
+    ASSERT_EQ(print(*eval.EvaluateExpression("a[m[2]]")), "20");
+
+    // Kept through results, edits and promotion to general storage
+    ASSERT_FALSE(static_cast<const JsonArray&>(*eval.EvaluateExpression("sort(d)")).number(0).isInteger()); // -1.0
+    JsonArray copy = array(eval, "d");
+    copy.remove(0);
+    ASSERT_TRUE(copy.number(1).isInteger());
+    copy.add(JsonSlot(JsonString(std::string("x"))));
+    ASSERT_EQ(copy.storage(), JsonArray::Storage::Slots);
+    ASSERT_FALSE(static_cast<const JsonNumber*>(copy.at(0))->isInteger());
+    ASSERT_TRUE(static_cast<const JsonNumber*>(copy.at(1))->isInteger());
+}
+
+TEST_F(PackedTest, promotion) {
+    JsonArray array;
+    array.add(JsonSlot(JsonNumber(1)));
+    array.add(JsonSlot(JsonNumber(2)));
+    ASSERT_EQ(array.storage(), JsonArray::Storage::Integers);
+
+    array.set(0, JsonSlot(JsonNumber(0.5)));
+    ASSERT_EQ(array.storage(), JsonArray::Storage::Doubles);
+    ASSERT_TRUE(array.number(1).isInteger());
+
+    array.add(JsonBoolean::True());
+    ASSERT_EQ(array.storage(), JsonArray::Storage::Slots);
+    ASSERT_EQ(print(array), "[ 0.5, 2, true ]");
+
+    array.remove(2);
+    array.add(JsonSlot(JsonNumber(3)));
+    ASSERT_EQ(array.storage(), JsonArray::Storage::Slots); // for good
+    ASSERT_EQ(print(array), "[ 0.5, 2, 3 ]");
+}
+
+TEST_F(PackedTest, hash_and_edit) {
+    auto root = parse("{\"a\": [1, 2.5, 3]}");
+
+    // Same hash as the same numbers in general storage
+    JsonArray slots;
+    slots.add(std::make_shared<JsonNumber>(1));
+    slots.add(std::make_shared<JsonNumber>(2.5));
+    slots.add(std::make_shared<JsonNumber>(3));
+    ASSERT_EQ(slots.storage(), JsonArray::Storage::Slots);
+    ASSERT_EQ(JsonHash::Of(**JsonEval(root).Query("a")), JsonHash::Of(slots));
+
+    JsonDocument document(root);
+    JsonDocument edited = document.Set("a[1]", JsonNumber(7)).Erase("a[0]");
+    ASSERT_EQ(print(*JsonEval(edited.root()).EvaluateExpression("a")), "[ 7, 3 ]");
+    ASSERT_EQ(JsonHash::Diff(*document.root(), *edited.root()),
+              (std::vector<std::string>{ "a[0]", "a[1]", "a[2]" }));
+
+    ASSERT_FALSE(document.TrySet("a[1].x", JsonNumber(1)).has_value()); // a number, not an object
+
+    JsonDocument text = document.Set("a[2]", JsonString(std::string("x")));
+    ASSERT_EQ(print(*JsonEval(text.root()).EvaluateExpression("a")), "[ 1, 2.5, \"x\" ]");
+    ASSERT_EQ(print(*JsonEval(document.root()).EvaluateExpression("a")), "[ 1, 2.5, 3 ]");
+}
+
+TEST_F(PackedTest, intrinsics_on_buffer) {
+    JsonEval eval(parse("{\"a\": [5, 1, 9, 3, 9, -0, 0], \"d\": [2.5, -1, 2.5], \"o\": [{\"a\": [4, 2]}]}"));
+
+    auto packedResult = [&](const std::string& expression) {
+        auto result = eval.EvaluateExpression(expression);
+        EXPECT_TRUE(static_cast<const JsonArray&>(*result).isPacked()) << expression;
+        return print(*result);
+    };
+
+    ASSERT_EQ(packedResult("topk(a, 3)"), "[ 9, 9, 5 ]");
+    ASSERT_EQ(packedResult("sort(a)"), "[ 0, 0, 1, 3, 5, 9, 9 ]");
+    ASSERT_EQ(packedResult("distinct(a)"), "[ 5, 1, 9, 3, 0 ]");
+    ASSERT_EQ(packedResult("sort(d)"), "[ -1, 2.5, 2.5 ]");
+    ASSERT_EQ(packedResult("distinct(d)"), "[ 2.5, -1 ]");
+    ASSERT_EQ(packedResult("topk(sort(a), 2)"), "[ 9, 9 ]");
+
+    // Same as through boxed items
+    ASSERT_EQ(print(*eval.EvaluateExpression("sort(o[*].a[*])")), "[ 2, 4 ]");
+    ASSERT_EQ(print(*eval.EvaluateExpression("sort(a[*])")), packedResult("sort(a)"));
+    ASSERT_FALSE(eval.TryEvaluateExpression("sortby(a, x)"));
+    ASSERT_FALSE(eval.TryEvaluateExpression("contains(a, 'x')"));
+}
+
+TEST_F(PackedTest, memory) {
+    std::string json = "{\"a\": [";
+    for (int i = 0; i < 1000; ++i) {
+        json += (i ? "," : "") + std::to_string(i);
+    }
+    auto root = parse(json + "]}");
+
+    JsonMemory::Report report = JsonMemory::Measure(*root);
+    const JsonMemory::Usage& numbers = report.types[(int)JsonType::Number];
+    const JsonMemory::Usage& arrays = report.types[(int)JsonType::Array];
+    ASSERT_EQ(numbers.count, 1000u);
+    ASSERT_EQ(numbers.compactBytes, 0u);
+    ASSERT_LE(arrays.compactBytes, 1024 * sizeof(int32_t) + 256);
+}
+
+TEST_F(PackedTest, concurrent_reads) {
+    // Reading packed elements writes nothing to the shared tree
+    const JsonEval eval(parse("{\"a\": [10, 20, 30, 40]}"));
+
+    std::vector<int> mismatches(8, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 1000; ++i) {
+                int index = (t + i) % 4;
+                auto result = eval.TryEvaluateExpression("a[" + std::to_string(index) + "]");
+                mismatches[t] += !result || print(**result) != std::to_string(10 * (index + 1));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    for (int count : mismatches) {
+        ASSERT_EQ(count, 0);
+    }
+}
@@ -7,9 +7,12 @@
 #include <fstream>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "../src/json_parser.h"
 #include "../src/json_eval.h"
+#include "../src/json_reader.h"
 
 class PassTest : public EvalTest {
 protected:
@@ -27,11 +30,9 @@ protected:
         file.close();
 
         JsonEval evaluator(root);
-        std::shared_ptr<JsonValue> expressionResult{};
+        std::shared_ptr<const JsonValue> expressionResult{};
 
-
-        std::string exprCopy = expression;
-        ASSERT_NO_THROW(expressionResult = evaluator.EvaluateExpression(root, exprCopy));
+        ASSERT_NO_THROW(expressionResult = evaluator.EvaluateExpression(expression));
 
         std::stringstream evalOut;
         evalOut << *expressionResult;
@@ -60,3 +61,94 @@ TEST_F(PassTest, Case_03) {
 TEST_F(PassTest, Case_04) {
     evalExpr("test.json", "a.b[a.b[a.b[0]]].c", "test");
 }
+
+TEST_F(PassTest, object_members) {
+    evalExpr("object/01-members.json", "nested.y.z[1]", "b");
+}
+
+TEST_F(PassTest, empty_array) {
+    evalExpr("object/01-members.json", "empty_array", "[  ]");
+}
+
+TEST_F(PassTest, literals) {
+    evalExpr("object/01-members.json", "flags", "[ true, false, null ]");
+}
+
+TEST_F(PassTest, numbers) {
+    evalExpr("object/01-members.json", "numbers", "[ -1, 2.5, 1000, 3e+09 ]");
+}
+
+TEST_F(PassTest, concurrent_queries) {
+    std::ifstream file(_testDirectory + "test.json");
+    ASSERT_TRUE(file.is_open());
+
+    JsonParser parser;
+    const JsonEval evaluator(parser.Parse(file));
+
+    // a.b[3] is packed, its elements are not nodes Query() could return
+    const char* expressions[] = { "a.b[1]", "a.b[2].c", "a.b[a.b[1]].c", "a.b[3]" };
+    const char* expected[] = { "2", "test", "test", "[ 11, 12 ]" };
+
+    std::vector<int> mismatches(8, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+        threads.emplace_back([&, t] {
+            for (int i = 0; i < 1000; ++i) {
+                int e = (t + i) % 4;
+                auto result = evaluator.Query(expressions[e]);
+                std::stringstream out;
+                if (result) {
+                    out << **result;
+                }
+                mismatches[t] += out.str() != expected[e];
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    for (int count : mismatches) {
+        ASSERT_EQ(count, 0);
+    }
+}
+
+TEST_F(PassTest, shared_literals) {
+    std::ifstream file(_testDirectory + "object/01-members.json");
+    ASSERT_TRUE(file.is_open());
+
+    JsonParser parser;
+    const JsonEval evaluator(parser.Parse(file));
+
+    auto flags = evaluator.Query("flags");
+    ASSERT_TRUE(flags.has_value());
+
+    const JsonArray* arr = static_cast<const JsonArray*>(*flags);
+    ASSERT_EQ(arr->at(0), JsonBoolean::True().get());
+    ASSERT_EQ(arr->at(1), JsonBoolean::False().get());
+    ASSERT_EQ(arr->at(2), JsonNull::Instance().get());
+
+    auto numbers = evaluator.Query("numbers");
+    ASSERT_TRUE(numbers.has_value());
+    ASSERT_TRUE(static_cast<const JsonArray*>(*numbers)->isPacked());
+}
+
+TEST_F(PassTest, read_ahead_small_blocks) {
+    // Blocks much smaller than tokens exercise every block boundary
+    JsonReadAheadBuffer::Options options;
+    options.blockSize = 3;
+    options.blocks = 2;
+
+    JsonReadAheadBuffer buffer(_testDirectory + "object/01-members.json", options);
+    ASSERT_TRUE(buffer.is_open());
+    std::istream in(&buffer);
+
+    JsonParser parser;
+    auto root = parser.TryParse(in);
+    ASSERT_TRUE(root.has_value()) << root.error().what();
+
+    JsonEval evaluator(*root);
+    std::stringstream out;
+    out << *evaluator.EvaluateExpression("numbers");
+    ASSERT_EQ(out.str(), "[ -1, 2.5, 1000, 3e+09 ]");
+}
@@ -0,0 +1,89 @@
+#include <gtest/gtest.h>
+
+#include "core.h"
+
+#include <memory>
+#include <sstream>
+#include <fstream>
+#include <string>
+
+#include "../src/json_parser.h"
+#include "../src/json_eval.h"
+#include "../src/json_path.h"
+
+// Malformed paths are rejected by the compiler; JsonPath<> itself would not build
+static_assert(JsonPathCompiler::Compile<8>("a.b[2].c").valid());
+static_assert(JsonPathCompiler::Compile<13>("a.b[a.b[1]].c").valid());
+static_assert(!JsonPathCompiler::Compile<4>("a.b[").valid());
+static_assert(!JsonPathCompiler::Compile<4>("a..b").valid());
+static_assert(!JsonPathCompiler::Compile<5>("a.b[]").valid());
+static_assert(!JsonPathCompiler::Compile<6>("a.b[2]x").valid());
+static_assert(!JsonPathCompiler::Compile<3>("a.1").valid());
+static_assert(!JsonPathCompiler::Compile<7>("a.b[-1]").valid());
+static_assert(JsonPathCompiler::Compile<4>("a.b[").errorPosition == 4);
+
+class PathTest : public EvalTest {
+protected:
+    void SetUp() override {
+        EvalTest::SetUp();
+
+        std::ifstream file(_testDirectory + "test.json");
+        ASSERT_TRUE(file.is_open());
+
+        JsonParser parser;
+        auto root = parser.TryParse(file);
+        ASSERT_TRUE(root.has_value());
+        _root = *root;
+    }
+
+    // The compiled path must give the same result or error as JsonEval
+    template <typename Path>
+    void expectSame() {
+        JsonEval evaluator(_root);
+        auto expected = evaluator.Query(Path::expression());
+        auto actual = Path::Query(*_root);
+
+        ASSERT_EQ(actual.has_value(), expected.has_value()) << Path::expression();
+        if (expected) {
+            ASSERT_EQ(*actual, *expected);
+        } else {
+            ASSERT_EQ(actual.error().message, expected.error().message);
+            ASSERT_EQ(actual.error().position, expected.error().position);
+        }
+    }
+
+    std::shared_ptr<const JsonValue> _root;
+};
+
+TEST_F(PathTest, same_as_eval) {
+    expectSame<JsonPath<"a.b[1]">>();
+    expectSame<JsonPath<"a.b[2].c">>();
+    expectSame<JsonPath<"a.b">>();
+    expectSame<JsonPath<"a.b[a.b[1]].c">>();
+    expectSame<JsonPath<"a.b[3][1]">>();
+}
+
+TEST_F(PathTest, errors_same_as_eval) {
+    expectSame<JsonPath<"x">>();
+    expectSame<JsonPath<"a[0]">>();
+    expectSame<JsonPath<"a.b[42]">>();
+    expectSame<JsonPath<"a.b[2].c.d">>();
+    expectSame<JsonPath<"a.b[a.b[2]]">>();
+    expectSame<JsonPath<"a.b[a.x]">>();
+}
+
+TEST_F(PathTest, evaluator_and_ownership) {
+    JsonEval evaluator(_root);
+    auto result = evaluator.Query<JsonPath<"a.b[2].c">>();
+    ASSERT_TRUE(result.has_value());
+
+    std::stringstream out;
+    out << **result;
+    ASSERT_EQ(out.str(), "test");
+
+    auto owned = JsonPath<"a.b[3]">::EvaluateExpression(_root);
+    _root.reset();
+    std::stringstream ownedOut;
+    ownedOut << *owned;
+    ASSERT_EQ(ownedOut.str(), "[ 11, 12 ]");
+}
@@ -0,0 +1,200 @@
+#include <gtest/gtest.h>
+
+#include "core.h"
+
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../src/json_persistent.h"
+#include "../src/json_types.h"
+
+class PersistentTest : public EvalTest {
+protected:
+    using Vector = JsonVector<int64_t>;
+
+    static std::vector<int64_t> values(const Vector& vector) {
+        return std::vector<int64_t>(vector.begin(), vector.end());
+    }
+
+    // Order-dependent, so that misplaced runs change it
+    static uint64_t summary(const Vector& vector) {
+        auto run = [](const int64_t* elements, size_t count) {
+            uint64_t sum = 0;
+            for (size_t i = 0; i < count; ++i) {
+                sum = sum * 31 + uint64_t(elements[i]);
+            }
+            return sum;
+        };
+        auto join = [](uint64_t left, uint64_t right, size_t rightCount) {
+            uint64_t scale = 1;
+            for (size_t i = 0; i < rightCount; ++i) {
+                scale *= 31;
+            }
+            return left * scale + right;
+        };
+        return vector.summarize(run, join);
+    }
+
+    // Every key collides in all but the lowest bits, so members pile up in
+    // nodes below the last level
+    struct BadHash {
+        size_t operator()(std::string_view key) const {
+            return key.size() % 4;
+        }
+    };
+};
+
+TEST_F(PersistentTest, vector_matches_std) {
+    std::mt19937 rng(7);
+    Vector vector;
+    std::vector<int64_t> model;
+
+    // Flat, one level and two levels of branches
+    for (size_t size : { size_t(10), Vector::LeafSize + 1, Vector::LeafSize * Vector::BranchSize + 5 }) {
+        while (model.size() < size) {
+            vector.push_back(int64_t(model.size()));
+            model.push_back(int64_t(model.size()));
+        }
+        ASSERT_EQ(values(vector), model);
+
+        for (int round = 0; round < 2000; ++round) {
+            size_t index = rng() % model.size();
+            switch (rng() % 3) {
+                case 0:
+                    vector.set(index, -round);
+                    model[index] = -round;
+                    break;
+                case 1:
+                    vector.erase(index);
+                    model.erase(model.begin() + index);
+                    break;
+                default:
+                    vector.push_back(round);
+                    model.push_back(round);
+                    break;
+            }
+            ASSERT_EQ(vector.size(), model.size());
+            if (model.empty()) {
+                vector.push_back(round);
+                model.push_back(round);
+            }
+            ASSERT_EQ(vector[index % model.size()], model[index % model.size()]);
+        }
+        ASSERT_EQ(values(vector), model);
+    }
+
+    // Down to nothing and flat again
+    while (!model.empty()) {
+        size_t index = rng() % model.size();
+        vector.erase(index);
+        model.erase(model.begin() + index);
+    }
+    ASSERT_TRUE(vector.empty());
+    vector.push_back(1);
+    ASSERT_EQ(values(vector), std::vector<int64_t>{ 1 });
+}
+
+TEST_F(PersistentTest, vector_copies_share_storage) {
+    Vector original;
+    for (int64_t i = 0; i < 100000; ++i) {
+        original.push_back(i);
+    }
+    std::vector<int64_t> before = values(original);
+    uint64_t summaryBefore = summary(original);
+
+    Vector copy = original;
+    copy.set(5, -5);
+    copy.erase(70000);
+    copy.push_back(-1);
+
+    // The original is unchanged, and only the leaves on the paths were copied
+    ASSERT_EQ(values(original), before);
+    ASSERT_EQ(copy[5], -5);
+    ASSERT_EQ(copy[70000], 70001);
+    ASSERT_EQ(copy.size(), original.size());
+    ASSERT_NE(&copy[5], &original[5]);
+    ASSERT_EQ(&copy[50000], &original[50000]);
+
+    // Cached summaries follow the changes
+    ASSERT_EQ(summary(original), summaryBefore);
+    Vector rebuilt;
+    for (int64_t value : copy) {
+        rebuilt.push_back(value);
+    }
+    ASSERT_EQ(summary(copy), summary(rebuilt));
+    ASSERT_NE(summary(copy), summaryBefore);
+}
+
+TEST_F(PersistentTest, map_matches_std) {
+    std::mt19937 rng(3);
+
+    // Around the flat size and well past it
+    for (unsigned keys : { unsigned(JsonMap<int, JsonKeyHash>::FlatSize + 4), 3000u }) {
+        JsonMap<int, JsonKeyHash> map;
+        JsonMap<int, BadHash> colliding;
+        std::unordered_map<std::string, int> model;
+
+        for (int round = 0; round < 20000; ++round) {
+            std::string key = "k" + std::to_string(rng() % keys);
+            if (rng() % 3 == 0) {
+                ASSERT_EQ(map.erase(key), model.erase(key) == 1) << key;
+                colliding.erase(key);
+            } else {
+                map.set(key, round);
+                colliding.set(key, round);
+                model[key] = round;
+            }
+            ASSERT_EQ(map.size(), model.size());
+            ASSERT_EQ(colliding.size(), model.size());
+        }
+
+        for (const auto& [key, value] : model) {
+            ASSERT_NE(map.find(key), nullptr) << key;
+            ASSERT_EQ(*map.find(key), value) << key;
+            ASSERT_NE(colliding.find(key), nullptr) << key;
+            ASSERT_EQ(*colliding.find(key), value) << key;
+        }
+        ASSERT_EQ(map.find("missing"), nullptr);
+
+        size_t visited = 0;
+        for (const auto& [key, value] : map) {
+            ASSERT_EQ(model.at(key), value);
+            ++visited;
+        }
+        ASSERT_EQ(visited, model.size());
+
+        for (const auto& [key, value] : model) {
+            ASSERT_TRUE(colliding.erase(key));
+        }
+        ASSERT_TRUE(colliding.empty());
+        ASSERT_EQ(colliding.begin(), colliding.end());
+    }
+}
+
+TEST_F(PersistentTest, map_copies_share_storage) {
+    JsonMap<int, JsonKeyHash> original;
+    for (int i = 0; i < 10000; ++i) {
+        original.set("k" + std::to_string(i), i);
+    }
+    auto sum = [](const JsonMap<int, JsonKeyHash>& map) {
+        return map.summarize([](const auto& member) { return uint64_t(member.second); });
+    };
+    uint64_t sumBefore = sum(original);
+
+    auto copy = original;
+    copy.set("k1", -1);
+    copy.erase("k2");
+    copy.set("new", 5);
+
+    ASSERT_EQ(*original.find("k1"), 1);
+    ASSERT_EQ(*original.find("k2"), 2);
+    ASSERT_EQ(original.find("new"), nullptr);
+    ASSERT_EQ(*copy.find("k1"), -1);
+    ASSERT_EQ(copy.find("k2"), nullptr);
+    ASSERT_EQ(copy.find("k5000"), original.find("k5000"));
+
+    ASSERT_EQ(sum(original), sumBefore);
+    ASSERT_EQ(sum(copy), sumBefore - 1 - 1 - 2 + 5);
+}
@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include "core.h"
+
+#include <sstream>
+#include <string>
+
+#include "../src/json_parser.h"
+#include "../src/json_eval.h"
+#include "../src/json_stats.h"
+
+#ifdef JSON_EVAL_STATS
+
+class StatsTest : public EvalTest {
+protected:
+    void SetUp() override {
+        EvalTest::SetUp();
+        JsonStats::Local() = JsonStats::Counters(); // earlier tests on this thread
+    }
+};
+
+TEST_F(StatsTest, parse_and_eval_counters) {
+    std::string json = "{\"a\": {\"b\": [1, 2.5, \"s\", true, null]}, \"c\": \"longer than a slot holds\"}";
+    std::istringstream in(json);
+    {
+        JSON_STATS_PHASE(Parse);
+        JsonParser parser;
+        JsonEval eval(parser.Parse(in));
+
+        JSON_STATS_PHASE(Eval);
+        ASSERT_TRUE(eval.TryEvaluateExpression("a.b[1]").has_value());
+    }
+
+    const JsonStats::Counters& counters = JsonStats::Local();
+    ASSERT_EQ(counters.bytesRead, json.size());
+    ASSERT_EQ(counters.nodes[(int)JsonStats::Node::Object], 2u);
+    ASSERT_EQ(counters.nodes[(int)JsonStats::Node::Array], 1u);
+    ASSERT_EQ(counters.nodes[(int)JsonStats::Node::String], 2u);
+    ASSERT_EQ(counters.nodes[(int)JsonStats::Node::Number], 2u);
+    ASSERT_EQ(counters.nodes[(int)JsonStats::Node::Boolean], 1u);
+    ASSERT_EQ(counters.nodes[(int)JsonStats::Node::Null], 1u);
+    ASSERT_EQ(counters.stringsAllocated, 1u); // "s" is stored in its slot
+    ASSERT_EQ(counters.keysAllocated, 3u);
+    ASSERT_EQ(counters.hashLookups, 2u); // a, b
+    ASSERT_GT(counters.phaseNs[(int)JsonStats::Phase::Parse], 0u);
+    ASSERT_GT(counters.phaseNs[(int)JsonStats::Phase::Eval], 0u);
+}
+
+TEST_F(StatsTest, report) {
+    std::istringstream in("{\"a\": [{}, {}]}");
+    JsonParser parser;
+    parser.Parse(in);
+
+    // Report() folds the local counters into the process totals
+    std::ostringstream out;
+    JsonStats::Report(out);
+    ASSERT_EQ(JsonStats::Local().nodes[(int)JsonStats::Node::Object], 0u);
+
+    std::string report = out.str();
+    for (const char* key : { "\"phases_ms\": {\"open\": ", "\"parse\": ", "\"destroy\": ", "\"bytes_read\": ",
+                             "\"nodes\": {\"object\": ", "\"null\": ", "\"strings_allocated\": ",
+                             "\"keys_allocated\": ", "\"hash_lookups\": ", "\"peak_memory_bytes\": " }) {
+        ASSERT_NE(report.find(key), std::string::npos) << key;
+    }
+    ASSERT_EQ(report.back(), '\n');
+
+    // Totals only grow
+    std::ostringstream again;
+    JsonStats::Report(again);
+    auto objects = [](const std::string& text) {
+        size_t pos = text.find("\"object\": ") + 10;
+        return std::stoull(text.substr(pos));
+    };
+    ASSERT_GE(objects(report), 3u);
+    ASSERT_EQ(objects(again.str()), objects(report));
+}
+
+#endif
@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+
+#include "core.h"
+
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/json_parser.h"
+#include "../src/json_eval.h"
+#include "../src/json_strings.h"
+
+class StringsTest : public EvalTest {
+protected:
+    static std::vector<bool> booleans(const JsonValue& value) {
+        std::vector<bool> result;
+        for (const JsonSlot& element : static_cast<const JsonArray&>(value).elements()) {
+            result.push_back(static_cast<const JsonBoolean*>(element.get())->value());
+        }
+        return result;
+    }
+};
+
+TEST_F(StringsTest, find_matches_std) {
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<int> letter('a', 'c');
+    std::uniform_int_distribution<size_t> length(0, 200);
+    std::uniform_int_distribution<size_t> needleLength(0, 6);
+
+    for (int round = 0; round < 20000; ++round) {
+        std::string haystack(length(rng), ' ');
+        for (char& ch : haystack) {
+            ch = char(letter(rng));
+        }
+        std::string needle(needleLength(rng), ' ');
+        for (char& ch : needle) {
+            ch = char(letter(rng));
+        }
+        ASSERT_EQ(JsonStrings::Find(haystack, needle), std::string_view(haystack).find(needle))
+            << haystack << " / " << needle;
+    }
+}
+
+TEST_F(StringsTest, match) {
+    ASSERT_TRUE(JsonStrings::Match("", ""));
+    ASSERT_TRUE(JsonStrings::Match("", "*"));
+    ASSERT_FALSE(JsonStrings::Match("", "?"));
+    ASSERT_TRUE(JsonStrings::Match("abc", "abc"));
+    ASSERT_FALSE(JsonStrings::Match("abcd", "abc"));
+    ASSERT_TRUE(JsonStrings::Match("abc", "a?c"));
+    ASSERT_TRUE(JsonStrings::Match("https://api.example.com/v1", "https://*.example.com/*"));
+    ASSERT_FALSE(JsonStrings::Match("http://api.example.com/v1", "https://*.example.com/*"));
+    ASSERT_TRUE(JsonStrings::Match("aXbXc", "a*b*c"));
+    ASSERT_FALSE(JsonStrings::Match("abca", "*a*bc"));
+    ASSERT_TRUE(JsonStrings::Match("abab", "*ab"));
+    ASSERT_FALSE(JsonStrings::Match("ab", "a*ab"));     // the tail cannot reuse the head
+    ASSERT_TRUE(JsonStrings::Match("x.log", "*.???"));
+    ASSERT_TRUE(JsonStrings::Match("caf\xC3\xA9", "caf?"));  // one code point
+    ASSERT_FALSE(JsonStrings::Match("caf\xC3\xA9", "caf??"));
+    ASSERT_TRUE(JsonStrings::Match("\xC3\xA9t\xC3\xA9", "*?t?"));
+}
+
+TEST_F(StringsTest, lower) {
+    ASSERT_EQ(JsonStrings::Lower("Hello, WORLD! 0-9 [Z] @A"), "hello, world! 0-9 [z] @a");
+    ASSERT_EQ(JsonStrings::Lower("\xC3\x89T\xC3\x89 ABCDEFGHIJKLMNOPQRSTUVWXYZ"), "\xC3\x89t\xC3\x89 abcdefghijklmnopqrstuvwxyz");
+}
+
+TEST_F(StringsTest, map_over_projection) {
+    JsonEval eval(parse(
+        "{\"log\": [{\"msg\": \"Connection timeout\"}, {\"msg\": \"ok\"}, {\"msg\": \"read TIMEOUT\"}],"
+        " \"tags\": [\"alpha\", \"beta\"], \"s\": \"Mixed Case\"}"));
+
+    ASSERT_EQ(booleans(*eval.EvaluateExpression("contains(log[*].msg, 'timeout')")), (std::vector<bool>{ true, false, false }));
+    ASSERT_EQ(booleans(*eval.EvaluateExpression("contains(lower(log[*].msg), 'timeout')")), (std::vector<bool>{ true, false, true }));
+    ASSERT_EQ(booleans(*eval.EvaluateExpression("startsWith(tags, \"al\")")), (std::vector<bool>{ true, false }));
+    ASSERT_EQ(booleans(*eval.EvaluateExpression("endsWith(tags, 'ta')")), (std::vector<bool>{ false, true }));
+
+    ASSERT_EQ(print(*eval.EvaluateExpression("lower(s)")), "mixed case");
+    ASSERT_EQ(*eval.Query("match(s, 'Mixed*')"), JsonBoolean::True().get());
+    ASSERT_FALSE(eval.Query("lower(s)")); // computes a new string
+}
+
+TEST_F(StringsTest, filter) {
+    JsonEval eval(parse(
+        "{\"log\": [{\"url\": \"https://api.example.com/a\", \"ok\": true},"
+        " {\"url\": \"https://example.org/b\", \"ok\": false},"
+        " {\"url\": \"HTTPS://WWW.EXAMPLE.COM/c\", \"ok\": true}],"
+        " \"words\": [\"apple\", \"banana\", \"apricot\"]}"));
+
+    auto matched = eval.EvaluateExpression("filter(log[*], match(lower(url), 'https://*.example.com/*'))");
+    const auto& array = static_cast<const JsonArray&>(*matched);
+    ASSERT_EQ(array.size(), 2u);
+    ASSERT_EQ(array.at(0), *eval.Query("log[0]"));
+    ASSERT_EQ(array.at(1), *eval.Query("log[2]"));
+
+    ASSERT_EQ(static_cast<const JsonArray&>(*eval.EvaluateExpression("filter(log, ok)")).size(), 2u);
+    ASSERT_EQ(print(*eval.EvaluateExpression("filter(words, startsWith(@, 'ap'))")), "[ \"apple\", \"apricot\" ]");
+    ASSERT_EQ(print(*eval.EvaluateExpression("sort(filter(words, contains(@, 'an')))")), "[ \"banana\" ]");
+    ASSERT_EQ(print(*eval.EvaluateExpression("filter(words, contains(@, 'zz'))")), "[  ]");
+}
+
+TEST_F(StringsTest, errors) {
+    JsonEval eval(parse("{\"a\": [\"x\", 1], \"log\": [{\"m\": \"x\"}, {\"m\": \"y\"}], \"s\": \"x\"}"));
+
+    auto expectError = [&](const std::string& expression, size_t position) {
+        auto result = eval.TryEvaluateExpression(expression);
+        ASSERT_FALSE(result) << expression;
+        ASSERT_EQ(result.error().position, position) << expression << ": " << result.error().what();
+    };
+
+    expectError("contains(a, 'x')", 9);            // not all strings
+    expectError("contains(s, x)", 12);              // not a literal
+    expectError("contains(s, 'x)", 12);             // unterminated
+    expectError("contains(s)", 10);                 // missing literal
+    expectError("filter(log, m)", 12);              // predicate is not boolean
+    expectError("filter(log, sort(@))", 12);        // not per element
+    expectError("filter(log[*], contains(n, 'x'))", 24);
+}
+
+TEST_F(StringsTest, short_and_long_storage) {
+    for (size_t length : { 0, 1, 15, 16, 1000 }) {
+        std::string text(length, 'x');
+        if (length > 0) {
+            text[0] = 'a';
+            text[length - 1] = 'z';
+        }
+
+        JsonString str(text);
+        ASSERT_EQ(str.value(), text) << length;
+
+        JsonString copy(str);
+        ASSERT_EQ(copy.value(), text) << length;
+
+        JsonString moved(std::move(copy));
+        ASSERT_EQ(moved.value(), text) << length;
+        ASSERT_TRUE(copy.empty()) << length;
+
+        copy = moved;
+        moved = JsonString(std::string("other"));
+        ASSERT_EQ(copy.value(), text) << length;
+        ASSERT_EQ(moved.value(), "other") << length;
+
+        JsonEval eval(parse("{\"s\": \"" + text + "\", \"a\": [\"" + text + "\"]}"));
+        ASSERT_EQ(print(*eval.EvaluateExpression("s")), text) << length;
+        ASSERT_EQ(print(*eval.EvaluateExpression("a[0]")), text) << length;
+    }
+}
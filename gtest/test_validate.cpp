@@ -0,0 +1,148 @@
+#include <gtest/gtest.h>
+
+#include "core.h"
+
+#include <sstream>
+#include <fstream>
+#include <string>
+
+#include "../src/json_parser.h"
+#include "../src/json_eval.h"
+#include "../src/json_validator.h"
+
+class ValidateTest : public EvalTest {
+protected:
+    JsonResult<uint64_t> validate(const std::string& json) {
+        std::istringstream in(json);
+        return JsonValidator::Validate(in);
+    }
+
+    // Feeds one byte at a time, so every state is resumed across blocks
+    JsonResult<uint64_t> validateBytewise(const std::string& json) {
+        JsonValidator validator;
+        for (char ch : json) {
+            if (!validator.Feed(&ch, 1)) {
+                return validator.error();
+            }
+        }
+        if (!validator.Finish()) {
+            return validator.error();
+        }
+        return validator.offset();
+    }
+
+    void expectError(const std::string& json, int line, int column) {
+        for (auto result : { validate(json), validateBytewise(json) }) {
+            ASSERT_FALSE(result.has_value()) << json;
+            TEST_COUT << result.error().what() << std::endl;
+            EXPECT_EQ(result.error().line, line) << json;
+            EXPECT_EQ(result.error().column, column) << json;
+        }
+    }
+};
+
+TEST_F(ValidateTest, valid_files) {
+    for (const char* name : { "test.json", "object/01-members.json", "string/01-unicode_letter.json" }) {
+        std::ifstream file(_testDirectory + name, std::ios::binary);
+        ASSERT_TRUE(file.is_open());
+        auto result = JsonValidator::Validate(file, 7);
+        ASSERT_TRUE(result.has_value()) << name << ": " << result.error().what();
+    }
+}
+
+TEST_F(ValidateTest, valid_values) {
+    std::string json = "[ 0, -0.5e+3, 12E-2, \"caf\xC3\xA9 \\u00e9 \\ud83d\\ude00 \xF0\x9F\x98\x80\","
+                       " true, false, null, {}, [], {\"a\": {\"b\": [1, {\"c\": \"\\\"\"}]}} ]";
+    ASSERT_TRUE(validate(json).has_value());
+    ASSERT_TRUE(validateBytewise(json).has_value());
+    ASSERT_TRUE(validate(" 42 ").has_value());
+}
+
+TEST_F(ValidateTest, grammar_errors) {
+    expectError("{\"a\":\n  [1 2]}", 2, 6);
+    expectError("{\"a\": 01}", 1, 8);
+    expectError("{\"a\": 1.}", 1, 9);
+    expectError("{a: 1}", 1, 2);
+    expectError("{\"a\" 1}", 1, 6);
+    expectError("[tru]", 1, 5);
+    expectError("[1,]", 1, 4);
+    expectError("{} []", 1, 4);
+    expectError("{\"a\": [1", 1, 9);
+    expectError("", 1, 1);
+}
+
+TEST_F(ValidateTest, string_errors) {
+    expectError("[\"a\tb\"]", 1, 4);
+    expectError("[\"\\x\"]", 1, 4);
+    expectError("[\"\\udc00\"]", 1, 8);
+    expectError("[\"\\ud83d x\"]", 1, 9);
+    expectError("[\"\\ud83d\\u0041\"]", 1, 14);
+}
+
+TEST_F(ValidateTest, utf8_errors) {
+    expectError("[\"ok\", \"\xC3\x28\"]", 1, 10);     // missing continuation
+    expectError("[\"\xC0\xAF\"]", 1, 3);              // overlong
+    expectError("[\"\xED\xA0\x80\"]", 1, 4);          // encoded surrogate
+    expectError("[\"\xF4\x90\x80\x80\"]", 1, 4);      // above U+10FFFF
+    expectError("[\"\xE2\x82", 1, 5);                 // truncated at the end
+
+    // Inside 16-byte chunks
+    expectError("[\"0123456789abcdefghijklmnopqrstuvw\xFF\"]", 1, 36);
+}
+
+TEST_F(ValidateTest, long_documents) {
+    // Long enough for the 64-byte bitmaps, which feeding a byte at a time
+    // never uses
+    std::string json = "{\"items\": [\n";
+    for (int i = 0; i < 24; ++i) {
+        std::string n = std::to_string(i);
+        json += "  {\"id\": " + n + ", \"name\": \"item \\\"" + n + "\\u00e9\\ud83d\\ude00\", \"score\": -" + n
+            + ".5e+1, \"ok\": true, \"tags\": [null, false, \"caf\xC3\xA9\", 0, {}]},\n";
+    }
+    json += "  []\n]}";
+    ASSERT_TRUE(validate(json).has_value());
+    ASSERT_TRUE(validateBytewise(json).has_value());
+
+    // Any corruption is reported as the byte-by-byte state machine does
+    for (size_t i = 0; i < json.size(); i += 3) {
+        for (char bad : { '}', ']', '"', ',', '0', '-', 'e', ' ', '\t', '\\', '\x01', '\x80' }) {
+            std::string broken = json;
+            broken[i] = bad;
+            auto whole = validate(broken);
+            auto bytewise = validateBytewise(broken);
+            ASSERT_EQ(whole.has_value(), bytewise.has_value()) << i << " " << int(bad);
+            if (!whole.has_value()) {
+                ASSERT_EQ(whole.error().message, bytewise.error().message) << i << " " << int(bad);
+                ASSERT_EQ(whole.error().position, bytewise.error().position) << i << " " << int(bad);
+                ASSERT_EQ(whole.error().line, bytewise.error().line) << i << " " << int(bad);
+                ASSERT_EQ(whole.error().column, bytewise.error().column) << i << " " << int(bad);
+            }
+        }
+    }
+}
+
+TEST_F(ValidateTest, parser_surrogate_pairs) {
+    std::istringstream in("{\"s\": \"\\u0123 \\ud83d\\ude00\"}");
+
+    JsonParser parser;
+    auto root = parser.TryParse(in);
+    ASSERT_TRUE(root.has_value()) << root.error().what();
+
+    JsonEval evaluator(*root);
+    auto result = evaluator.Query("s");
+    ASSERT_TRUE(result.has_value());
+
+    std::stringstream out;
+    out << **result;
+    ASSERT_EQ(out.str(), "\xC4\xA3 \xF0\x9F\x98\x80");
+}
+
+TEST_F(ValidateTest, parser_string_errors) {
+    for (const char* json : { "{\"s\": \"a\nb\"}", "{\"s\": \"\\udc00\"}", "{\"s\": \"\\ud83d\"}" }) {
+        std::istringstream in(json);
+        JsonParser parser;
+        auto root = parser.TryParse(in);
+        ASSERT_FALSE(root.has_value()) << json;
+        TEST_COUT << root.error().what() << std::endl;
+    }
+}
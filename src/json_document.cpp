@@ -0,0 +1,132 @@
+#include "json_document.h"
+#include "json_hash.h"
+#include "json_path.h"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Returns a new version of `node` with the edit at path[k..] applied; the
+// copy shares all children except the one on the path. Erases if `value`
+// is null.
+JsonResult<std::shared_ptr<JsonValue>> edit(const JsonValue& node, const std::vector<JsonPathSegment>& path,
+                                            size_t k, const JsonSlot* value)
+{
+    const JsonPathSegment& segment = path[k];
+    bool last = k + 1 == path.size();
+
+    if (segment.isIndex) {
+        if (node.type() != JsonType::Array) {
+            return JsonError{ "Token preceding '[' must be a JSON array.", segment.position };
+        }
+        const JsonArray& array = static_cast<const JsonArray&>(node);
+
+        bool append = last && value && segment.index == array.size();
+        if (segment.index >= array.size() && !append) {
+            return JsonError{ "Index '" + std::to_string(segment.index) + "' is out of range.", segment.position };
+        }
+
+        auto copy = std::make_shared<JsonArray>(array);
+        if (append) {
+            copy->add(JsonSlot(*value));
+        } else if (!last) {
+            // A packed number fails the next segment like any other scalar
+            JsonNumber number(0);
+            if (array.isPacked()) {
+                number = array.number(segment.index);
+            }
+            auto child = edit(array.isPacked() ? number : *array.at(segment.index), path, k + 1, value);
+            if (!child) {
+                return child.error();
+            }
+            copy->set(segment.index, JsonSlot(std::move(*child)));
+        } else if (value) {
+            copy->set(segment.index, JsonSlot(*value));
+        } else {
+            copy->remove(segment.index);
+        }
+        if (array.hash() != 0) {
+            copy->setHash(JsonHash::Compute(*copy)); // keep hashed trees hashed
+        }
+        return std::shared_ptr<JsonValue>(std::move(copy));
+    }
+
+    if (node.type() != JsonType::Object) {
+        return JsonError{ "Token preceding '.' must be a JSON object.", segment.position };
+    }
+    const JsonObject& object = static_cast<const JsonObject&>(node);
+
+    const JsonValue* child = object.find(segment.key);
+    if (!child && !(last && value)) {
+        return JsonError{ "Key \"" + segment.key + "\" was not found in parent object.", segment.position };
+    }
+
+    auto copy = std::make_shared<JsonObject>(object);
+    if (!last) {
+        auto edited = edit(*child, path, k + 1, value);
+        if (!edited) {
+            return edited.error();
+        }
+        copy->add(segment.key, JsonSlot(std::move(*edited)));
+    } else if (value) {
+        copy->add(segment.key, JsonSlot(*value));
+    } else {
+        copy->remove(segment.key);
+    }
+    if (object.hash() != 0) {
+        copy->setHash(JsonHash::Compute(*copy));
+    }
+    return std::shared_ptr<JsonValue>(std::move(copy));
+}
+
+JsonResult<JsonDocument> apply(const std::shared_ptr<const JsonValue>& root, std::string_view path, const JsonSlot* value) {
+    auto segments = JsonLiteralPath::Split(path);
+    if (!segments) {
+        return segments.error();
+    }
+
+    if (segments->empty()) {
+        if (!value) {
+            return JsonError{ "The root cannot be erased." };
+        }
+        return JsonDocument(value->share());
+    }
+    if (!root) {
+        return JsonError{ "Document is empty." };
+    }
+
+    auto edited = edit(*root, *segments, 0, value);
+    if (!edited) {
+        return edited.error();
+    }
+    return JsonDocument(std::move(*edited));
+}
+
+} // namespace
+
+
+JsonResult<JsonDocument> JsonDocument::TrySet(std::string_view path, JsonSlot value) const {
+    return apply(_root, path, &value);
+}
+
+JsonResult<JsonDocument> JsonDocument::TryErase(std::string_view path) const {
+    return apply(_root, path, nullptr);
+}
+
+JsonDocument JsonDocument::Set(std::string_view path, JsonSlot value) const {
+    auto result = TrySet(path, std::move(value));
+    if (!result) {
+        throw std::runtime_error(result.error().what());
+    }
+    return *result;
+}
+
+JsonDocument JsonDocument::Erase(std::string_view path) const {
+    auto result = TryErase(path);
+    if (!result) {
+        throw std::runtime_error(result.error().what());
+    }
+    return *result;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+
+#include "json_types.h"
+#include "json_result.h"
+
+/*
+ * Persistent, copy-on-write document versions.
+ *
+ * A JsonDocument never changes its tree. Set() and Erase() return a new
+ * version that copies only the containers on the path to the edited value;
+ * every other subtree is shared with the old version, which stays valid for
+ * anyone still reading it. Containers keep their elements and members in
+ * JsonVector and JsonMap, whose copies share storage, so copying a container
+ * on the path copies only the chunk and trie nodes that lead to the edited
+ * slot: an edit costs O(log n) per container along its path instead of the
+ * widths of those containers. Stored hashes are kept by recombining the
+ * cached hashes of the untouched nodes.
+ *
+ * Paths are keys and integer literal indices ("a.b[2].c"); "" is the root.
+ */
+class JsonDocument {
+public:
+    JsonDocument(std::shared_ptr<const JsonValue> root)
+        : _root(std::move(root)) {}
+
+    const std::shared_ptr<const JsonValue>& root() const {
+        return _root;
+    }
+
+    // Replaces the value at `path`. A missing last key is added to its object
+    // and the index one past the end appends to its array.
+    JsonResult<JsonDocument> TrySet(std::string_view path, JsonSlot value) const;
+
+    // Removes an object member or an array element
+    JsonResult<JsonDocument> TryErase(std::string_view path) const;
+
+    // Throwing wrappers of the above
+    JsonDocument Set(std::string_view path, JsonSlot value) const;
+
+    JsonDocument Erase(std::string_view path) const;
+
+private:
+    std::shared_ptr<const JsonValue> _root;
+};
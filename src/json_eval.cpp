@@ -1,104 +1,602 @@
 #include "json_eval.h"
 #include "json_types.h"
+#include "json_intrinsics.h"
+#include "json_strings.h"
+#include "json_stats.h"
 #include <cassert>
+#include <charconv>
 #include <memory>
 #include <stdexcept>
 #include <string>
 
-//  a.b[a.b[1]].c
+static bool isIntegerLiteral(std::string_view token) {
+    size_t start = (!token.empty() && token[0] == '-') ? 1 : 0;
+    if (start == token.size()) {
+        return false;
+    }
+    for (size_t i = start; i < token.size(); ++i) {
+        if (!std::isdigit((unsigned char)token[i])) {
+            return false;
+        }
+    }
+    return true;
+}
 
-// a.b[1].c
+static void skipSpaces(std::string_view expression, size_t& pos) {
+    while (pos < expression.size() && expression[pos] == ' ') {
+        ++pos;
+    }
+}
 
-std::shared_ptr<JsonValue> JsonEval::EvaluateExpression(std::shared_ptr<JsonValue> parent, std::string& expression)
+// 'text' or "text", with backslash escaping the quote and itself
+static JsonResult<std::string> readLiteral(std::string_view expression, size_t& pos) {
+    size_t start = pos;
+    if (pos >= expression.size() || (expression[pos] != '\'' && expression[pos] != '"')) {
+        return JsonError{ "Expected a string literal.", start };
+    }
+    char quote = expression[pos++];
+    std::string value;
+    while (pos < expression.size()) {
+        char ch = expression[pos++];
+        if (ch == quote) {
+            return value;
+        }
+        if (ch == '\\' && pos < expression.size()) {
+            ch = expression[pos++];
+        }
+        value += ch;
+    }
+    return JsonError{ "Unterminated string literal.", start };
+}
+
+JsonResult<const JsonValue*> JsonEval::Query(std::string_view expression) const
 {
-    std::string token{};
+    Cursor cursor(expression);
+
+    auto result = evaluate(cursor);
+    if (result && !cursor.temporaries.empty()) {
+        return JsonError{ "Expression computes a new value, use TryEvaluateExpression().", 0 };
+    }
+    if (result && cursor.isBoxed(*result)) {
+        return JsonError{ "Element of a packed array is not a node, use TryEvaluateExpression().", 0 };
+    }
+    return result;
+}
+
+JsonResult<std::shared_ptr<const JsonValue>> JsonEval::TryEvaluateExpression(std::string_view expression) const
+{
+    Cursor cursor(expression);
+
+    auto node = evaluate(cursor);
+    if (!node) {
+        return node.error();
+    }
+    for (const auto& temporary : cursor.temporaries) {
+        if (temporary.get() == *node) {
+            return temporary;
+        }
+    }
+    if (cursor.isBoxed(*node)) {
+        return std::shared_ptr<const JsonValue>(std::make_shared<JsonNumber>(*static_cast<const JsonNumber*>(*node)));
+    }
+    // Aliasing constructor: keeps the whole tree alive while the result is in use
+    return std::shared_ptr<const JsonValue>(_root, *node);
+}
 
-    int i = 0;
-    char ch{};
-    for (; i < expression.length(); ++i) {
-        ch = expression[i];
+std::shared_ptr<const JsonValue> JsonEval::EvaluateExpression(std::string_view expression) const
+{
+    auto result = TryEvaluateExpression(expression);
+    if (!result) {
+        throw std::runtime_error(result.error().what());
+    }
+    return *result;
+}
 
-        if (ch == '.' || ch == '[' || ch == ']') {
-            ++i;
+std::string_view JsonEval::readToken(Cursor& cursor)
+{
+    size_t start = cursor.pos;
+    while (!cursor.atEnd()) {
+        char ch = cursor.expression[cursor.pos];
+        if (ch == '.' || ch == '[' || ch == ']' || ch == '(' || ch == ')' || ch == ',') {
             break;
+        }
+        ++cursor.pos;
+    }
+    return cursor.expression.substr(start, cursor.pos - start);
+}
+
+JsonResult<const JsonValue*> JsonEval::evaluate(Cursor& cursor) const
+{
+    auto operand = evalOperand(cursor);
+    if (!operand) {
+        return operand.error();
+    }
+    if (!cursor.atEnd()) {
+        return JsonError{ std::string("Unexpected character '") + cursor.peek() + "'.", cursor.pos };
+    }
+    if (operand->isList) {
+        return makeArray(cursor, operand->items);
+    }
+    return operand->value;
+}
+
+JsonResult<JsonEval::Operand> JsonEval::evalOperand(Cursor& cursor) const
+{
+    if (cursor.depth >= MaxNesting) {
+        return JsonError{ "Expression nesting exceeds the maximum depth of " + std::to_string(MaxNesting) + ".", cursor.pos };
+    }
+
+    size_t start = cursor.pos;
+    std::string_view name = readToken(cursor);
+
+    ++cursor.depth;
+    JsonResult<Operand> result = JsonError{};
+    if (cursor.peek() == '(') {
+        result = evalCall(cursor, name, start);
+    } else {
+        cursor.pos = start;
+        result = evalPath(cursor);
+    }
+    --cursor.depth;
+    return result;
+}
+
+JsonResult<JsonEval::Operand> JsonEval::evalPath(Cursor& cursor) const
+{
+    Operand current;
+    if (cursor.scope) {
+        current = *cursor.scope;
+    } else {
+        current.value = _root.get();
+    }
+
+    for (bool first = true;; first = false) {
+        size_t tokenPos = cursor.pos;
+        std::string_view key = readToken(cursor);
+
+        if (isIntegerLiteral(key)) {
+            return JsonError{ "Integer literal can only be used as an array index.", tokenPos };
+        }
+
+        // Find current token in parent, or in every projected value
+        auto member = [&](const JsonValue*& value) -> bool {
+            if (value->type() != JsonType::Object) {
+                return false;
+            }
+            JSON_STATS_ADD(hashLookups, 1);
+            value = static_cast<const JsonObject*>(value)->find(key);
+            return value != nullptr;
+        };
+        const JsonValue* failed = nullptr;
+        if (first && key == "@") {
+            // The element of a filter predicate, or the root
+        } else if (!current.isList) {
+            failed = current.value;
+            if (member(current.value)) {
+                failed = nullptr;
+            }
         } else {
-            token += ch;
+            for (const JsonValue*& item : current.items) {
+                const JsonValue* parent = item;
+                if (!member(item)) {
+                    failed = parent;
+                    break;
+                }
+            }
+        }
+        if (failed) {
+            if (failed->type() != JsonType::Object) {
+                return JsonError{ "Token preceding '.' must be a JSON object.", tokenPos };
+            }
+            return JsonError{ "Key \"" + std::string(key) + "\" was not found in parent object.", tokenPos };
         }
+
+        while (cursor.peek() == '[') {
+            size_t bracketPos = cursor.pos;
+
+            if (cursor.expression.substr(cursor.pos, 3) == "[*]") {
+                cursor.pos += 3;
+
+                // Projection: continue with every element (of every projected array)
+                std::vector<const JsonValue*> items;
+                const std::vector<const JsonValue*> single{ current.value };
+                for (const JsonValue* value : current.isList ? current.items : single) {
+                    if (value->type() != JsonType::Array) {
+                        return JsonError{ "Token preceding '[' must be a JSON array.", bracketPos };
+                    }
+                    appendElements(cursor, *static_cast<const JsonArray*>(value), items);
+                }
+                current.items = std::move(items);
+                current.isList = true;
+                continue;
+            }
+
+            if (!current.isList && current.value->type() != JsonType::Array) {
+                return JsonError{ "Token preceding '[' must be a JSON array.", bracketPos };
+            }
+            ++cursor.pos;
+
+            size_t indexPos = cursor.pos;
+            auto index = evalIndex(cursor);
+            if (!index) {
+                return index.error();
+            }
+            if (cursor.peek() != ']') {
+                return JsonError{ "Expected ']' after array index.", cursor.pos };
+            }
+            ++cursor.pos;
+
+            // Negative indices wrap around to huge values and fail the range check
+            auto element = [&](const JsonValue*& value) -> JsonResult<bool> {
+                if (value->type() != JsonType::Array) {
+                    return JsonError{ "Token preceding '[' must be a JSON array.", bracketPos };
+                }
+                const JsonValue* child = JsonEval::element(cursor, *static_cast<const JsonArray*>(value), *index);
+                if (!child) {
+                    return JsonError{ "Index '" + std::to_string(*index) + "' is out of range.", indexPos };
+                }
+                value = child;
+                return true;
+            };
+            if (!current.isList) {
+                auto ok = element(current.value);
+                if (!ok) {
+                    return ok.error();
+                }
+            } else {
+                for (const JsonValue*& item : current.items) {
+                    auto ok = element(item);
+                    if (!ok) {
+                        return ok.error();
+                    }
+                }
+            }
+        }
+
+        if (cursor.peek() != '.') {
+            return current;
+        }
+        ++cursor.pos;
     }
-    
-    std::shared_ptr<JsonValue> current{};
+}
 
-    if (_afterArrayIndex) {
-        assert(token == "");
+JsonResult<int> JsonEval::evalIndex(Cursor& cursor) const
+{
+    size_t indexPos = cursor.pos;
 
-        current = parent;
+    // Literal int index into an array
+    std::string_view token = readToken(cursor);
+    if (isIntegerLiteral(token)) {
+        int index;
+        auto [end, err] = std::from_chars(token.data(), token.data() + token.size(), index);
+        if (err != std::errc()) {
+            return JsonError{ "Integer literal \"" + std::string(token) + "\" is out of range.", indexPos };
+        }
+        return index;
+    }
 
-        _afterArrayIndex = false;
+    // Nested expression, evaluated from the root
+    if (cursor.depth >= MaxNesting) {
+        return JsonError{ "Expression nesting exceeds the maximum depth of " + std::to_string(MaxNesting) + ".", indexPos };
+    }
+    cursor.pos = indexPos;
+    const Operand* scope = cursor.scope;
+    cursor.scope = nullptr;
+    ++cursor.depth;
+    auto value = evalPath(cursor);
+    --cursor.depth;
+    cursor.scope = scope;
+    if (!value) {
+        return value.error();
+    }
+
+    if (value->isList || value->value->type() != JsonType::Number) {
+        return JsonError{ "Expected number value as index in JSON array.", indexPos };
+    }
+
+    const JsonNumber* number = static_cast<const JsonNumber*>(value->value);
+    if (!number->isInteger()) {
+        return JsonError{ "Expected integer index in JSON array.", indexPos };
+    }
+
+    return int(*number);
+}
+
+JsonResult<JsonEval::Operand> JsonEval::evalCall(Cursor& cursor, std::string_view name, size_t namePos) const
+{
+    bool list = name == "topk" || name == "sort" || name == "distinct" || name == "sortby" || name == "filter";
+    bool string = name == "contains" || name == "startsWith" || name == "endsWith" || name == "match" || name == "lower";
+    if (!list && !string) {
+        return JsonError{ "Unknown function '" + std::string(name) + "'.", namePos };
+    }
+    // A predicate gives one value per element, which these do not
+    if (list && cursor.scope) {
+        return JsonError{ "Function '" + std::string(name) + "' cannot be used in a filter predicate.", namePos };
+    }
+    ++cursor.pos; // '('
+
+    skipSpaces(cursor.expression, cursor.pos);
+    size_t argPos = cursor.pos;
+    auto arg = evalOperand(cursor);
+    if (!arg) {
+        return arg.error();
+    }
+    if (string) {
+        return evalStringCall(cursor, name, std::move(*arg), argPos);
+    }
+
+    std::vector<const JsonValue*> items;
+    const JsonArray* packed = nullptr;
+    if (arg->isList) {
+        items = std::move(arg->items);
+    } else if (arg->value->type() == JsonType::Array) {
+        const JsonArray* array = static_cast<const JsonArray*>(arg->value);
+        if (array->isPacked() && name != "sortby" && name != "filter") {
+            packed = array; // works on the buffer, no items needed
+        } else {
+            items.reserve(array->size());
+            appendElements(cursor, *array, items);
+        }
     } else {
-        // If token is just a literal int index into an array
-        try {
-            int index = std::stoi(token);
+        return JsonError{ "Function '" + std::string(name) + "' expects an array.", argPos };
+    }
+    return evalListCall(cursor, name, namePos, std::move(items), packed);
+}
 
-            if (!_inArrayIndex) {
-                throw std::runtime_error("Integer literal can only be used as an array index.");
+JsonResult<JsonEval::Operand> JsonEval::evalListCall(Cursor& cursor, std::string_view name, size_t namePos,
+                                                     std::vector<const JsonValue*> items, const JsonArray* packed) const
+{
+    // Second argument: the k of topk, the key path of sortby, the predicate of filter
+    size_t k = 0;
+    std::vector<std::string_view> field;
+    Operand predicate;
+    size_t argPos = cursor.pos;
+    if (name != "sort" && name != "distinct") {
+        skipSpaces(cursor.expression, cursor.pos);
+        if (cursor.peek() != ',') {
+            return JsonError{ "Function '" + std::string(name) + "' expects two arguments.", cursor.pos };
+        }
+        ++cursor.pos;
+        skipSpaces(cursor.expression, cursor.pos);
+
+        argPos = cursor.pos;
+        if (name == "topk") {
+            std::string_view token = readToken(cursor);
+            auto [end, err] = std::from_chars(token.data(), token.data() + token.size(), k);
+            if (token.empty() || err != std::errc() || end != token.data() + token.size()) {
+                return JsonError{ "Expected a non-negative integer.", argPos };
+            }
+        } else if (name == "sortby") {
+            size_t tokenPos = argPos;
+            std::string_view token = readToken(cursor);
+            for (;;) {
+                if (token.empty() || isIntegerLiteral(token)) {
+                    return JsonError{ "Expected a key.", tokenPos };
+                }
+                field.push_back(token);
+                if (cursor.peek() != '.') {
+                    break;
+                }
+                ++cursor.pos;
+                tokenPos = cursor.pos;
+                token = readToken(cursor);
             }
+        } else {
+            // The predicate is evaluated once, against all elements together
+            Operand scope;
+            scope.items = items;
+            scope.isList = true;
+            cursor.scope = &scope;
+            auto result = evalOperand(cursor);
+            cursor.scope = nullptr;
+            if (!result) {
+                return result.error();
+            }
+            predicate = std::move(*result);
+        }
+    }
+
+    skipSpaces(cursor.expression, cursor.pos);
+    if (cursor.peek() != ')') {
+        return JsonError{ "Expected ')' after function arguments.", cursor.pos };
+    }
+    ++cursor.pos;
+
+    Operand result;
+
+    if (packed) {
+        JsonResult<JsonIntrinsics::Positions> positions = JsonIntrinsics::Positions();
+        if (name == "topk") {
+            positions = JsonIntrinsics::TopK(*packed, k);
+        } else if (name == "sort") {
+            positions = JsonIntrinsics::Sort(*packed);
+        } else {
+            positions = JsonIntrinsics::Distinct(*packed);
+        }
+        if (!positions) {
+            return JsonError{ std::string(name) + ": " + positions.error().message, namePos };
+        }
+
+        // A packed array again, built without boxing any element
+        auto array = std::make_shared<JsonArray>();
+        array->reserve(positions->size());
+        for (uint32_t position : *positions) {
+            array->add(JsonSlot(packed->number(position)));
+        }
+        cursor.temporaries.push_back(array);
+        result.value = array.get();
+        return result;
+    }
 
-            current = std::make_shared<JsonNumber>(index);
-        } catch (const std::runtime_error& e) {
-            throw e; // propagate the error
-        } catch (...) {
-            std::shared_ptr<JsonObject> parentObj = std::dynamic_pointer_cast<JsonObject>(parent);
-            if (!parentObj) {
-                throw std::runtime_error("Token preceding '.' must be a JSON object.");
+    result.isList = true;
+
+    if (name == "filter") {
+        if (!predicate.isList || predicate.items.size() != items.size()) {
+            return JsonError{ "Filter predicate must give one boolean per element.", argPos };
+        }
+        for (size_t i = 0; i < items.size(); ++i) {
+            const JsonValue* keep = predicate.items[i];
+            if (keep->type() != JsonType::Boolean) {
+                return JsonError{ "Filter predicate must give one boolean per element.", argPos };
             }
-            
-            // Find current token in parent
-            current = parentObj->get(token);
-            if (!current) {
-                throw std::runtime_error("Key \"" + token + "\" was not found in parent object.");
+            if (static_cast<const JsonBoolean*>(keep)->value()) {
+                result.items.push_back(items[i]);
             }
         }
+        return result;
+    }
+
+    JsonResult<JsonIntrinsics::Positions> positions = JsonIntrinsics::Positions();
+    if (name == "topk") {
+        positions = JsonIntrinsics::TopK(items, k);
+    } else if (name == "sort") {
+        positions = JsonIntrinsics::Sort(items);
+    } else if (name == "distinct") {
+        positions = JsonIntrinsics::Distinct(items);
+    } else {
+        positions = JsonIntrinsics::SortBy(items, field);
+    }
+    if (!positions) {
+        return JsonError{ std::string(name) + ": " + positions.error().message, namePos };
     }
 
-    expression = expression.substr(i);
+    result.items.resize(positions->size());
+    for (size_t i = 0; i < result.items.size(); ++i) {
+        result.items[i] = items[(*positions)[i]];
+    }
+    return result;
+}
+
+JsonResult<JsonEval::Operand> JsonEval::evalStringCall(Cursor& cursor, std::string_view name,
+                                                       Operand arg, size_t argPos) const
+{
+    bool lower = name == "lower";
 
-    if (ch == '.') {
-        return EvaluateExpression(current, expression);
-    } else if (ch == '[') {
-        std::shared_ptr<JsonArray> currentArr = std::dynamic_pointer_cast<JsonArray>(current);
-        if (!currentArr) {
-            throw std::runtime_error("Token preceding '[' must be a JSON array.");
+    std::string literal;
+    if (!lower) {
+        skipSpaces(cursor.expression, cursor.pos);
+        if (cursor.peek() != ',') {
+            return JsonError{ "Function '" + std::string(name) + "' expects two arguments.", cursor.pos };
         }
+        ++cursor.pos;
+        skipSpaces(cursor.expression, cursor.pos);
 
-        _inArrayIndex = true;
+        auto parsed = readLiteral(cursor.expression, cursor.pos);
+        if (!parsed) {
+            return parsed.error();
+        }
+        literal = std::move(*parsed);
+    }
 
-        std::shared_ptr<JsonValue> retVal = EvaluateExpression(_root, expression);
-        
-        _inArrayIndex = false;
+    skipSpaces(cursor.expression, cursor.pos);
+    if (cursor.peek() != ')') {
+        return JsonError{ "Expected ')' after function arguments.", cursor.pos };
+    }
+    ++cursor.pos;
 
-        _afterArrayIndex = true;
-        
-        std::shared_ptr<JsonNumber> retNum = std::dynamic_pointer_cast<JsonNumber>(retVal);
-        if (!retNum) {
-            throw std::runtime_error("Expected number value as index in JSON array.");
+    // A single string, or every element of a projection or array
+    if (!arg.isList && arg.value->type() == JsonType::Array) {
+        appendElements(cursor, *static_cast<const JsonArray*>(arg.value), arg.items);
+        arg.isList = true;
+    }
+    if (!arg.isList) {
+        arg.items.push_back(arg.value);
+    }
+    for (const JsonValue* value : arg.items) {
+        if (value->type() != JsonType::String) {
+            return JsonError{ "Function '" + std::string(name) + "' expects strings.", argPos };
         }
+    }
+
+    Operand result;
+    result.isList = arg.isList;
+    result.items.reserve(arg.items.size());
 
-        if (!retNum->isInteger()) {
-            throw std::runtime_error("Expected integer index in JSON array.");
+    if (lower && !result.isList) {
+        auto string = std::make_shared<JsonString>(JsonStrings::Lower(static_cast<const JsonString*>(arg.value)->value()));
+        cursor.temporaries.push_back(string);
+        result.value = string.get();
+        return result;
+    }
+    if (lower) {
+        auto array = std::make_shared<JsonArray>();
+        array->reserve(arg.items.size());
+        for (const JsonValue* value : arg.items) {
+            array->add(JsonSlot(JsonString(JsonStrings::Lower(static_cast<const JsonString*>(value)->value()))));
+        }
+        cursor.temporaries.push_back(array);
+        for (size_t i = 0; i < array->size(); ++i) {
+            result.items.push_back(array->at(i));
         }
+    } else {
+        bool (*test)(std::string_view, std::string_view) =
+            name == "contains"   ? JsonStrings::Contains :
+            name == "startsWith" ? JsonStrings::StartsWith :
+            name == "endsWith"   ? JsonStrings::EndsWith :
+                                   JsonStrings::Match;
+        const JsonValue* yes = JsonBoolean::True().get();
+        const JsonValue* no = JsonBoolean::False().get();
+        for (const JsonValue* value : arg.items) {
+            result.items.push_back(test(static_cast<const JsonString*>(value)->value(), literal) ? yes : no);
+        }
+    }
 
-        int index = *retNum;
+    if (!result.isList) {
+        result.value = result.items.front();
+        result.items.clear();
+    }
+    return result;
+}
 
-        std::shared_ptr<JsonValue> arrChild = currentArr->get(index);
-        if (!arrChild) {
-            throw std::runtime_error("Index '" + std::to_string(index) + "' is out of range.");
+void JsonEval::appendElements(Cursor& cursor, const JsonArray& array, std::vector<const JsonValue*>& items)
+{
+    if (!array.isPacked()) {
+        for (const JsonSlot& element : array.elements()) {
+            items.push_back(element.get());
         }
+        return;
+    }
+    for (size_t i = 0; i < array.size(); ++i) {
+        items.push_back(&cursor.numbers.emplace_back(array.number(i)));
+    }
+}
 
-        return EvaluateExpression(arrChild, expression);
-    } else if (ch == ']') {
-        
-        return current;
+const JsonValue* JsonEval::element(Cursor& cursor, const JsonArray& array, size_t index)
+{
+    if (!array.isPacked()) {
+        return array.at(index);
+    }
+    if (index >= array.size()) {
+        return nullptr;
     }
+    return &cursor.numbers.emplace_back(array.number(index));
+}
 
-    return current;
+const JsonValue* JsonEval::makeArray(Cursor& cursor, const std::vector<const JsonValue*>& items) const
+{
+    auto array = std::make_shared<JsonArray>();
+    array->reserve(items.size());
+    for (const JsonValue* item : items) {
+        array->add(slotOf(item));
+    }
+    cursor.temporaries.push_back(array);
+    return array.get();
+}
+
+JsonSlot JsonEval::slotOf(const JsonValue* node) const
+{
+    switch (node->type()) {
+        case JsonType::Number:
+            return JsonSlot(*static_cast<const JsonNumber*>(node));
+        case JsonType::String:
+            return JsonSlot(JsonString(static_cast<const JsonString*>(node)->value()));
+        case JsonType::Boolean:
+            return static_cast<const JsonBoolean*>(node)->value() ? JsonBoolean::True() : JsonBoolean::False();
+        case JsonType::Null:
+            return JsonNull::Instance();
+        default:
+            // Containers of the tree; the result keeps the tree alive. The tree
+            // is never modified through the result, which is handed out as const.
+            return std::shared_ptr<JsonValue>(std::const_pointer_cast<JsonValue>(_root), const_cast<JsonValue*>(node));
+    }
 }
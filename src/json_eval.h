@@ -1,26 +1,149 @@
 #pragma once
 
 #include "json_types.h"
+#include "json_result.h"
+#include <deque>
 #include <memory>
+#include <string_view>
+#include <vector>
 
 
+/*
+ * Evaluates expressions against a parsed tree:
+ *
+ *     a.b[a.b[1]].c           paths, with nested paths as indices
+ *     a.items[*].price        projection over all elements of an array
+ *     topk(a.items[*].price, 100), sort(a.b), distinct(a.tags)
+ *     sortby(a.items[*], price)
+ *     contains(a.log[*].msg, 'timeout'), startsWith, endsWith, match, lower
+ *     filter(a.log[*], match(lower(host), '*.example.com'))
+ *
+ * String functions apply to every element of a projection or array. Paths in
+ * a filter predicate are relative to the element, which '@' stands for.
+ * String literals take single or double quotes.
+ *
+ * The tree is held as const and never modified, and evaluation keeps all of
+ * its state on the caller's stack, so a single JsonEval can serve any number
+ * of concurrent queries.
+ */
 class JsonEval {
 
 public:
-    JsonEval(const std::shared_ptr<JsonValue>& root) 
-        : _root(root) {}
+    JsonEval(std::shared_ptr<const JsonValue> root)
+        : _root(std::move(root)) {}
 
-    std::shared_ptr<JsonValue> EvaluateExpression(std::shared_ptr<JsonValue> root, std::string& expression);
+    // Returns a node of the tree, valid as long as the tree is. Does not touch
+    // any reference counts, so concurrent queries do not contend. Expressions
+    // that compute a new value (projections, intrinsics) are rejected, and so
+    // are elements of packed arrays, which are not nodes.
+    JsonResult<const JsonValue*> Query(std::string_view expression) const;
 
-private:
+    // Like Query, but the result shares ownership of the tree and outlives the
+    // evaluator. Computed values are returned as new nodes.
+    JsonResult<std::shared_ptr<const JsonValue>> TryEvaluateExpression(std::string_view expression) const;
+
+    // Throwing wrapper of TryEvaluateExpression.
+    std::shared_ptr<const JsonValue> EvaluateExpression(std::string_view expression) const;
 
-    void logError(const std::string& message) {
-        std::cerr << "[JSON expression]: " << message << std::endl;
+    const std::shared_ptr<const JsonValue>& root() const {
+        return _root;
     }
 
-    std::shared_ptr<JsonValue> _root;
-    std::string _expression;
+    // Deepest nesting of subscripts and calls; evaluation recurses on it
+    static constexpr int MaxNesting = 256;
+
+    // Evaluates a path compiled at build time, e.g. Query<JsonPath<"a.b[2].c">>()
+    template <typename Path>
+    JsonResult<const JsonValue*> Query() const {
+        return Path::Query(*_root);
+    }
+
+private:
+    // A single value or, after a '[*]' projection, a list of values
+    struct Operand {
+        const JsonValue* value = nullptr;
+        std::vector<const JsonValue*> items;
+        bool isList = false;
+    };
+
+    // Evaluation cursor, lives on the stack of the calling thread
+    struct Cursor {
+        explicit Cursor(std::string_view expression)
+            : expression(expression) {}
+
+        std::string_view expression;
+        size_t pos = 0;
+
+        // Values computed by this evaluation
+        std::vector<std::shared_ptr<const JsonValue>> temporaries;
+
+        // Elements of packed arrays, boxed for the items of a list or a
+        // subscript. They are not nodes of the tree.
+        std::deque<JsonNumber> numbers;
+
+        // Elements a filter predicate is evaluated against, instead of the root
+        const Operand* scope = nullptr;
+
+        int depth = 0; // of nested subscripts and calls
+
+        bool atEnd() const {
+            return pos >= expression.size();
+        }
+
+        char peek() const {
+            return atEnd() ? '\0' : expression[pos];
+        }
+
+        bool isBoxed(const JsonValue* node) const {
+            if (node->type() == JsonType::Number) {
+                for (const JsonNumber& number : numbers) {
+                    if (&number == node) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+    };
+
+    JsonResult<const JsonValue*> evaluate(Cursor& cursor) const;
+
+    // expression := call | path
+    JsonResult<Operand> evalOperand(Cursor& cursor) const;
+
+    // path := ('@' | key) ('.' key | '[' index ']' | '[*]')*
+    JsonResult<Operand> evalPath(Cursor& cursor) const;
+
+    // index := integer | path
+    JsonResult<int> evalIndex(Cursor& cursor) const;
+
+    // call := name '(' expression [',' argument] ')'
+    JsonResult<Operand> evalCall(Cursor& cursor, std::string_view name, size_t namePos) const;
+
+    // topk, sort, distinct, sortby, filter: work on the list as a whole. Given
+    // a packed array instead of items, topk, sort and distinct work on its
+    // buffer and return a packed array.
+    JsonResult<Operand> evalListCall(Cursor& cursor, std::string_view name, size_t namePos,
+                                     std::vector<const JsonValue*> items, const JsonArray* packed = nullptr) const;
+
+    // contains, startsWith, endsWith, match, lower: applied to every element
+    JsonResult<Operand> evalStringCall(Cursor& cursor, std::string_view name,
+                                       Operand arg, size_t argPos) const;
+
+    // Appends borrowed pointers to the elements of `array`; packed numbers are
+    // boxed into the cursor rather than into the array
+    static void appendElements(Cursor& cursor, const JsonArray& array, std::vector<const JsonValue*>& items);
+
+    // Element `index` of `array` boxed the same way, null if out of range
+    static const JsonValue* element(Cursor& cursor, const JsonArray& array, size_t index);
+
+    // New array node holding `items`, kept alive by the cursor
+    const JsonValue* makeArray(Cursor& cursor, const std::vector<const JsonValue*>& items) const;
+
+    // Slot of a result array referring to `node`
+    JsonSlot slotOf(const JsonValue* node) const;
+
+    static std::string_view readToken(Cursor& cursor);
 
-    bool _inArrayIndex = false;
-    bool _afterArrayIndex = false;
-};
\ No newline at end of file
+    std::shared_ptr<const JsonValue> _root;
+};
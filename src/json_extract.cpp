@@ -0,0 +1,174 @@
+#include "json_extract.h"
+#include "json_path.h"
+#include "json_scanner.h"
+#include "json_stats.h"
+
+#include <sstream>
+
+JsonResult<JsonExtractor> JsonExtractor::Compile(const std::vector<std::string>& paths) {
+    JsonExtractor extractor;
+    extractor._paths = paths;
+    extractor._nodes.emplace_back(); // root
+
+    for (size_t field = 0; field < paths.size(); ++field) {
+        auto segments = JsonLiteralPath::Split(paths[field]);
+        if (!segments) {
+            const JsonError& error = segments.error();
+            return JsonError{ "Path \"" + paths[field] + "\": " + error.message, error.position };
+        }
+
+        uint32_t node = 0;
+        for (const JsonPathSegment& segment : *segments) {
+            // Indices into _nodes, which grows below
+            uint32_t next = uint32_t(extractor._nodes.size());
+            uint32_t child;
+            if (segment.isIndex) {
+                child = extractor._nodes[node].indices.try_emplace(segment.index, next).first->second;
+            } else {
+                child = extractor._nodes[node].keys.try_emplace(segment.key, next).first->second;
+            }
+            if (child == next) {
+                extractor._nodes.emplace_back();
+            }
+            node = child;
+        }
+        extractor._nodes[node].fields.push_back(uint32_t(field));
+    }
+
+    return extractor;
+}
+
+JsonResult<JsonExtractor::Record> JsonExtractor::Extract(std::istream& in) const {
+    Record record(_paths.size());
+    State state{ record, _paths.size() };
+
+    JsonScanner scanner(in);
+    bool ok = state.remaining == 0 || extract(scanner, 0, state);
+
+    JSON_STATS_ADD(bytesRead, scanner.offset());
+
+    if (!ok) {
+        return scanner.error();
+    }
+    return record;
+}
+
+bool JsonExtractor::extract(JsonScanner& scanner, uint32_t index, State& state) const {
+    const Node& node = _nodes[index];
+    if (node.fields.empty()) {
+        return extractChildren(scanner, node, state);
+    }
+
+    std::string text;
+    if (!scanner.captureValue(text)) {
+        return false;
+    }
+    // A repeated key overwrites the value, as in the parser, but its paths
+    // were already counted as found
+    for (uint32_t field : node.fields) {
+        if (!state.record[field]) {
+            --state.remaining;
+        }
+    }
+
+    // Paths that continue below a captured value are looked up in its text
+    if (!node.keys.empty() || !node.indices.empty()) {
+        std::istringstream captured(text);
+        JsonScanner inner(captured);
+        if (!extractChildren(inner, node, state)) {
+            return scanner.fail(inner.error().message);
+        }
+    }
+
+    for (size_t i = 0; i + 1 < node.fields.size(); ++i) {
+        state.record[node.fields[i]] = text;
+    }
+    state.record[node.fields.back()] = std::move(text);
+    return true;
+}
+
+bool JsonExtractor::extractChildren(JsonScanner& scanner, const Node& node, State& state) const {
+    int ch = scanner.peekToken();
+
+    if (ch == '{' && !node.keys.empty()) {
+        scanner.get();
+        bool more = scanner.peekToken() != '}';
+        if (!more) {
+            scanner.get();
+        }
+
+        std::string key;
+        while (more) {
+            if (!scanner.readString(key) || !scanner.expect(':')) {
+                return false;
+            }
+            auto it = node.keys.find(key);
+            if (it != node.keys.end()) {
+                if (!extract(scanner, it->second, state)) {
+                    return false;
+                }
+                if (state.remaining == 0) {
+                    return true;
+                }
+            } else if (!scanner.skipValue()) {
+                return false;
+            }
+            if (!scanner.nextItem('}', more)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    if (ch == '[' && !node.indices.empty()) {
+        scanner.get();
+        bool more = scanner.peekToken() != ']';
+        if (!more) {
+            scanner.get();
+        }
+
+        for (size_t index = 0; more; ++index) {
+            auto it = node.indices.find(index);
+            if (it != node.indices.end()) {
+                if (!extract(scanner, it->second, state)) {
+                    return false;
+                }
+                if (state.remaining == 0) {
+                    return true;
+                }
+            } else if (!scanner.skipValue()) {
+                return false;
+            }
+            if (!scanner.nextItem(']', more)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Nothing below is wanted, or the value is not of the type a path expects
+    return scanner.skipValue();
+}
+
+void JsonExtractor::Write(std::ostream& out, const Record& record) const {
+    out << '{';
+    for (size_t i = 0; i < _paths.size(); ++i) {
+        if (i > 0) {
+            out << ", ";
+        }
+        out << '"';
+        for (char ch : _paths[i]) {
+            if (ch == '"' || ch == '\\') {
+                out << '\\';
+            }
+            out << ch;
+        }
+        out << "\": ";
+        if (record[i]) {
+            out << *record[i];
+        } else {
+            out << "null";
+        }
+    }
+    out << '}';
+}
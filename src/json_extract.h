@@ -0,0 +1,69 @@
+#pragma once
+
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+#include "json_types.h"
+#include "json_result.h"
+
+class JsonScanner;
+
+/*
+ * Extracts many paths from a document in one forward pass, without a tree.
+ *
+ *     auto extractor = JsonExtractor::Compile({ "a.b", "a.c[2]", "d" });
+ *     auto record = extractor->Extract(file);
+ *
+ * The paths are merged into a trie. Scanning follows the trie, so each key of
+ * the document costs one hash lookup however many paths were asked for.
+ * Subtrees no path leads into are skipped without allocating, and the pass
+ * stops as soon as every path has been found. Matched values are captured as
+ * JSON text. Of repeated keys the last one read wins, as in the parser, but a
+ * repeat after the pass has stopped is not seen.
+ */
+class JsonExtractor {
+public:
+    // Text of every path's value, in the order given to Compile; empty where
+    // the document has no such value
+    using Record = std::vector<std::optional<std::string>>;
+
+    // Paths are made of keys and integer indices ("a.b[2].c"); "" is the root
+    static JsonResult<JsonExtractor> Compile(const std::vector<std::string>& paths);
+
+    // Reads one document from `in`, up to the last requested value
+    JsonResult<Record> Extract(std::istream& in) const;
+
+    // Writes {"path": value, ...}, with null for missing values
+    void Write(std::ostream& out, const Record& record) const;
+
+    const std::vector<std::string>& paths() const {
+        return _paths;
+    }
+
+private:
+    struct Node {
+        std::unordered_map<std::string, uint32_t, JsonKeyHash, std::equal_to<>> keys;
+        std::unordered_map<size_t, uint32_t> indices;
+        std::vector<uint32_t> fields; // paths ending here, duplicates included
+    };
+
+    struct State {
+        Record& record;
+        size_t remaining; // paths whose record entry is still empty
+    };
+
+    JsonExtractor() = default;
+
+    // Matches the value at the scanner against the trie below `node`
+    bool extract(JsonScanner& scanner, uint32_t node, State& state) const;
+
+    bool extractChildren(JsonScanner& scanner, const Node& node, State& state) const;
+
+    std::vector<Node> _nodes;
+    std::vector<std::string> _paths;
+};
@@ -0,0 +1,348 @@
+#include "json_hash.h"
+#include "json_eval.h"
+
+#include <algorithm>
+#include <cstring>
+#include <optional>
+
+namespace {
+
+// splitmix64 finalizer
+uint64_t mix(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return x;
+}
+
+// Separates values of different types with equal payloads, e.g. [] and {}
+uint64_t seed(JsonType type) {
+    return mix(0x9e3779b97f4a7c15ull * (uint64_t(type) + 1));
+}
+
+uint64_t hashBytes(std::string_view bytes, uint64_t hash) {
+    size_t i = 0;
+    for (; i + 8 <= bytes.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, bytes.data() + i, 8);
+        hash = mix(hash ^ word);
+    }
+    uint64_t tail = 0;
+    std::memcpy(&tail, bytes.data() + i, bytes.size() - i);
+    return mix(hash ^ tail ^ (uint64_t(bytes.size()) << 56));
+}
+
+// 1 and 1.0 are the same JSON number; so are 0 and -0
+uint64_t hashNumber(double number) {
+    number += 0.0;
+    uint64_t bits;
+    std::memcpy(&bits, &number, sizeof(bits));
+    return mix(seed(JsonType::Number) ^ bits);
+}
+
+// Arrays are hashed as the polynomial sum of h(e[i]) * B^(n-1-i) modulo the
+// prime 2^61 - 1. Unlike a running hash, the sums of two runs of elements
+// combine in O(1), so JsonVector can cache them per node and an edited array
+// is rehashed along the path of the edit only.
+const uint64_t s_prime = (uint64_t(1) << 61) - 1;
+const uint64_t s_base = 0x1fc4ce47a7b2d91ull % s_prime;
+
+uint64_t reduce(uint64_t x) {
+    x = (x & s_prime) + (x >> 61);
+    return x >= s_prime ? x - s_prime : x;
+}
+
+// a * b modulo s_prime, for a, b < s_prime, without 128-bit integers
+uint64_t mulMod(uint64_t a, uint64_t b) {
+    uint64_t aHi = a >> 32, aLo = a & 0xffffffffu;
+    uint64_t bHi = b >> 32, bLo = b & 0xffffffffu;
+    uint64_t lo = aLo * bLo;
+    uint64_t mid = aHi * bLo + aLo * bHi; // < 2^62
+    uint64_t hi = aHi * bHi;              // < 2^58
+    // 2^64 = 8 and 2^61 = 1 (mod s_prime)
+    uint64_t x = (hi << 3) + (mid >> 29) + ((mid & ((uint64_t(1) << 29) - 1)) << 32) + (lo >> 61) + (lo & s_prime);
+    return reduce(reduce(x));
+}
+
+uint64_t powMod(uint64_t base, uint64_t exponent) {
+    uint64_t result = 1;
+    for (; exponent; exponent >>= 1) {
+        if (exponent & 1) {
+            result = mulMod(result, base);
+        }
+        base = mulMod(base, base);
+    }
+    return result;
+}
+
+// Hash sum of a run of elements, given the hash of each
+template <typename T, typename ElementHash>
+uint64_t hashRun(const T* elements, size_t count, const ElementHash& hash) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+        sum = reduce(mulMod(sum, s_base) + reduce(hash(elements[i])));
+    }
+    return sum;
+}
+
+uint64_t joinRuns(uint64_t left, uint64_t right, size_t rightCount) {
+    return reduce(mulMod(left, powMod(s_base, rightCount)) + right);
+}
+
+template <typename T, typename ElementHash>
+uint64_t hashElements(const JsonVector<T>& elements, const ElementHash& hash) {
+    auto run = [&](const T* run, size_t count) { return hashRun(run, count, hash); };
+    return elements.summarize(run, joinRuns);
+}
+
+uint64_t hashMember(const JsonObject::Members::Member& member) {
+    return mix(hashBytes(member.first, seed(JsonType::String)) ^ (JsonHash::Of(*member.second) * 0x9e3779b97f4a7c15ull));
+}
+
+// Stored hashes use 0 for "not computed"
+uint64_t nonZero(uint64_t hash) {
+    return hash != 0 ? hash : 1;
+}
+
+void diff(const JsonValue& a, const JsonValue& b, std::string& path, std::vector<std::string>& changes) {
+    if (JsonHash::Equal(a, b)) {
+        return;
+    }
+    if (a.type() != b.type() || (a.type() != JsonType::Object && a.type() != JsonType::Array)) {
+        changes.push_back(path);
+        return;
+    }
+
+    size_t base = path.size();
+
+    if (a.type() == JsonType::Array) {
+        const JsonArray& left = static_cast<const JsonArray&>(a);
+        const JsonArray& right = static_cast<const JsonArray&>(b);
+        size_t common = std::min(left.size(), right.size());
+        for (size_t i = 0; i < std::max(left.size(), right.size()); ++i) {
+            path += '[' + std::to_string(i) + ']';
+            if (i < common && (left.isPacked() || right.isPacked())) {
+                // Compared by value, without boxing every element for good
+                JsonNumber a = left.isPacked() ? left.number(i) : JsonNumber(0);
+                JsonNumber b = right.isPacked() ? right.number(i) : JsonNumber(0);
+                diff(left.isPacked() ? a : *left.at(i), right.isPacked() ? b : *right.at(i), path, changes);
+            } else if (i < common) {
+                diff(*left.at(i), *right.at(i), path, changes);
+            } else {
+                changes.push_back(path);
+            }
+            path.resize(base);
+        }
+        return;
+    }
+
+    const JsonObject& left = static_cast<const JsonObject&>(a);
+    const JsonObject& right = static_cast<const JsonObject&>(b);
+    auto member = [&](const std::string& key) {
+        if (base > 0) {
+            path += '.';
+        }
+        path += key;
+    };
+    for (const auto& [key, slot] : left.members()) {
+        member(key);
+        const JsonValue* other = right.find(key);
+        if (other) {
+            diff(*slot, *other, path, changes);
+        } else {
+            changes.push_back(path);
+        }
+        path.resize(base);
+    }
+    for (const auto& [key, slot] : right.members()) {
+        if (!left.find(key)) {
+            member(key);
+            changes.push_back(path);
+            path.resize(base);
+        }
+    }
+}
+
+} // namespace
+
+
+uint64_t JsonHash::Of(const JsonValue& value) {
+    switch (value.type()) {
+        case JsonType::Object: {
+            uint64_t stored = static_cast<const JsonObject&>(value).hash();
+            return stored != 0 ? stored : Compute(value);
+        }
+        case JsonType::Array: {
+            uint64_t stored = static_cast<const JsonArray&>(value).hash();
+            return stored != 0 ? stored : Compute(value);
+        }
+        case JsonType::String:
+            return hashBytes(static_cast<const JsonString&>(value).value(), seed(JsonType::String));
+        case JsonType::Number:
+            return hashNumber(static_cast<const JsonNumber&>(value).value());
+        case JsonType::Boolean:
+            return mix(seed(JsonType::Boolean) + static_cast<const JsonBoolean&>(value).value());
+        case JsonType::Null:
+            break;
+    }
+    return seed(JsonType::Null);
+}
+
+uint64_t JsonHash::Compute(const JsonValue& container) {
+    uint64_t hash = seed(container.type());
+
+    if (container.type() == JsonType::Array) {
+        const JsonArray& array = static_cast<const JsonArray&>(container);
+        uint64_t sum;
+        if (auto integers = array.integers()) {
+            sum = hashElements(*integers, [](int32_t number) { return hashNumber(double(number)); });
+        } else if (auto doubles = array.doubles()) {
+            sum = hashElements(*doubles, [](double number) { return hashNumber(number); });
+        } else {
+            sum = hashElements(array.elements(), [](const JsonSlot& element) { return Of(*element); });
+        }
+        hash = mix(mix(hash ^ sum) + array.size());
+    } else if (container.type() == JsonType::Object) {
+        // A sum does not depend on the order the members are visited in, and
+        // is cached per node like the sums of arrays
+        uint64_t members = static_cast<const JsonObject&>(container).members().summarize(hashMember);
+        hash = mix(hash ^ members);
+    } else {
+        return Of(container);
+    }
+
+    return nonZero(hash);
+}
+
+uint64_t JsonHash::Store(JsonValue& value) {
+    if (value.type() == JsonType::Object) {
+        JsonObject& object = static_cast<JsonObject&>(value);
+        if (object.hash() == 0) {
+            for (const auto& [key, slot] : object.members()) {
+                if (!slot.isInline()) {
+                    Store(*slot.share());
+                }
+            }
+            object.setHash(Compute(object));
+        }
+        return object.hash();
+    }
+    if (value.type() == JsonType::Array) {
+        JsonArray& array = static_cast<JsonArray&>(value);
+        if (array.hash() == 0) {
+            if (!array.isPacked()) {
+                for (const JsonSlot& slot : array.elements()) {
+                    if (!slot.isInline()) {
+                        Store(*slot.share());
+                    }
+                }
+            }
+            array.setHash(Compute(array));
+        }
+        return array.hash();
+    }
+    return Of(value);
+}
+
+bool JsonHash::Identical(const JsonValue& a, const JsonValue& b) {
+    if (&a == &b) {
+        return true;
+    }
+    if (a.type() != b.type()) {
+        return false;
+    }
+
+    switch (a.type()) {
+        case JsonType::Object: {
+            const JsonObject& left = static_cast<const JsonObject&>(a);
+            const JsonObject& right = static_cast<const JsonObject&>(b);
+            if (left.size() != right.size() || (left.hash() && right.hash() && left.hash() != right.hash())) {
+                return false;
+            }
+            for (const auto& [key, slot] : left.members()) {
+                const JsonValue* other = right.find(key);
+                if (!other || !Identical(*slot, *other)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case JsonType::Array: {
+            const JsonArray& left = static_cast<const JsonArray&>(a);
+            const JsonArray& right = static_cast<const JsonArray&>(b);
+            if (left.size() != right.size() || left.storage() != right.storage()
+                || (left.hash() && right.hash() && left.hash() != right.hash())) {
+                return false;
+            }
+            if (left.integers()) {
+                return std::equal(left.integers()->begin(), left.integers()->end(), right.integers()->begin());
+            }
+            if (left.doubles()) {
+                if (!std::equal(left.doubles()->begin(), left.doubles()->end(), right.doubles()->begin())) {
+                    return false;
+                }
+                for (size_t i = 0; i < left.size(); ++i) {
+                    if (left.number(i).isInteger() != right.number(i).isInteger()) {
+                        return false;
+                    }
+                }
+                return true;
+            }
+            return std::equal(left.elements().begin(), left.elements().end(), right.elements().begin(),
+                              [](const JsonSlot& a, const JsonSlot& b) { return Identical(*a, *b); });
+        }
+        case JsonType::String:
+            return static_cast<const JsonString&>(a).value() == static_cast<const JsonString&>(b).value();
+        case JsonType::Number: {
+            const JsonNumber& left = static_cast<const JsonNumber&>(a);
+            const JsonNumber& right = static_cast<const JsonNumber&>(b);
+            return left.isInteger() == right.isInteger() && left.value() == right.value();
+        }
+        case JsonType::Boolean:
+            return static_cast<const JsonBoolean&>(a).value() == static_cast<const JsonBoolean&>(b).value();
+        case JsonType::Null:
+            break;
+    }
+    return true;
+}
+
+std::vector<std::string> JsonHash::Diff(const JsonValue& a, const JsonValue& b) {
+    std::vector<std::string> changes;
+    std::string path;
+    diff(a, b, path, changes);
+    return changes;
+}
+
+JsonResult<std::shared_ptr<const JsonValue>> JsonQueryCache::Evaluate(const JsonEval& evaluator, std::string_view expression) {
+    if (!evaluator.root()) {
+        return JsonError{ "Nothing to evaluate." };
+    }
+
+    const std::shared_ptr<const JsonValue>& root = evaluator.root();
+    Key key{ std::string(expression), JsonHash::Of(*root) };
+    std::optional<Entry> cached;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _results.find(key);
+        if (it != _results.end()) {
+            cached = it->second;
+        }
+    }
+    // Compared outside the lock, this may visit the whole tree
+    if (cached && JsonHash::Identical(*cached->root, *root)) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_hits;
+        return cached->result;
+    }
+
+    auto result = evaluator.TryEvaluateExpression(expression);
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_results.size() >= _capacity) {
+        _results.clear();
+    }
+    _results.insert_or_assign(std::move(key), Entry{ root, result });
+    return result;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+#include "json_types.h"
+#include "json_result.h"
+
+class JsonEval;
+
+/*
+ * Merkle-style structural hashing of subtrees.
+ *
+ * A container's hash is derived from its children's hashes: in order for
+ * arrays, order-insensitive for object members, so documents that differ
+ * only in member order hash equal. JsonParser::EnableHashing() stores the
+ * hash of every object and array bottom-up while parsing, which makes Of()
+ * O(1) for containers; scalars are hashed from their value on demand.
+ * Compute() reuses the hashes cached in the containers' storage nodes, so
+ * rehashing a container after an edit only visits the nodes it copied.
+ *
+ * Equal hashes mean equal structure with overwhelming probability (64-bit
+ * hashes), not with certainty.
+ */
+class JsonHash {
+public:
+    // Hash of a subtree; containers without a stored hash are hashed recursively
+    static uint64_t Of(const JsonValue& value);
+
+    // Hash of a container computed from the hashes of its children
+    static uint64_t Compute(const JsonValue& container);
+
+    // Hashes and stores every container of the subtree that has no hash yet
+    static uint64_t Store(JsonValue& value);
+
+    static bool Equal(const JsonValue& a, const JsonValue& b) {
+        return &a == &b || Of(a) == Of(b);
+    }
+
+    // Certain equality as the evaluator sees it: 1 and 1.0 differ here, they
+    // index arrays differently. Member order is still ignored. Shared and
+    // differently hashed subtrees are decided without being visited.
+    static bool Identical(const JsonValue& a, const JsonValue& b);
+
+    // Paths ("a.b[2]", "" for the root) where the two trees differ. Subtrees
+    // with equal hashes are skipped without being visited.
+    static std::vector<std::string> Diff(const JsonValue& a, const JsonValue& b);
+};
+
+/*
+ * Expression results keyed by (expression, hash of the evaluated tree), so
+ * re-evaluating an expression against an unchanged or structurally equal
+ * document is a lookup. Errors are cached as well. As the hash does not tell
+ * 1 from 1.0, a hit is only used if its tree is JsonHash::Identical to the
+ * one being evaluated.
+ *
+ * A cached result keeps the tree it was evaluated on alive. The cache is
+ * cleared when it reaches its capacity. It is safe to use from several threads.
+ */
+class JsonQueryCache {
+public:
+    JsonQueryCache(size_t capacity = 4096)
+        : _capacity(capacity) {}
+
+    JsonResult<std::shared_ptr<const JsonValue>> Evaluate(const JsonEval& evaluator, std::string_view expression);
+
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _results.size();
+    }
+
+    uint64_t hits() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _hits;
+    }
+
+private:
+    struct Key {
+        std::string expression;
+        uint64_t hash;
+
+        bool operator==(const Key&) const = default;
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return JsonKeyHash::Hash(key.expression) ^ size_t(key.hash);
+        }
+    };
+
+    struct Entry {
+        std::shared_ptr<const JsonValue> root; // the result was evaluated on
+        JsonResult<std::shared_ptr<const JsonValue>> result;
+    };
+
+    size_t _capacity;
+
+    mutable std::mutex _mutex;
+    std::unordered_map<Key, Entry, KeyHash> _results;
+    uint64_t _hits = 0;
+};
@@ -0,0 +1,320 @@
+#include "json_index.h"
+#include "json_parser.h"
+#include "json_path.h"
+#include "json_scanner.h"
+#include "json_stats.h"
+
+#include <filesystem>
+#include <fstream>
+
+namespace {
+
+const char* s_magic = "json_eval-index";
+const int s_version = 2;
+
+// Appends a member to a canonical path. Keys are escaped so that a key
+// containing '.' or '[' cannot pass for a longer path: {"a.b": 1} is a\.b.
+void appendKey(std::string& path, std::string_view key) {
+    if (!path.empty()) {
+        path += '.';
+    }
+    for (char ch : key) {
+        if (ch == '.' || ch == '[' || ch == ']' || ch == '\\') {
+            path += '\\';
+        }
+        path += ch;
+    }
+}
+
+void appendIndex(std::string& path, size_t index) {
+    path += '[' + std::to_string(index) + ']';
+}
+
+class IndexBuilder {
+public:
+    IndexBuilder(JsonScanner& scanner, const JsonIndex::Options& options,
+                 std::unordered_map<std::string, uint64_t>& offsets)
+        : _scanner(scanner), _options(options), _offsets(offsets) {}
+
+    // Records the children of the value at the scanner, recursing `depth` levels
+    bool indexValue(std::string& path, int depth) {
+        int ch = _scanner.peekToken();
+        if (depth >= _options.depth || (ch != '{' && ch != '[')) {
+            return _scanner.skipValue();
+        }
+        _scanner.get();
+
+        size_t base = path.size();
+        bool more = true;
+
+        if (ch == '{') {
+            if (_scanner.peekToken() == '}') {
+                _scanner.get();
+                return true;
+            }
+            std::string key;
+            while (more) {
+                if (!_scanner.readString(key) || !_scanner.expect(':')) {
+                    return false;
+                }
+                path.resize(base);
+                appendKey(path, key);
+
+                _scanner.peekToken();
+                _offsets[path] = _scanner.offset();
+                if (!indexValue(path, depth + 1) || !_scanner.nextItem('}', more)) {
+                    return false;
+                }
+            }
+        } else {
+            if (_scanner.peekToken() == ']') {
+                _scanner.get();
+                return true;
+            }
+            for (size_t i = 0; more; ++i) {
+                if (i % _options.stride == 0) {
+                    path.resize(base);
+                    appendIndex(path, i);
+
+                    _scanner.peekToken();
+                    _offsets[path] = _scanner.offset();
+                    if (!indexValue(path, depth + 1)) {
+                        return false;
+                    }
+                } else if (!_scanner.skipValue()) {
+                    return false;
+                }
+                if (!_scanner.nextItem(']', more)) {
+                    return false;
+                }
+            }
+        }
+
+        path.resize(base);
+        return true;
+    }
+
+private:
+    JsonScanner& _scanner;
+    const JsonIndex::Options& _options;
+    std::unordered_map<std::string, uint64_t>& _offsets;
+};
+
+// Skips `count` items of the array the scanner is in
+bool skipElements(JsonScanner& scanner, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        bool more;
+        if (!scanner.skipValue() || !scanner.nextItem(']', more)) {
+            return false;
+        }
+        if (!more) {
+            return scanner.fail("Index is out of range");
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+
+bool JsonIndex::fileStamp(const std::string& jsonPath, uint64_t& size, int64_t& mtime) {
+    std::error_code ec;
+    size = std::filesystem::file_size(jsonPath, ec);
+    if (ec) {
+        return false;
+    }
+    auto time = std::filesystem::last_write_time(jsonPath, ec);
+    if (ec) {
+        return false;
+    }
+    mtime = time.time_since_epoch().count();
+    return true;
+}
+
+JsonResult<JsonIndex> JsonIndex::Build(const std::string& jsonPath, const Options& options) {
+    JsonIndex index;
+    index._options = options;
+    if (index._options.stride == 0) {
+        index._options.stride = 1;
+    }
+
+    if (!fileStamp(jsonPath, index._fileSize, index._fileTime)) {
+        return JsonError{ "Could not stat file " + jsonPath };
+    }
+
+    std::ifstream file(jsonPath, std::ios::binary);
+    if (!file.is_open()) {
+        return JsonError{ "Could not open file " + jsonPath };
+    }
+
+    JsonScanner scanner(file);
+    scanner.peekToken();
+    index._offsets[""] = scanner.offset();
+
+    std::string path;
+    IndexBuilder builder(scanner, index._options, index._offsets);
+    if (!builder.indexValue(path, 0)) {
+        return scanner.error();
+    }
+
+    JSON_STATS_ADD(bytesRead, scanner.offset());
+
+    return index;
+}
+
+JsonResult<JsonIndex> JsonIndex::Load(const std::string& jsonPath) {
+    std::ifstream in(SidecarPath(jsonPath), std::ios::binary);
+    if (!in.is_open()) {
+        return JsonError{ "No index for " + jsonPath };
+    }
+
+    JsonIndex index;
+
+    std::string magic;
+    int version = 0;
+    size_t count = 0;
+    in >> magic >> version >> index._fileSize >> index._fileTime
+       >> index._options.stride >> index._options.depth >> count;
+    if (!in || magic != s_magic || version != s_version || index._options.stride == 0) {
+        return JsonError{ "Invalid index file " + SidecarPath(jsonPath) };
+    }
+
+    uint64_t size;
+    int64_t mtime;
+    if (!fileStamp(jsonPath, size, mtime) || size != index._fileSize || mtime != index._fileTime) {
+        return JsonError{ "Index is out of date for " + jsonPath };
+    }
+
+    // <offset> <path length> <path>
+    index._offsets.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t offset;
+        size_t length;
+        in >> offset >> length;
+        in.get();
+
+        std::string path(length, '\0');
+        in.read(path.data(), length);
+        if (!in) {
+            return JsonError{ "Truncated index file " + SidecarPath(jsonPath) };
+        }
+        index._offsets.emplace(std::move(path), offset);
+    }
+
+    return index;
+}
+
+bool JsonIndex::Save(const std::string& jsonPath) const {
+    std::ofstream out(SidecarPath(jsonPath), std::ios::binary | std::ios::trunc);
+    if (!out.is_open()) {
+        return false;
+    }
+
+    out << s_magic << ' ' << s_version << ' ' << _fileSize << ' ' << _fileTime << ' '
+        << _options.stride << ' ' << _options.depth << ' ' << _offsets.size() << '\n';
+    for (const auto& [path, offset] : _offsets) {
+        out << offset << ' ' << path.size() << ' ' << path << '\n';
+    }
+
+    return bool(out);
+}
+
+JsonResult<std::shared_ptr<JsonValue>> JsonIndex::Query(std::istream& file, std::string_view expression) const {
+    auto segments = JsonLiteralPath::Split(expression);
+    if (!segments) {
+        return segments.error();
+    }
+
+    // Canonical form of every prefix of the path
+    std::vector<std::string> prefixes(1);
+    for (const JsonPathSegment& segment : *segments) {
+        std::string prefix = prefixes.back();
+        if (segment.isIndex) {
+            appendIndex(prefix, segment.index);
+        } else {
+            appendKey(prefix, segment.key);
+        }
+        prefixes.push_back(std::move(prefix));
+    }
+
+    // Longest indexed prefix; array indices are rounded down to the stride
+    size_t resolved = 0;
+    size_t skip = 0;
+    uint64_t offset = _offsets.at("");
+    for (size_t k = segments->size(); k > 0; --k) {
+        const JsonPathSegment& last = (*segments)[k - 1];
+        std::string path = prefixes[k];
+        size_t rest = 0;
+        if (last.isIndex) {
+            rest = last.index % _options.stride;
+            path = prefixes[k - 1];
+            appendIndex(path, last.index - rest);
+        }
+        auto it = _offsets.find(path);
+        if (it != _offsets.end()) {
+            resolved = k;
+            skip = rest;
+            offset = it->second;
+            break;
+        }
+    }
+
+    file.clear();
+    file.seekg(offset);
+    JsonScanner scanner(file, offset);
+    uint64_t start = offset;
+
+    if (!skipElements(scanner, skip)) {
+        return JsonError{ scanner.error().message, (*segments)[resolved - 1].position };
+    }
+
+    // Walk the rest of the path without building nodes
+    for (size_t k = resolved; k < segments->size(); ++k) {
+        const JsonPathSegment& segment = (*segments)[k];
+        bool more = true;
+
+        if (segment.isIndex) {
+            if (scanner.peekToken() != '[') {
+                return JsonError{ "Token preceding '[' must be a JSON array.", segment.position };
+            }
+            scanner.get();
+            if (scanner.peekToken() == ']' || !skipElements(scanner, segment.index)) {
+                return JsonError{ "Index '" + std::to_string(segment.index) + "' is out of range.", segment.position };
+            }
+            continue;
+        }
+
+        if (scanner.peekToken() != '{') {
+            return JsonError{ "Token preceding '.' must be a JSON object.", segment.position };
+        }
+        scanner.get();
+        more = scanner.peekToken() != '}';
+
+        std::string key;
+        bool found = false;
+        while (more && !found) {
+            if (!scanner.readString(key) || !scanner.expect(':')) {
+                return scanner.error();
+            }
+            if (key == segment.key) {
+                found = true;
+            } else if (!scanner.skipValue() || !scanner.nextItem('}', more)) {
+                return scanner.error();
+            }
+        }
+        if (!found) {
+            return JsonError{ "Key \"" + segment.key + "\" was not found in parent object.", segment.position };
+        }
+    }
+
+    scanner.peekToken();
+    offset = scanner.offset();
+
+    JSON_STATS_ADD(bytesRead, offset - start);
+
+    file.clear();
+    file.seekg(offset);
+
+    JsonParser parser;
+    return parser.TryParseValue(file);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
+
+#include "json_types.h"
+#include "json_result.h"
+
+/*
+ * Sidecar offset index for random access into large JSON files.
+ *
+ * The index maps object members and every `stride`-th array element, down to
+ * `depth` path levels, to the byte offset of their value in the file. A query
+ * for a literal path such as "a.b[5000000].c" seeks to the nearest indexed
+ * prefix, skips forward with JsonScanner and parses only the requested value.
+ *
+ * The sidecar is stored next to the JSON file (<file>.idx) and is only used
+ * while the file's size and modification time match the ones it was built for.
+ */
+class JsonIndex {
+public:
+    struct Options {
+        size_t stride = 1000; // index every stride-th array element
+        int depth = 3;        // number of path levels to index
+    };
+
+    // Builds the index of `jsonPath` in a single streaming pass
+    static JsonResult<JsonIndex> Build(const std::string& jsonPath, const Options& options);
+
+    // Loads the sidecar of `jsonPath`, failing if it is missing or stale
+    static JsonResult<JsonIndex> Load(const std::string& jsonPath);
+
+    bool Save(const std::string& jsonPath) const;
+
+    static std::string SidecarPath(const std::string& jsonPath) {
+        return jsonPath + ".idx";
+    }
+
+    // Evaluates a path made of keys and integer indices against `file`,
+    // parsing only the addressed value
+    JsonResult<std::shared_ptr<JsonValue>> Query(std::istream& file, std::string_view expression) const;
+
+    size_t size() const {
+        return _offsets.size();
+    }
+
+private:
+    static bool fileStamp(const std::string& jsonPath, uint64_t& size, int64_t& mtime);
+
+    Options _options;
+
+    uint64_t _fileSize = 0;
+    int64_t _fileTime = 0;
+
+    // Canonical path ("a.b[1000]", "" for the root, '\' before '.', '[', ']'
+    // and '\' in keys) -> offset of its value
+    std::unordered_map<std::string, uint64_t> _offsets;
+};
@@ -0,0 +1,63 @@
+#include "json_intern.h"
+#include "json_hash.h"
+#include "json_memory.h"
+
+
+std::shared_ptr<JsonValue> JsonInternTable::String(JsonString&& str) {
+    Shard& s = shard(std::hash<std::string_view>()(str.value()));
+    std::lock_guard<std::mutex> lock(s.mutex);
+    ++s.stats.strings;
+
+    auto it = s.strings.find(str.value());
+    if (it != s.strings.end()) {
+        ++s.stats.stringHits;
+        s.stats.bytesSaved += JsonMemory::OwnBytes(str, true);
+        return it->second;
+    }
+
+    auto node = std::make_shared<JsonString>(std::move(str));
+    s.strings.emplace(node->value(), node);
+    return node;
+}
+
+std::shared_ptr<JsonValue> JsonInternTable::Container(std::shared_ptr<JsonValue> node, uint64_t hash) {
+    Shard& s = shard(hash);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    ++s.stats.containers;
+
+    auto [first, last] = s.containers.equal_range(hash);
+    for (auto it = first; it != last; ++it) {
+        // Not just equal hashes: a false match would silently replace a value
+        if (JsonHash::Identical(*it->second, *node)) {
+            ++s.stats.containerHits;
+            s.stats.bytesSaved += JsonMemory::OwnBytes(*node);
+            return it->second;
+        }
+    }
+
+    s.containers.emplace(hash, node);
+    return node;
+}
+
+JsonInternTable::Stats JsonInternTable::stats() const {
+    Stats total;
+    for (const Shard& s : _shards) {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        total.strings += s.stats.strings;
+        total.stringHits += s.stats.stringHits;
+        total.containers += s.stats.containers;
+        total.containerHits += s.stats.containerHits;
+        total.bytesSaved += s.stats.bytesSaved;
+    }
+    return total;
+}
+
+void JsonInternTable::Print(const Stats& stats, std::ostream& os) {
+    uint64_t lookups = stats.strings + stats.containers;
+    uint64_t kept = lookups - stats.stringHits - stats.containerHits;
+
+    os << "{\"strings\": {\"count\": " << stats.strings << ", \"shared\": " << stats.stringHits << "}"
+       << ", \"containers\": {\"count\": " << stats.containers << ", \"shared\": " << stats.containerHits << "}"
+       << ", \"ratio\": " << (kept ? double(lookups) / double(kept) : 1.0)
+       << ", \"bytes_saved\": " << stats.bytesSaved << "}" << std::endl;
+}
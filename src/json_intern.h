@@ -0,0 +1,80 @@
+#pragma once
+
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <cstdint>
+
+#include "json_types.h"
+
+/*
+ * Hash-consing of parsed values (JsonParser::SetInternTable).
+ *
+ * String values too long to be stored inline and small containers are looked
+ * up by content, and a repeat reuses the node kept for the first occurrence
+ * instead of allocating its own. A container only qualifies if all its
+ * children are inline or interned themselves, so equal subtrees end up as one
+ * node from the leaves up.
+ *
+ * Interned nodes are immutable and owned by the table, not by a parser's
+ * memory resource, so a table may outlive the trees using it and be shared
+ * by parsers on several threads. Lookups take the lock of one of Shards
+ * shards. Nothing is ever evicted.
+ */
+class JsonInternTable {
+public:
+    struct Options {
+        size_t minStringLength = 16;  // shorter strings stay inline in their slot
+        size_t maxContainerSize = 16; // members or elements of an interned container
+    };
+
+    struct Stats {
+        uint64_t strings = 0;    // string values looked up
+        uint64_t stringHits = 0; // ... that reused a node
+        uint64_t containers = 0;
+        uint64_t containerHits = 0;
+        uint64_t bytesSaved = 0; // estimated as in JsonMemory
+    };
+
+    JsonInternTable() = default;
+
+    JsonInternTable(const Options& options)
+        : _options(options) {}
+
+    // The node for a string value, shared with all its earlier occurrences
+    std::shared_ptr<JsonValue> String(JsonString&& str);
+
+    // An earlier container equal to `node` if there is one, otherwise `node`,
+    // which is kept from now on. `hash` is JsonHash::Of(*node).
+    std::shared_ptr<JsonValue> Container(std::shared_ptr<JsonValue> node, uint64_t hash);
+
+    const Options& options() const {
+        return _options;
+    }
+
+    Stats stats() const;
+
+    // {"strings": ..., "ratio": ..., "bytes_saved": ...}; the ratio is values
+    // looked up per node kept
+    static void Print(const Stats& stats, std::ostream& os);
+
+    static constexpr size_t Shards = 64;
+
+private:
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string_view, std::shared_ptr<JsonString>> strings; // keys view the nodes
+        std::unordered_multimap<uint64_t, std::shared_ptr<JsonValue>> containers;
+        Stats stats;
+    };
+
+    Shard& shard(uint64_t hash) {
+        return _shards[(hash >> 32) % Shards];
+    }
+
+    Options _options;
+
+    Shard _shards[Shards];
+};
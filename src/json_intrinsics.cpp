@@ -0,0 +1,325 @@
+#include "json_intrinsics.h"
+#include "json_hash.h"
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <unordered_set>
+
+namespace {
+
+struct NumberKey {
+    double key;
+    uint32_t position;
+};
+
+struct StringKey {
+    std::string_view key;
+    uint32_t position;
+};
+
+// Total orders: equal keys are ordered by position, which makes the
+// unstable standard algorithms behave stably
+template <typename Key>
+bool ascending(const Key& a, const Key& b) {
+    return a.key < b.key || (a.key == b.key && a.position < b.position);
+}
+
+template <typename Key>
+bool descending(const Key& a, const Key& b) {
+    return b.key < a.key || (a.key == b.key && a.position < b.position);
+}
+
+size_t threadCount(size_t size) {
+    size_t threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+    return std::max<size_t>(1, std::min(threads, size / JsonIntrinsics::ParallelThreshold));
+}
+
+// Calls fn(chunk, begin, end) for `chunks` equal parts of [0, size), one thread each
+template <typename Fn>
+void forEachChunk(size_t size, size_t chunks, Fn&& fn) {
+    std::vector<std::thread> workers;
+    for (size_t c = 1; c < chunks; ++c) {
+        workers.emplace_back([&, c] { fn(c, size * c / chunks, size * (c + 1) / chunks); });
+    }
+    fn(0, 0, size / chunks);
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+// Sorts the chunks in parallel, then merges pairs of sorted runs in parallel
+// rounds until one run is left
+template <typename Key>
+void parallelSort(std::vector<Key>& keys) {
+    size_t chunks = threadCount(keys.size());
+    std::vector<size_t> bounds(chunks + 1);
+    for (size_t c = 0; c <= chunks; ++c) {
+        bounds[c] = keys.size() * c / chunks;
+    }
+
+    forEachChunk(keys.size(), chunks, [&](size_t c, size_t, size_t) {
+        std::sort(keys.begin() + bounds[c], keys.begin() + bounds[c + 1], ascending<Key>);
+    });
+    if (chunks == 1) {
+        return;
+    }
+
+    std::vector<Key> buffer(keys.size());
+    while (bounds.size() > 2) {
+        size_t runs = bounds.size() - 1;
+        size_t pairs = (runs + 1) / 2;
+
+        std::vector<std::thread> workers;
+        for (size_t p = 0; p < pairs; ++p) {
+            size_t first = bounds[2 * p];
+            size_t middle = bounds[std::min(2 * p + 1, runs)];
+            size_t last = bounds[std::min(2 * p + 2, runs)];
+            workers.emplace_back([&, first, middle, last] {
+                std::merge(keys.begin() + first, keys.begin() + middle,
+                           keys.begin() + middle, keys.begin() + last,
+                           buffer.begin() + first, ascending<Key>);
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+
+        std::vector<size_t> merged;
+        for (size_t i = 0; i < bounds.size(); i += 2) {
+            merged.push_back(bounds[i]);
+        }
+        if (merged.back() != keys.size()) {
+            merged.push_back(keys.size());
+        }
+        bounds = std::move(merged);
+        keys.swap(buffer);
+    }
+}
+
+// Each chunk moves its k best keys to the front; the best of those candidates win
+template <typename Key>
+void parallelTopK(std::vector<Key>& keys, size_t k) {
+    size_t chunks = threadCount(keys.size());
+    std::vector<std::vector<Key>> candidates(chunks);
+
+    forEachChunk(keys.size(), chunks, [&](size_t c, size_t begin, size_t end) {
+        auto first = keys.begin() + begin;
+        auto last = keys.begin() + end;
+        if (size_t(last - first) > k) {
+            std::nth_element(first, first + k, last, descending<Key>);
+            last = first + k;
+        }
+        candidates[c].assign(first, last);
+    });
+
+    keys.clear();
+    for (auto& chunk : candidates) {
+        keys.insert(keys.end(), chunk.begin(), chunk.end());
+    }
+    k = std::min(k, keys.size());
+    std::partial_sort(keys.begin(), keys.begin() + k, keys.end(), descending<Key>);
+    keys.resize(k);
+}
+
+template <typename Key>
+JsonIntrinsics::Positions positionsOf(const std::vector<Key>& keys) {
+    JsonIntrinsics::Positions positions(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        positions[i] = keys[i].position;
+    }
+    return positions;
+}
+
+// Unboxed keys of values that must be all numbers or all strings
+struct Keys {
+    std::vector<NumberKey> numbers;
+    std::vector<StringKey> strings;
+};
+
+JsonResult<Keys> extractKeys(const std::vector<const JsonValue*>& values) {
+    Keys keys;
+    if (values.empty()) {
+        return keys;
+    }
+    if (values.size() > UINT32_MAX) {
+        return JsonError{ "Array is too large." };
+    }
+
+    JsonType type = values[0]->type();
+    if (type == JsonType::Number) {
+        keys.numbers.resize(values.size());
+    } else if (type == JsonType::String) {
+        keys.strings.resize(values.size());
+    } else {
+        return JsonError{ "Expected an array of numbers or of strings." };
+    }
+
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (values[i]->type() != type) {
+            return JsonError{ "Expected an array of numbers or of strings." };
+        }
+        if (type == JsonType::Number) {
+            keys.numbers[i] = { static_cast<const JsonNumber*>(values[i])->value(), uint32_t(i) };
+        } else {
+            keys.strings[i] = { static_cast<const JsonString*>(values[i])->value(), uint32_t(i) };
+        }
+    }
+    return keys;
+}
+
+template <typename T>
+void fillKeys(const JsonVector<T>& numbers, std::vector<NumberKey>& keys) {
+    keys.resize(numbers.size());
+    uint32_t i = 0;
+    for (T number : numbers) {
+        keys[i] = { double(number), i };
+        ++i;
+    }
+}
+
+JsonResult<std::vector<NumberKey>> packedKeys(const JsonArray& array) {
+    if (array.size() > UINT32_MAX) {
+        return JsonError{ "Array is too large." };
+    }
+    std::vector<NumberKey> keys;
+    if (auto integers = array.integers()) {
+        fillKeys(*integers, keys);
+    } else if (auto doubles = array.doubles()) {
+        fillKeys(*doubles, keys);
+    } else {
+        return JsonError{ "Expected a packed array of numbers." };
+    }
+    return keys;
+}
+
+template <typename T>
+JsonIntrinsics::Positions distinctNumbers(const JsonVector<T>& numbers) {
+    std::unordered_set<T> seen;
+    JsonIntrinsics::Positions positions;
+    uint32_t i = 0;
+    for (T number : numbers) {
+        // + 0 folds -0 into 0
+        if (seen.insert(number + 0).second) {
+            positions.push_back(i);
+        }
+        ++i;
+    }
+    return positions;
+}
+
+} // namespace
+
+
+JsonResult<JsonIntrinsics::Positions> JsonIntrinsics::TopK(const Items& items, size_t k) {
+    auto keys = extractKeys(items);
+    if (!keys) {
+        return keys.error();
+    }
+    if (!keys->numbers.empty()) {
+        parallelTopK(keys->numbers, k);
+        return positionsOf(keys->numbers);
+    }
+    parallelTopK(keys->strings, k);
+    return positionsOf(keys->strings);
+}
+
+JsonResult<JsonIntrinsics::Positions> JsonIntrinsics::Sort(const Items& items) {
+    auto keys = extractKeys(items);
+    if (!keys) {
+        return keys.error();
+    }
+    if (!keys->numbers.empty()) {
+        parallelSort(keys->numbers);
+        return positionsOf(keys->numbers);
+    }
+    parallelSort(keys->strings);
+    return positionsOf(keys->strings);
+}
+
+JsonResult<JsonIntrinsics::Positions> JsonIntrinsics::SortBy(const Items& items, const std::vector<std::string_view>& field) {
+    Items values(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        const JsonValue* value = items[i];
+        for (std::string_view key : field) {
+            if (value->type() != JsonType::Object) {
+                return JsonError{ "Expected an array of objects." };
+            }
+            value = static_cast<const JsonObject*>(value)->find(key);
+            if (!value) {
+                return JsonError{ "Key \"" + std::string(key) + "\" was not found in parent object." };
+            }
+        }
+        values[i] = value;
+    }
+    return Sort(values);
+}
+
+JsonIntrinsics::Positions JsonIntrinsics::Distinct(const Items& items) {
+    std::unordered_set<double> numbers;
+    std::unordered_set<std::string_view> strings;
+    std::unordered_set<uint64_t> containers; // by structural hash
+    bool seen[2] = {};
+    bool seenNull = false;
+
+    Positions positions;
+    for (size_t i = 0; i < items.size(); ++i) {
+        const JsonValue* value = items[i];
+        bool added = false;
+        switch (value->type()) {
+            case JsonType::Number:
+                // + 0.0 folds -0 into 0
+                added = numbers.insert(static_cast<const JsonNumber*>(value)->value() + 0.0).second;
+                break;
+            case JsonType::String:
+                added = strings.insert(static_cast<const JsonString*>(value)->value()).second;
+                break;
+            case JsonType::Boolean: {
+                bool& flag = seen[static_cast<const JsonBoolean*>(value)->value()];
+                added = !flag;
+                flag = true;
+                break;
+            }
+            case JsonType::Null:
+                added = !seenNull;
+                seenNull = true;
+                break;
+            case JsonType::Object:
+            case JsonType::Array:
+                added = containers.insert(JsonHash::Of(*value)).second;
+                break;
+        }
+        if (added) {
+            positions.push_back(uint32_t(i));
+        }
+    }
+    return positions;
+}
+
+JsonResult<JsonIntrinsics::Positions> JsonIntrinsics::TopK(const JsonArray& numbers, size_t k) {
+    auto keys = packedKeys(numbers);
+    if (!keys) {
+        return keys.error();
+    }
+    parallelTopK(*keys, k);
+    return positionsOf(*keys);
+}
+
+JsonResult<JsonIntrinsics::Positions> JsonIntrinsics::Sort(const JsonArray& numbers) {
+    auto keys = packedKeys(numbers);
+    if (!keys) {
+        return keys.error();
+    }
+    parallelSort(*keys);
+    return positionsOf(*keys);
+}
+
+JsonIntrinsics::Positions JsonIntrinsics::Distinct(const JsonArray& numbers) {
+    if (auto integers = numbers.integers()) {
+        return distinctNumbers(*integers);
+    }
+    if (auto doubles = numbers.doubles()) {
+        return distinctNumbers(*doubles);
+    }
+    return Positions(); // not packed
+}
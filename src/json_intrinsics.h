@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include "json_types.h"
+#include "json_result.h"
+
+/*
+ * Array intrinsics of JsonEval: topk, sort, distinct and sortby.
+ *
+ * They take the values to work on as borrowed pointers and return positions
+ * into that sequence, in result order; building the result is left to the
+ * caller. Ordering works on unboxed keys, (double, position) or (string_view,
+ * position), extracted once up front, so no comparison touches a node.
+ * Selection and sorting split large inputs across hardware threads.
+ */
+class JsonIntrinsics {
+public:
+    using Items = std::vector<const JsonValue*>;
+    using Positions = std::vector<uint32_t>;
+
+    // The k largest values, largest first. Values must be all numbers or all
+    // strings; equal values keep their input order.
+    static JsonResult<Positions> TopK(const Items& items, size_t k);
+
+    // Ascending, stable
+    static JsonResult<Positions> Sort(const Items& items);
+
+    // Objects in ascending order of the value at `field` (a key path)
+    static JsonResult<Positions> SortBy(const Items& items, const std::vector<std::string_view>& field);
+
+    // First occurrence of every distinct value, in input order
+    static Positions Distinct(const Items& items);
+
+    // The same for the elements of a packed array (JsonArray::isPacked()),
+    // with the keys read straight from its buffer
+    static JsonResult<Positions> TopK(const JsonArray& numbers, size_t k);
+    static JsonResult<Positions> Sort(const JsonArray& numbers);
+    static Positions Distinct(const JsonArray& numbers);
+
+    // Inputs below this size are processed on the calling thread only
+    static constexpr size_t ParallelThreshold = 1 << 16;
+};
@@ -0,0 +1,416 @@
+#include "json_lines.h"
+#include "json_parser.h"
+#include "json_eval.h"
+#include "json_stats.h"
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <semaphore>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Read-only stream buffer over memory owned by someone else, so that records
+// can be parsed in place without copying them into a stringstream.
+class MemoryBuffer : public std::streambuf {
+public:
+    MemoryBuffer(const char* begin, const char* end) {
+        setg(const_cast<char*>(begin), const_cast<char*>(begin), const_cast<char*>(end));
+    }
+};
+
+// A line-aligned slice of the input together with its results.
+struct Chunk {
+    size_t seq = 0;
+    size_t firstLine = 1;
+
+    std::string data;
+
+    std::ostringstream output;
+    std::ostringstream errors;
+    size_t failed = 0;
+};
+
+// Blocks Follow() until the file may have grown or Stop() was called. With
+// inotify the thread sleeps until the kernel reports a write; without it, it
+// wakes up every poll interval.
+class FileWatch {
+public:
+    FileWatch(const std::string& path, std::atomic<int>& wakeFd, unsigned pollInterval)
+        : _wakeFd(wakeFd), _pollInterval(pollInterval)
+    {
+#if defined(__linux__)
+        int fds[2];
+        if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0) {
+            _wakeRead = fds[0];
+            _wakeWrite = fds[1];
+            _wakeFd = _wakeWrite;
+        }
+        _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (_inotify >= 0 && inotify_add_watch(_inotify, path.c_str(), IN_MODIFY) < 0) {
+            close(_inotify);
+            _inotify = -1;
+        }
+#else
+        (void)path;
+#endif
+    }
+
+    FileWatch(const FileWatch&) = delete;
+    FileWatch& operator=(const FileWatch&) = delete;
+
+    ~FileWatch() {
+#if defined(__linux__)
+        _wakeFd = -1;
+        for (int fd : { _inotify, _wakeRead, _wakeWrite }) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    void wait() {
+#if defined(__linux__)
+        if (_wakeRead >= 0) {
+            // poll() skips the inotify entry if it is -1
+            pollfd fds[2] = { { _wakeRead, POLLIN, 0 }, { _inotify, POLLIN, 0 } };
+            poll(fds, 2, _inotify >= 0 ? -1 : int(_pollInterval));
+            drain(_wakeRead);
+            drain(_inotify);
+            return;
+        }
+#endif
+        std::this_thread::sleep_for(std::chrono::milliseconds(_pollInterval));
+    }
+
+private:
+#if defined(__linux__)
+    // The events themselves do not matter, the file is read either way
+    static void drain(int fd) {
+        char buffer[4096];
+        while (fd >= 0 && read(fd, buffer, sizeof(buffer)) > 0) {
+        }
+    }
+
+    int _inotify = -1;
+    int _wakeRead = -1;
+    int _wakeWrite = -1;
+#endif
+
+    std::atomic<int>& _wakeFd;
+    unsigned _pollInterval;
+};
+
+} // namespace
+
+
+// `parser` allocates from `arena`, which is released after every record
+static void processChunk(Chunk& chunk, const std::string& expression, JsonParser& parser,
+                         std::pmr::monotonic_buffer_resource& arena)
+{
+    const char* p = chunk.data.data();
+    const char* end = p + chunk.data.size();
+
+    for (size_t line = chunk.firstLine; p < end; ++line) {
+        // Every chunk ends with '\n', so the parser never runs off the end of a record
+        const char* nl = std::find(p, end, '\n');
+        const char* next = nl + 1;
+
+        if (std::all_of(p, nl, [](char ch) { return std::isspace((unsigned char)ch); })) {
+            p = next;
+            continue;
+        }
+
+        std::shared_ptr<JsonValue> record;
+        std::shared_ptr<const JsonValue> result;
+
+        JsonError error;
+        bool failed = false;
+
+        MemoryBuffer buffer(p, next);
+        std::istream in(&buffer);
+
+        {
+            JSON_STATS_PHASE(Parse);
+            auto parsed = parser.TryParseValue(in);
+            if (parsed) {
+                record = std::move(*parsed);
+
+                int ch;
+                while ((ch = in.get()) != std::char_traits<char>::eof()) {
+                    if (!std::isspace(ch)) {
+                        int column = int(next - p) - int(buffer.in_avail());
+                        error = JsonError{ "Unexpected characters after the end of the record", 
+                                           size_t(column - 1), 1, column };
+                        failed = true;
+                        break;
+                    }
+                }
+            } else {
+                error = parsed.error();
+                failed = true;
+            }
+        }
+        if (!failed) {
+            JSON_STATS_PHASE(Eval);
+            JsonEval evaluator(record);
+            auto evaluated = evaluator.TryEvaluateExpression(expression);
+            if (evaluated) {
+                result = std::move(*evaluated);
+            } else {
+                error = evaluated.error();
+                failed = true;
+            }
+        }
+
+        if (!failed) {
+            JSON_STATS_PHASE(Print);
+            chunk.output << *result << '\n';
+        } else {
+            chunk.errors << "[JSON lines] Line " << line << ": " << error.what() << '\n';
+            ++chunk.failed;
+        }
+
+        {
+            JSON_STATS_PHASE(Destroy);
+            // All nodes live in the arena, so they must be gone before it is reset
+            result.reset();
+            record.reset();
+            arena.release();
+        }
+
+        p = next;
+    }
+}
+
+size_t JsonLines::Run(std::istream& in, std::ostream& out, std::ostream& err) {
+    unsigned threads = _options.threads;
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    // Bounds memory to a few chunks per worker regardless of input size
+    const size_t maxInFlight = threads * 2;
+
+    std::mutex queueMutex;
+    std::deque<std::unique_ptr<Chunk>> queue; // nullptr tells a worker to stop
+    std::counting_semaphore<> queued(0);
+    std::counting_semaphore<> freeSlots(maxInFlight);
+
+    std::mutex outMutex;
+    std::map<size_t, std::unique_ptr<Chunk>> pending; // finished out of order
+    size_t nextSeq = 0;
+    size_t failed = 0;
+
+    auto emit = [&](Chunk& chunk) {
+        out << chunk.output.view();
+        err << chunk.errors.view();
+        failed += chunk.failed;
+    };
+
+    auto complete = [&](std::unique_ptr<Chunk> chunk) {
+        size_t written = 0;
+        {
+            std::lock_guard<std::mutex> lock(outMutex);
+            if (!_options.ordered) {
+                emit(*chunk);
+                written = 1;
+            } else {
+                pending[chunk->seq] = std::move(chunk);
+                while (!pending.empty() && pending.begin()->first == nextSeq) {
+                    emit(*pending.begin()->second);
+                    pending.erase(pending.begin());
+                    ++nextSeq;
+                    ++written;
+                }
+            }
+        }
+        if (written) {
+            freeSlots.release(written);
+        }
+    };
+
+    auto worker = [&]() {
+        std::unique_ptr<char[]> initial(new char[_options.arenaSize]);
+        std::pmr::monotonic_buffer_resource arena(initial.get(), _options.arenaSize);
+        JsonParser parser(&arena);
+        parser.SetLimits(_options.limits);
+
+        for (;;) {
+            queued.acquire();
+
+            std::unique_ptr<Chunk> chunk;
+            {
+                std::lock_guard<std::mutex> lock(queueMutex);
+                chunk = std::move(queue.front());
+                queue.pop_front();
+            }
+            if (!chunk) {
+                return;
+            }
+            processChunk(*chunk, _expression, parser, arena);
+            complete(std::move(chunk));
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(worker);
+    }
+
+    std::string carry; // incomplete last line of the previous read
+    size_t seq = 0;
+    size_t line = 1;
+
+    for (bool eof = false; !eof; ) {
+        auto chunk = std::make_unique<Chunk>();
+        chunk->data = std::move(carry);
+        carry.clear();
+
+        size_t old = chunk->data.size();
+        chunk->data.resize(old + _options.chunkSize);
+        in.read(&chunk->data[old], _options.chunkSize);
+        chunk->data.resize(old + in.gcount());
+
+        eof = !in;
+
+        if (!eof) {
+            size_t lastNl = chunk->data.rfind('\n');
+            if (lastNl == std::string::npos) {
+                // Line longer than a chunk, keep reading until it is complete
+                carry = std::move(chunk->data);
+                continue;
+            }
+            carry.assign(chunk->data, lastNl + 1);
+            chunk->data.resize(lastNl + 1);
+        } else if (!chunk->data.empty() && chunk->data.back() != '\n') {
+            chunk->data += '\n';
+        }
+
+        if (chunk->data.empty()) {
+            continue;
+        }
+
+        chunk->seq = seq++;
+        chunk->firstLine = line;
+        line += std::count(chunk->data.begin(), chunk->data.end(), '\n');
+
+        freeSlots.acquire();
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            queue.push_back(std::move(chunk));
+        }
+        queued.release();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        for (unsigned i = 0; i < threads; ++i) {
+            queue.push_back(nullptr);
+        }
+    }
+    queued.release(threads);
+
+    for (auto& t : workers) {
+        t.join();
+    }
+
+    out.flush();
+
+    return failed;
+}
+
+JsonResult<size_t> JsonLines::Follow(const std::string& path, std::ostream& out, std::ostream& err) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return JsonError{ "Could not open file " + path };
+    }
+
+    FileWatch watch(path, _wakeFd, _options.pollInterval);
+
+    std::unique_ptr<char[]> initial(new char[_options.arenaSize]);
+    std::pmr::monotonic_buffer_resource arena(initial.get(), _options.arenaSize);
+    JsonParser parser(&arena);
+    parser.SetLimits(_options.limits);
+
+    std::vector<char> block(_options.chunkSize);
+    std::string pending; // read, but not a complete line yet
+    uint64_t offset = 0; // bytes read from the file
+    size_t line = 1;
+    size_t failed = 0;
+
+    for (;;) {
+        // Lines read after Stop() are still evaluated, nothing later is
+        bool stopping = _stopped;
+
+        std::error_code ec;
+        uint64_t size = std::filesystem::file_size(path, ec);
+        if (!ec && size < offset) {
+            // Truncated, e.g. by `> file`: what was read is gone
+            file.clear();
+            file.seekg(0);
+            offset = 0;
+            line = 1;
+            pending.clear();
+        }
+
+        // Reading past the end leaves the stream failed; clear() resumes at the offset
+        file.clear();
+        while (file.read(block.data(), block.size()) || file.gcount() > 0) {
+            pending.append(block.data(), size_t(file.gcount()));
+            offset += uint64_t(file.gcount());
+        }
+        if (file.bad()) {
+            return JsonError{ "Reading " + path + " failed" };
+        }
+
+        size_t lastNl = pending.rfind('\n');
+        if (lastNl != std::string::npos) {
+            Chunk chunk;
+            chunk.firstLine = line;
+            chunk.data.assign(pending, 0, lastNl + 1);
+            pending.erase(0, lastNl + 1);
+            line += std::count(chunk.data.begin(), chunk.data.end(), '\n');
+
+            processChunk(chunk, _expression, parser, arena);
+
+            out << chunk.output.view() << std::flush;
+            err << chunk.errors.view() << std::flush;
+            failed += chunk.failed;
+        }
+
+        if (stopping) {
+            return failed;
+        }
+        watch.wait();
+    }
+}
+
+void JsonLines::Stop() {
+    _stopped = true;
+#if defined(__linux__)
+    // write() is async-signal-safe
+    int fd = _wakeFd;
+    if (fd >= 0) {
+        char byte = 0;
+        ssize_t written = write(fd, &byte, 1);
+        (void)written;
+    }
+#endif
+}
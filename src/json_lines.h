@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <cstddef>
+
+#include "json_parser.h"
+#include "json_result.h"
+
+/*
+ * JSON Lines (NDJSON) driver: every line of the input is an independent
+ * document. The input is split into line-aligned chunks which are parsed
+ * and evaluated on a pool of worker threads; results are written one per
+ * line, either in input order or in completion order.
+ *
+ * Follow() instead tails a file that is still being written, like tail -f.
+ */
+class JsonLines {
+public:
+    struct Options {
+        unsigned threads = 0;              // 0 - one worker per hardware thread
+        bool ordered = true;               // keep results in input order
+        size_t chunkSize = 1 << 20;        // bytes per work item (rounded to whole lines)
+        size_t arenaSize = 256 << 10;      // initial per-worker arena for one record
+        JsonParser::Limits limits;         // applied to every record
+        unsigned pollInterval = 100;       // ms between size checks when following without inotify
+    };
+
+    JsonLines(const std::string& expression)
+        : _expression(expression) {}
+
+    JsonLines(const std::string& expression, const Options& options)
+        : _expression(expression), _options(options) {}
+
+    // Evaluates the expression against every record of `in`, writing results
+    // to `out` and per-record errors to `err`. Returns the number of failed records.
+    size_t Run(std::istream& in, std::ostream& out, std::ostream& err);
+
+    // Evaluates every complete line of the file at `path`, then every line
+    // appended to it, and flushes each batch of results as soon as its lines
+    // are complete. Waits for growth with inotify where available, else by
+    // polling the size; only the new bytes are read. A truncated file is read
+    // again from its start. Records are parsed on the calling thread, all
+    // with one arena. Returns the number of failed records once Stop() is
+    // called, or an error if the file cannot be read.
+    JsonResult<size_t> Follow(const std::string& path, std::ostream& out, std::ostream& err);
+
+    // Makes Follow() return after the lines it has read. Safe to call from
+    // another thread or a signal handler.
+    void Stop();
+
+private:
+    std::string _expression;
+
+    Options _options;
+
+    std::atomic<bool> _stopped = false;
+    std::atomic<int> _wakeFd = -1; // write end of the pipe Follow() waits on
+};
@@ -0,0 +1,181 @@
+#include "json_memory.h"
+
+#include <unordered_set>
+
+namespace {
+
+const char* s_typeNames[] = { "object", "array", "string", "number", "boolean", "null" };
+
+// A make_shared allocation: control block plus object, rounded up by the allocator
+uint64_t heapNode(uint64_t objectSize) {
+    return (objectSize + 16 + 15) & ~uint64_t(15);
+}
+
+uint64_t heapBuffer(uint64_t size) {
+    return size ? (size + 15) & ~uint64_t(15) : 0;
+}
+
+// Characters that did not fit into the small string buffer
+uint64_t stringPayload(const std::string& str) {
+    static const size_t s_inlineCapacity = std::string().capacity();
+    return str.capacity() > s_inlineCapacity ? heapBuffer(str.capacity() + 1) : 0;
+}
+
+uint64_t stringPayload(const JsonString& str) {
+    size_t size = str.value().size();
+    return size > JsonString::ShortLength ? heapBuffer(size) : 0;
+}
+
+// Hash map storage for `count` members: bucket array plus one node per member,
+// each node holding the next pointer, the key/value pair and the cached hash.
+uint64_t mapStorage(uint64_t count, uint64_t buckets, uint64_t valueSize) {
+    return heapBuffer(buckets * sizeof(void*))
+        + count * heapBuffer(sizeof(void*) + sizeof(std::string) + valueSize + sizeof(size_t));
+}
+
+// Bytes of the node itself, see JsonMemory::OwnBytes
+uint64_t ownBytes(const JsonValue& value, bool isInline) {
+    switch (value.type()) {
+        case JsonType::Object: {
+            const JsonObject& obj = static_cast<const JsonObject&>(value);
+            uint64_t bytes = heapNode(sizeof(JsonObject)) + obj.members().storageBytes(heapNode, heapBuffer);
+            for (const auto& [key, slot] : obj.members()) {
+                bytes += stringPayload(key);
+                if (slot.isInline()) {
+                    bytes += ownBytes(*slot, true);
+                }
+            }
+            return bytes;
+        }
+        case JsonType::Array: {
+            const JsonArray& arr = static_cast<const JsonArray&>(value);
+            uint64_t bytes = heapNode(sizeof(JsonArray)) + arr.storageBytes(heapNode, heapBuffer);
+            if (arr.isPacked()) {
+                return bytes;
+            }
+            for (const JsonSlot& slot : arr.elements()) {
+                if (slot.isInline()) {
+                    bytes += ownBytes(*slot, true);
+                }
+            }
+            return bytes;
+        }
+        case JsonType::String:
+            return (isInline ? 0 : heapNode(sizeof(JsonString))) + stringPayload(static_cast<const JsonString&>(value));
+        case JsonType::Number:
+            return isInline ? 0 : heapNode(sizeof(JsonNumber));
+        case JsonType::Boolean:
+        case JsonType::Null:
+            break;
+    }
+    return 0; // shared instances
+}
+
+struct Measurement {
+    JsonMemory::Report& report;
+    std::unordered_set<const JsonValue*> nodes; // seen so far, for nodes shared by several parents
+};
+
+// References from the parent (a shared_ptr before, a JsonSlot now) are part
+// of the parent's container storage and are charged to the parent. A node
+// reached a second time (JsonInternTable) is counted again, but its compact
+// bytes only once.
+void measure(const JsonValue& value, bool isInline, bool shared, Measurement& m) {
+    JsonMemory::Usage& usage = m.report.types[(int)value.type()];
+    ++usage.count;
+
+    if (!isInline && !shared && (value.type() == JsonType::Object || value.type() == JsonType::Array
+                                 || value.type() == JsonType::String)) {
+        shared = !m.nodes.insert(&value).second;
+    }
+
+    switch (value.type()) {
+        case JsonType::Object: {
+            const JsonObject& obj = static_cast<const JsonObject&>(value);
+            // As a std::unordered_map at load factor 1
+            usage.boxedBytes += heapNode(sizeof(JsonObject))
+                + mapStorage(obj.size(), obj.size(), sizeof(std::shared_ptr<JsonValue>));
+            if (!shared) {
+                usage.compactBytes += heapNode(sizeof(JsonObject)) + obj.members().storageBytes(heapNode, heapBuffer);
+            }
+
+            for (const auto& [key, slot] : obj.members()) {
+                uint64_t keyBytes = stringPayload(key);
+                usage.boxedBytes += keyBytes;
+                usage.compactBytes += shared ? 0 : keyBytes;
+                measure(*slot, slot.isInline(), shared, m);
+            }
+            break;
+        }
+        case JsonType::Array: {
+            const JsonArray& arr = static_cast<const JsonArray&>(value);
+            usage.boxedBytes += heapNode(sizeof(JsonArray))
+                + heapBuffer(arr.size() * sizeof(std::shared_ptr<JsonValue>));
+
+            if (arr.isPacked()) {
+                // 4 or 8 bytes per number, no nodes
+                usage.compactBytes += shared ? 0 : ownBytes(arr, false);
+                JsonMemory::Usage& numbers = m.report.types[(int)JsonType::Number];
+                numbers.count += arr.size();
+                numbers.boxedBytes += arr.size() * heapNode(sizeof(JsonNumber));
+                break;
+            }
+
+            if (!shared) {
+                usage.compactBytes += heapNode(sizeof(JsonArray)) + arr.storageBytes(heapNode, heapBuffer);
+            }
+
+            for (const JsonSlot& slot : arr.elements()) {
+                measure(*slot, slot.isInline(), shared, m);
+            }
+            break;
+        }
+        case JsonType::String:
+            usage.boxedBytes += heapNode(sizeof(JsonString)) + stringPayload(static_cast<const JsonString&>(value));
+            usage.compactBytes += shared ? 0 : ownBytes(value, isInline);
+            break;
+        case JsonType::Number:
+            usage.boxedBytes += heapNode(sizeof(JsonNumber));
+            usage.compactBytes += shared ? 0 : ownBytes(value, isInline);
+            break;
+        case JsonType::Boolean:
+            // Shared instances, nothing but the reference
+            usage.boxedBytes += heapNode(sizeof(JsonBoolean));
+            break;
+        case JsonType::Null:
+            usage.boxedBytes += heapNode(sizeof(JsonNull));
+            break;
+    }
+}
+
+} // namespace
+
+
+JsonMemory::Report JsonMemory::Measure(const JsonValue& root) {
+    Report report;
+    Measurement m{ report, {} };
+    measure(root, false, false, m);
+    return report;
+}
+
+uint64_t JsonMemory::OwnBytes(const JsonValue& value, bool isInline) {
+    return ownBytes(value, isInline);
+}
+
+void JsonMemory::Print(const Report& report, std::ostream& os) {
+    Usage total;
+
+    os << "{\"types\": {";
+    for (int i = 0; i < 6; ++i) {
+        const Usage& usage = report.types[i];
+        os << (i ? ", " : "") << "\"" << s_typeNames[i] << "\": {\"count\": " << usage.count
+           << ", \"boxed_bytes\": " << usage.boxedBytes
+           << ", \"compact_bytes\": " << usage.compactBytes << "}";
+        total.count += usage.count;
+        total.boxedBytes += usage.boxedBytes;
+        total.compactBytes += usage.compactBytes;
+    }
+    os << "}, \"total\": {\"count\": " << total.count
+       << ", \"boxed_bytes\": " << total.boxedBytes
+       << ", \"compact_bytes\": " << total.compactBytes << "}}" << std::endl;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <iostream>
+#include <cstdint>
+
+#include "json_types.h"
+
+/*
+ * Memory accounting for a parsed tree (the --memory flag).
+ *
+ * For every node type it estimates the bytes actually used by the compact
+ * layout (inline scalars in JsonSlot, packed numeric arrays, shared
+ * null/true/false) next to the bytes the same tree would take with one
+ * make_shared node per value. Nodes referenced from several places (see
+ * JsonInternTable) are counted once per reference but stored once.
+ * Heap blocks are assumed to carry a 16 byte shared_ptr control block and
+ * to be rounded up to 16 bytes, so the figures are estimates, not exact
+ * allocator statistics.
+ */
+class JsonMemory {
+public:
+    struct Usage {
+        uint64_t count = 0;
+        uint64_t boxedBytes = 0;   // one heap node per value
+        uint64_t compactBytes = 0; // current layout
+    };
+
+    struct Report {
+        Usage types[6] = {}; // indexed by JsonType
+    };
+
+    static Report Measure(const JsonValue& root);
+
+    // Compact bytes of one node, stored as a slot's inline value if `isInline`:
+    // its heap block, container storage, keys and inline children, but not
+    // the child nodes it refers to
+    static uint64_t OwnBytes(const JsonValue& value, bool isInline = false);
+
+    static void Print(const Report& report, std::ostream& os);
+};
@@ -1,191 +1,375 @@
 #include "json_parser.h"
+#include "json_hash.h"
+#include "json_stats.h"
+#include "json_utf8.h"
 #include <cassert>
+#include <charconv>
 #include <stdexcept>
 
-int JsonValue::s_LogDepth = 0;
+thread_local int JsonValue::s_LogDepth = 0;
 
 
-std::shared_ptr<JsonValue> JsonParser::Parse(std::ifstream& file) {
-    nextCharSkipWS(file);
+JsonResult<std::shared_ptr<JsonValue>> JsonParser::TryParse(std::istream& file) {
+    reset();
+    if (!nextCharSkipWS(file)) {
+        return _error;
+    }
 
     if (_ch != '{') {
-        throwRuntimeError("The root of JSON file must be an object");
+        fail("The root of JSON file must be an object");
+        return _error;
     }
 
-    return parseValue(file);
+    JsonSlot root;
+    bool ok = parseValue(file, root);
+    return result(ok, root);
 }
 
-std::shared_ptr<JsonValue> JsonParser::parseValue(std::ifstream& file) {
-    switch (_ch) {
-        case '{':
-            return std::make_shared<JsonObject>(parseObject(file));
-        case '[':
-            return std::make_shared<JsonArray>(parseArray(file));
-        case '"':
-            return std::make_shared<JsonString>(parseString(file));
-        case 't':
-        case 'f':
-            return std::make_shared<JsonBoolean>(parseBoolean(file));
-            break;
-        case 'n': 
-            return std::make_shared<JsonNull>(parseNull(file));
-            break;
+JsonResult<std::shared_ptr<JsonValue>> JsonParser::TryParseValue(std::istream& file) {
+    reset();
+    if (!nextCharSkipWS(file)) {
+        return _error;
     }
 
-    return std::make_shared<JsonNumber>(parseNumber(file));
+    JsonSlot root;
+    bool ok = parseValue(file, root);
+    return result(ok, root);
 }
 
-JsonObject JsonParser::parseObject(std::ifstream& file) {
-    JsonObject obj;
-    
-    nextCharSkipWS(file); // Skip ws and read first char after '{'
-    while (_ch != '}') {
-        
-        JsonString key = parseString(file);
-        if (key.empty()) {
-            // still need to parse to catch json format errors. :(  
+std::shared_ptr<JsonValue> JsonParser::Parse(std::istream& file) {
+    auto root = TryParse(file);
+    if (!root) {
+        throw std::runtime_error(root.error().what());
+    }
+    return *root;
+}
+
+std::shared_ptr<JsonValue> JsonParser::ParseValue(std::istream& file) {
+    auto value = TryParseValue(file);
+    if (!value) {
+        throw std::runtime_error(value.error().what());
+    }
+    return *value;
+}
+
+JsonResult<std::shared_ptr<JsonValue>> JsonParser::result(bool ok, const JsonSlot& value) {
+    JSON_STATS_ADD(bytesRead, _bytesRead);
+
+    // A failed parse leaves its open containers behind. Their nodes may live
+    // in a resource the caller releases before the next parse.
+    _stack.clear();
+
+    if (!ok) {
+        return _error;
+    }
+    return value.share();
+}
+
+bool JsonParser::parseValue(std::istream& file, JsonSlot& slot) {
+    for (;;) {
+        // _ch is the first char of a value
+        JsonSlot value;
+        bool complete = true;
+        bool shared = true; // inline, a shared literal or interned
+
+        if (_ch == '{' || _ch == '[') {
+            if (_stack.size() >= _limits.maxDepth) {
+                return fail("Nesting exceeds the maximum depth of " + std::to_string(_limits.maxDepth));
+            }
+            bool isObject = _ch == '{';
+            if (isObject) {
+                JSON_STATS_NODE(Object);
+            } else {
+                JSON_STATS_NODE(Array);
+            }
+            _stack.emplace_back();
+            Frame& frame = _stack.back();
+            frame.isObject = isObject;
+
+            if (!nextCharSkipWS(file)) { // Skip ws and read first char after '{' or '['
+                return false;
+            }
+            if (_ch == (isObject ? '}' : ']')) {
+                value = closeContainer(frame, shared);
+                _stack.pop_back();
+            } else {
+                if (isObject && !parseMemberKey(file, frame)) {
+                    return false;
+                }
+                complete = false;
+            }
+        } else if (!parseScalar(file, value)) {
+            return false;
         }
-        nextCharSkipWS(file);
-        if (_ch != ':') {
-            throwRuntimeError("Invalid object format");
+
+        // Hand completed values to their parents, closing every container that ends here
+        while (complete) {
+            if (_stack.empty()) {
+                slot = std::move(value);
+                return true;
+            }
+
+            Frame& frame = _stack.back();
+            frame.internable = frame.internable && shared;
+            if (!frame.isObject) {
+                frame.array.add(std::move(value));
+            } else if (!frame.key.empty()) {
+                frame.object.add(frame.key, std::move(value));
+            }
+
+            if (!nextCharSkipWS(file)) {
+                return false;
+            }
+            if (_ch == (frame.isObject ? '}' : ']')) {
+                value = closeContainer(frame, shared);
+                _stack.pop_back();
+                continue;
+            }
+            if (_ch != ',') {
+                return fail(frame.isObject ? "Missing comma between members" : "Missing comma between elements");
+            }
+            if (!nextCharSkipWS(file)) { // first char of the next member or element
+                return false;
+            }
+            if (frame.isObject && !parseMemberKey(file, frame)) {
+                return false;
+            }
+            complete = false;
         }
-        nextCharSkipWS(file);
-        auto value = parseValue(file);
+    }
+}
 
-        if (!key.empty()) {
-            obj.add(key, value);
+bool JsonParser::parseMemberKey(std::istream& file, Frame& frame) {
+    frame.key.clear();
+    if (!parseString(file, frame.key)) {
+        return false;
+    }
+    JSON_STATS_ADD(keysAllocated, 1);
+
+    if (!nextCharSkipWS(file)) {
+        return false;
+    }
+    if (_ch != ':') {
+        return fail("Invalid object format");
+    }
+    return nextCharSkipWS(file);
+}
+
+JsonSlot JsonParser::closeContainer(Frame& frame, bool& interned) {
+    size_t size = frame.isObject ? frame.object.size() : frame.array.size();
+    interned = _intern && frame.internable && size <= _intern->options().maxContainerSize;
+
+    if (interned) {
+        // Kept by the table, so not allocated from _resource
+        uint64_t hash;
+        std::shared_ptr<JsonValue> node;
+        if (frame.isObject) {
+            hash = JsonHash::Compute(frame.object);
+            frame.object.setHash(hash);
+            node = std::make_shared<JsonObject>(std::move(frame.object));
+        } else {
+            hash = JsonHash::Compute(frame.array);
+            frame.array.setHash(hash);
+            node = std::make_shared<JsonArray>(std::move(frame.array));
         }
+        return JsonSlot(_intern->Container(std::move(node), hash));
+    }
 
-        nextCharSkipWS(file);
-        if (_ch != ',' && _ch != '}') {
-            throwRuntimeError("Missing comma between members");
+    if (frame.isObject) {
+        if (_hashing) {
+            frame.object.setHash(JsonHash::Compute(frame.object));
         }
+        return JsonSlot(makeNode<JsonObject>(std::move(frame.object)));
+    }
+    if (_hashing) {
+        frame.array.setHash(JsonHash::Compute(frame.array));
     }
-    // Invariant: _ch == '}'
-    return obj;
+    return JsonSlot(makeNode<JsonArray>(std::move(frame.array)));
 }
 
-JsonArray JsonParser::parseArray(std::ifstream& file) {
-    JsonArray arr;
-    
-    while (_ch != ']') {
-        nextCharSkipWS(file);
-        arr.add(parseValue(file));
-        nextCharSkipWS(file);
-        if (_ch != ',' && _ch != ']') {
-            throwRuntimeError("Missing comma between elements");
+bool JsonParser::parseScalar(std::istream& file, JsonSlot& slot) {
+    switch (_ch) {
+        case '"': {
+            JSON_STATS_NODE(String);
+            _text.clear();
+            if (!parseString(file, _text)) {
+                return false;
+            }
+            JsonString str(_text);
+            if (_intern && _text.size() >= _intern->options().minStringLength) {
+                slot = _intern->String(std::move(str));
+            } else {
+                // Short text is stored in the slot itself
+                if (_text.size() > JsonString::ShortLength) {
+                    JSON_STATS_ADD(stringsAllocated, 1);
+                }
+                slot = std::move(str);
+            }
+            return true;
         }
+        case 't':
+        case 'f': {
+            JSON_STATS_NODE(Boolean);
+            bool value;
+            if (!parseBoolean(file, value)) {
+                return false;
+            }
+            slot = value ? JsonBoolean::True() : JsonBoolean::False();
+            return true;
+        }
+        case 'n':
+            JSON_STATS_NODE(Null);
+            if (!parseNull(file)) {
+                return false;
+            }
+            slot = JsonNull::Instance();
+            return true;
+    }
+
+    JSON_STATS_NODE(Number);
+    JsonNumber number(0);
+    if (!parseNumber(file, number)) {
+        return false;
     }
-    return arr;
+    slot = number;
+    return true;
 }
 
-JsonNumber JsonParser::parseNumber(std::ifstream& file) {
+bool JsonParser::parseNumber(std::istream& file, JsonNumber& number) {
     std::string numberStr;
 
     // Handle optional negative sign
     if (_ch == '-') {
         numberStr += _ch;
-        nextChar(file);
+        if (!nextChar(file)) {
+            return false;
+        }
     }
 
     // Parse integer part
     while (std::isdigit(_ch)) {
         numberStr += _ch;
-        nextChar(file);
+        if (!nextChar(file)) {
+            return false;
+        }
     }
 
     // Parse fractional part
     if (_ch == '.') {
         numberStr += _ch;
-        nextChar(file);
+        if (!nextChar(file)) {
+            return false;
+        }
         while (std::isdigit(_ch)) {
             numberStr += _ch;
-            nextChar(file);
+            if (!nextChar(file)) {
+                return false;
+            }
         }
     }
 
     // Parse exponent part
     if (_ch == 'e' || _ch == 'E') {
         numberStr += _ch;
-        nextChar(file);
+        if (!nextChar(file)) {
+            return false;
+        }
         if (_ch == '+' || _ch == '-') {
             numberStr += _ch;
-            nextChar(file);
+            if (!nextChar(file)) {
+                return false;
+            }
         }
         while (std::isdigit(_ch)) {
             numberStr += _ch;
-            nextChar(file);
+            if (!nextChar(file)) {
+                return false;
+            }
         }
     }
 
-    // Convert the parsed string to a number
-    try {
-        returnChar(file);
+    returnChar(file);
 
-        double doubleRep = std::stod(numberStr);
+    // Convert the parsed string to a number, preferring an exact int representation
+    const char* first = numberStr.data();
+    const char* last = first + numberStr.size();
 
-        try {
-            int intRep = std::stoi(numberStr);
-            return intRep;
-        } catch(...) {
-            return doubleRep;
-        }
-        
-    } catch (const std::exception& e) {
-        throwRuntimeError(e.what());
+    int intRep;
+    auto [intEnd, intErr] = std::from_chars(first, last, intRep);
+    if (intErr == std::errc() && intEnd == last) {
+        number = JsonNumber(intRep);
+        return true;
+    }
+
+    double doubleRep;
+    auto [doubleEnd, doubleErr] = std::from_chars(first, last, doubleRep);
+    if (doubleErr != std::errc() || doubleEnd != last || numberStr.empty()) {
+        return fail("Invalid value '" + (numberStr.empty() ? std::string(1, _ch) : numberStr) + "'");
     }
 
-    throwRuntimeError("Unexpected error in number parsing");
-    return 42.42; /* never reached */
+    number = JsonNumber(doubleRep);
+    return true;
 }
 
-JsonBoolean JsonParser::parseBoolean(std::ifstream& file) {
+bool JsonParser::parseBoolean(std::istream& file, bool& value) {
     std::string boolStr;
     for (int i = 0; std::isalpha(_ch) && i < 5; ++i) {
         boolStr += _ch;
-        nextChar(file);
+        if (!nextChar(file)) {
+            return false;
+        }
     }
+    returnChar(file);
 
     if (boolStr == "true") {
+        value = true;
         return true;
     } else if (boolStr != "false") {
-        throwRuntimeError("Invalid boolean value");
-    } 
-    
-    return false; 
+        return fail("Invalid boolean value");
+    }
+
+    value = false;
+    return true;
 }
 
-JsonNull JsonParser::parseNull(std::ifstream& file) {
-    std::string nullStr;
+bool JsonParser::parseNull(std::istream& file) {
     for (int i = 0; i < 4; ++i) {
         if (_ch != "null"[i]) {
-            throwRuntimeError("Invalid null value");
+            return fail("Invalid null value");
+        }
+        if (!nextChar(file)) {
+            return false;
         }
-        nullStr += _ch;
-        nextChar(file);
     }
+    returnChar(file);
 
-    return JsonNull();
+    return true;
 }
 
 
-JsonString JsonParser::parseString(std::ifstream& file) {
+bool JsonParser::parseString(std::istream& file, std::string& str) {
     
     if (_ch != '"') {
-        throwRuntimeError("String must start with \" sign");
+        return fail("String must start with \" sign");
     }
 
-    JsonString str;
-
-    int state = 0; // 2 - escape, 3 - unicode, -1 - done
+    int state = 0; // 2 - escape, 3 - unicode, 4/5 - "\u" of a low surrogate, -1 - done
 
     int unicode_digits_cnt = 0;
 
-    std::string unicode_hex_string = "";
+    uint32_t unicode_code = 0;
+
+    uint32_t high_surrogate = 0;
     
     while (state != -1) {
 
-        nextChar(file);
+        if (str.size() > _limits.maxStringLength) {
+            return fail("String exceeds the maximum length of " + std::to_string(_limits.maxStringLength) + " bytes");
+        }
+
+        if (!nextChar(file)) {
+            return false;
+        }
 
         switch (state) {
             case 0:
@@ -197,8 +381,8 @@ JsonString JsonParser::parseString(std::ifstream& file) {
                         state = -1; // done
                         break;
                     default:
-                        if (_ch < 0x0020 || _ch > 0x10FFF) {
-                            // Error: invalid char.
+                        if ((unsigned char)_ch < 0x20) {
+                            return fail("Invalid control character in string");
                         }
                         str += _ch;
                         // All good :)
@@ -242,28 +426,53 @@ JsonString JsonParser::parseString(std::ifstream& file) {
                     case 'u':
                         state = 3;
                         break;
+                    default:
+                        return fail(std::string("Invalid escape sequence '\\") + _ch + "'");
                 }
                 break;
-            case 3: // unicode mode
-                if (!std::isxdigit(_ch)) {
-                    throwRuntimeError(std::string("Invalid unicode hex digit \'") + _ch + "\'");
+            case 3: { // unicode mode
+                int digit = JsonUtf8::HexValue((unsigned char)_ch);
+                if (digit < 0) {
+                    return fail(std::string("Invalid unicode hex digit \'") + _ch + "\'");
                 }
-                unicode_hex_string += _ch;
+                unicode_code = unicode_code * 16 + digit;
 
                 ++unicode_digits_cnt;
 
-
                 if (unicode_digits_cnt == 4) {
                     unicode_digits_cnt = 0;
 
-                    char unicode_letter = std::stoi(unicode_hex_string, nullptr, 16);
+                    uint32_t code = unicode_code;
+                    unicode_code = 0;
 
-                    str += unicode_letter;
+                    if (high_surrogate != 0) {
+                        if (!JsonUtf8::IsLowSurrogate(code)) {
+                            return fail("High surrogate must be followed by a low surrogate");
+                        }
+                        code = JsonUtf8::CombineSurrogates(high_surrogate, code);
+                        high_surrogate = 0;
+                    } else if (JsonUtf8::IsHighSurrogate(code)) {
+                        high_surrogate = code;
+                        state = 4;
+                        break;
+                    } else if (JsonUtf8::IsLowSurrogate(code)) {
+                        return fail("Low surrogate without a preceding high surrogate");
+                    }
+
+                    JsonUtf8::Append(str, code);
 
                     state = 0; 
                 }
                 assert(unicode_digits_cnt < 4);
                 
+                break;
+            }
+            case 4: // '\\' of the low surrogate
+            case 5: // 'u' of the low surrogate
+                if (_ch != (state == 4 ? '\\' : 'u')) {
+                    return fail("High surrogate must be followed by a low surrogate");
+                }
+                state = state == 4 ? 5 : 3;
                 break;
             default:
                 assert(false); // should never happen
@@ -271,5 +480,5 @@ JsonString JsonParser::parseString(std::ifstream& file) {
         }
     }
 
-    return str;
+    return true;
 }
@@ -4,47 +4,139 @@
 #include <fstream>
 #include <stdexcept>
 #include <string>
+#include <memory_resource>
+#include <vector>
+#include <cstdint>
 #include <assert.h>
 
 #include "json_types.h"
+#include "json_result.h"
+#include "json_intern.h"
 
 class JsonParser {
 public:
+    // Bounds for untrusted input. Exceeding one fails the parse with an error
+    // instead of exhausting the stack or memory. Parsing itself does not
+    // recurse, but destroying and printing a tree do, so maxDepth should stay
+    // in the thousands.
+    struct Limits {
+        size_t maxDepth = 1024;                // nesting of objects and arrays
+        uint64_t maxDocumentSize = UINT64_MAX; // bytes read
+        size_t maxStringLength = SIZE_MAX;     // bytes after unescaping, keys included
+    };
+
     JsonParser() = default;
 
-    JsonParser(bool verbose) 
+    JsonParser(bool verbose)
         : _verbose(verbose) {}
 
-    std::shared_ptr<JsonValue> Parse(std::ifstream& file);
+    // Nodes (and their shared_ptr control blocks) are allocated from `resource`,
+    // which must outlive every node parsed with it.
+    JsonParser(std::pmr::memory_resource* resource)
+        : _resource(resource) {}
+
+    // Parses a JSON document whose root must be an object. A parser can be
+    // reused: every call starts a new document, with positions and limits
+    // counted from its first byte, and keeps the buffers of the last one.
+    JsonResult<std::shared_ptr<JsonValue>> TryParse(std::istream& file);
+
+    // Parses a single JSON value of any type, e.g. one record of a JSON Lines file.
+    JsonResult<std::shared_ptr<JsonValue>> TryParseValue(std::istream& file);
+
+    // Stores the structural hash (see JsonHash) of every object and array,
+    // computed bottom-up while parsing.
+    void EnableHashing(bool enabled = true) {
+        _hashing = enabled;
+    }
+
+    void SetLimits(const Limits& limits) {
+        _limits = limits;
+    }
+
+    // Shares repeated long strings and small subtrees through `table`, which
+    // may serve several parsers at once. Null turns it off.
+    void SetInternTable(std::shared_ptr<JsonInternTable> table) {
+        _intern = std::move(table);
+    }
+
+    // Throwing wrappers of the above.
+    std::shared_ptr<JsonValue> Parse(std::istream& file);
+
+    std::shared_ptr<JsonValue> ParseValue(std::istream& file);
 
 private:
-    std::shared_ptr<JsonValue> parseValue(std::ifstream& file);
+    template <typename T, typename... Args>
+    std::shared_ptr<JsonValue> makeNode(Args&&... args) {
+        if (_resource) {
+            return std::allocate_shared<T>(std::pmr::polymorphic_allocator<T>(_resource),
+                std::forward<Args>(args)...);
+        }
+        return std::make_shared<T>(std::forward<Args>(args)...);
+    }
+
+    // An object or array being filled, one per level of nesting
+    struct Frame {
+        bool isObject;
+        JsonObject object;
+        JsonArray array;
+        std::string key; // of the member whose value is being parsed
+        bool internable = true; // every child so far is inline or interned
+    };
+
+    // All parse functions return false after recording the error with fail().
+    // Numbers and strings are stored inline in the slot, null and booleans 
+    // share immutable instances.
+    // Nesting is tracked on _stack rather than by recursion, so the depth of
+    // the input does not touch the native stack. result() empties it again.
+    bool parseValue(std::istream& file, JsonSlot& slot);
+
+    bool parseScalar(std::istream& file, JsonSlot& slot);
+
+    // Reads up to the ':' of a member and the first char of its value
+    bool parseMemberKey(std::istream& file, Frame& frame);
 
-    JsonObject parseObject(std::ifstream& file);
+    // Sets `interned` if the container is now a node of _intern
+    JsonSlot closeContainer(Frame& frame, bool& interned);
 
-    JsonArray parseArray(std::ifstream& file);
+    // Appends the unescaped text to `str`
+    bool parseString(std::istream& file, std::string& str);
 
-    JsonString parseString(std::ifstream& file);
+    bool parseNumber(std::istream& file, JsonNumber& number);
 
-    JsonNumber parseNumber(std::ifstream& file);
-    
-    JsonBoolean parseBoolean(std::ifstream& file);
-    
-    JsonNull parseNull(std::ifstream& file);
+    bool parseBoolean(std::istream& file, bool& value);
 
-    inline void throwRuntimeError(const std::string& message) {
-        throw std::runtime_error("[Line: " + std::to_string(_line) 
-            + "] [Column: " + std::to_string(_column) + "]: " 
-            + message);
+    bool parseNull(std::istream& file);
+
+    JsonResult<std::shared_ptr<JsonValue>> result(bool ok, const JsonSlot& value);
+
+    // Forgets the position and error of the previous document
+    void reset() {
+        _stack.clear();
+        _line = 1;
+        _column = 0;
+        _bytesRead = 0;
+        _failed = false;
+        _error = JsonError();
     }
 
-    inline void nextChar(std::ifstream& file) {
-        if (!file.get(_ch)) {
-            if (file.eof()) {
-                throwRuntimeError("End of file reached");
-            } else {
-                throwRuntimeError("Error reading character from file");
-            }
+    inline bool fail(const std::string& message) {
+        if (!_failed) {
+            _failed = true;
+            _error = JsonError{ message, _bytesRead, _line, _column };
+        }
+        return false;
+    }
+
+    // Reads through the stream buffer directly: istream::get() builds a sentry per call
+    inline bool nextChar(std::istream& file) {
+        int ch = file.rdbuf()->sbumpc();
+        if (ch == std::char_traits<char>::eof()) {
+            return fail("End of file reached");
+        }
+        _ch = char(ch);
+
+        if (++_bytesRead > _limits.maxDocumentSize) {
+            return fail("Document exceeds the maximum size of " + std::to_string(_limits.maxDocumentSize) + " bytes");
         }
 
         if (_ch == '\n') {
@@ -53,16 +145,21 @@ private:
         } else {
             _column++;
         }
+        return true;
     }
 
-    inline void nextCharSkipWS(std::ifstream& file) {
+    inline bool nextCharSkipWS(std::istream& file) {
         do {
-            nextChar(file);
-        } while (std::isspace(_ch));
+            if (!nextChar(file)) {
+                return false;
+            }
+        } while (std::isspace((unsigned char)_ch));
+        return true;
     }
 
-    inline void returnChar(std::ifstream& file) {
-        file.putback(_ch);
+    inline void returnChar(std::istream& file) {
+        file.rdbuf()->sputbackc(_ch);
+        --_bytesRead;
 
         if (_ch == '\n') {
             _line--;
@@ -78,5 +175,23 @@ private:
     int _line = 1;
     int _column = 0;
 
+    size_t _bytesRead = 0;
+
+    bool _failed = false;
+    JsonError _error;
+
     bool _verbose = false;
+
+    bool _hashing = false;
+
+    Limits _limits;
+
+    std::vector<Frame> _stack;
+
+    // Text of the string value being parsed, kept for its capacity
+    std::string _text;
+
+    std::pmr::memory_resource* _resource = nullptr;
+
+    std::shared_ptr<JsonInternTable> _intern;
 };
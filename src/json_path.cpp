@@ -0,0 +1,53 @@
+#include "json_path.h"
+#include <charconv>
+
+JsonResult<std::vector<JsonPathSegment>> JsonLiteralPath::Split(std::string_view expression) {
+    std::vector<JsonPathSegment> segments;
+
+    size_t pos = 0;
+    bool expectKey = true;
+    while (pos < expression.size()) {
+        JsonPathSegment segment;
+        segment.position = pos;
+
+        if (expression[pos] == '[') {
+            size_t close = expression.find(']', pos);
+            if (close == std::string_view::npos) {
+                return JsonError{ "Expected ']' after array index.", pos };
+            }
+            const char* first = expression.data() + pos + 1;
+            const char* last = expression.data() + close;
+            auto [end, err] = std::from_chars(first, last, segment.index);
+            if (err != std::errc() || end != last) {
+                return JsonError{ "Only integer literal indices are supported here.", pos + 1 };
+            }
+            segment.isIndex = true;
+            pos = close + 1;
+            expectKey = false;
+        } else if (expression[pos] == '.' && !expectKey) {
+            ++pos;
+            expectKey = true;
+            continue;
+        } else {
+            if (!expectKey) {
+                return JsonError{ std::string("Unexpected character '") + expression[pos] + "'.", pos };
+            }
+            size_t end = expression.find_first_of(".[]", pos);
+            if (end == std::string_view::npos) {
+                end = expression.size();
+            }
+            segment.key = expression.substr(pos, end - pos);
+            pos = end;
+            expectKey = false;
+        }
+
+        segments.push_back(std::move(segment));
+    }
+
+    // An empty path addresses the root, a trailing '.' nothing
+    if (!segments.empty() && expectKey) {
+        return JsonError{ "Expected a key.", pos };
+    }
+
+    return segments;
+}
@@ -0,0 +1,379 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <cstdint>
+
+#include "json_types.h"
+#include "json_result.h"
+#include "json_stats.h"
+
+/*
+ * Path expressions compiled at build time:
+ *
+ *     auto c = JsonPath<"a.b[2].c">::Query(*root);
+ *
+ * The expression is tokenized and checked by the compiler; a malformed path
+ * does not compile. What remains at run time is a fixed, unrolled sequence of
+ * lookups with precomputed key hashes. The grammar, semantics and error
+ * messages are those of JsonEval, including nested paths in the subscript
+ * ("a.b[a.b[1]].c"), which are evaluated from the root.
+ */
+
+// One step of a path made only of keys and integer literal indices
+struct JsonPathSegment {
+    std::string key;
+    size_t index = 0;
+    bool isIndex = false;
+    size_t position = 0; // in the expression
+};
+
+// Paths that address a location rather than being evaluated (the sidecar
+// index, document edits), split at run time
+class JsonLiteralPath {
+public:
+    static JsonResult<std::vector<JsonPathSegment>> Split(std::string_view expression);
+};
+
+// Expression text usable as a template argument
+template <size_t N>
+struct JsonPathLiteral {
+    char text[N] = {};
+
+    consteval JsonPathLiteral(const char (&str)[N]) {
+        std::copy_n(str, N, text);
+    }
+
+    constexpr std::string_view view() const {
+        return std::string_view(text, N - 1);
+    }
+};
+
+struct JsonPathStep {
+    enum class Op : uint8_t {
+        Key,         // member lookup
+        Index,       // integer literal subscript
+        BeginNested, // subscript given by a path: evaluate it from the root...
+        EndNested,   // ...and use its value as the index
+    };
+
+    Op op = Op::Key;
+
+    size_t position = 0; // token (key, index) in the expression, for errors
+    size_t bracket = 0;  // '[' of a subscript
+
+    size_t keyOffset = 0;
+    size_t keyLength = 0;
+    size_t keyHash = 0;
+
+    int index = 0;
+};
+
+// Result of compiling an expression of at most N characters
+template <size_t N>
+struct JsonPathProgram {
+    std::array<JsonPathStep, 2 * N + 1> steps;
+    size_t count = 0;
+    int depth = 0; // nesting of path subscripts
+
+    enum class Error : uint8_t {
+        None,
+        ExpectedKey,
+        IntegerKey,
+        NegativeIndex,
+        IndexOutOfRange,
+        ExpectedClosingBracket,
+        UnexpectedCharacter,
+    };
+
+    Error error = Error::None;
+    size_t errorPosition = 0;
+
+    constexpr bool valid() const {
+        return error == Error::None;
+    }
+};
+
+class JsonPathCompiler {
+public:
+    // Never fails to compile; check valid() of the result
+    template <size_t N>
+    static consteval JsonPathProgram<N> Compile(std::string_view expression) {
+        JsonPathProgram<N> program;
+        size_t pos = 0;
+        compilePath(program, expression, pos, 0);
+        if (program.valid() && pos < expression.size()) {
+            fail(program, JsonPathProgram<N>::Error::UnexpectedCharacter, pos);
+        }
+        return program;
+    }
+
+    // Compile() that turns an invalid expression into a compile error
+    template <size_t N>
+    static consteval JsonPathProgram<N> CompileOrFail(std::string_view expression) {
+        JsonPathProgram<N> program = Compile<N>(expression);
+        using Error = typename JsonPathProgram<N>::Error;
+        switch (program.error) {
+            case Error::None: break;
+            case Error::ExpectedKey: malformed_path_expected_key(); break;
+            case Error::IntegerKey: malformed_path_integer_literal_used_as_key(); break;
+            case Error::NegativeIndex: malformed_path_negative_index(); break;
+            case Error::IndexOutOfRange: malformed_path_index_out_of_range(); break;
+            case Error::ExpectedClosingBracket: malformed_path_expected_closing_bracket(); break;
+            case Error::UnexpectedCharacter: malformed_path_unexpected_character(); break;
+        }
+        return program;
+    }
+
+private:
+    // Not constexpr: reaching one while compiling a path stops the build, and
+    // the diagnostic names the reason
+    static void malformed_path_expected_key() {}
+    static void malformed_path_integer_literal_used_as_key() {}
+    static void malformed_path_negative_index() {}
+    static void malformed_path_index_out_of_range() {}
+    static void malformed_path_expected_closing_bracket() {}
+    static void malformed_path_unexpected_character() {}
+
+    template <size_t N>
+    static constexpr void fail(JsonPathProgram<N>& program, typename JsonPathProgram<N>::Error error, size_t position) {
+        if (program.valid()) {
+            program.error = error;
+            program.errorPosition = position;
+        }
+    }
+
+    static constexpr std::string_view readToken(std::string_view expression, size_t& pos) {
+        size_t start = pos;
+        while (pos < expression.size() && expression[pos] != '.' && expression[pos] != '[' && expression[pos] != ']') {
+            ++pos;
+        }
+        return expression.substr(start, pos - start);
+    }
+
+    static constexpr bool isIntegerLiteral(std::string_view token) {
+        size_t start = (!token.empty() && token[0] == '-') ? 1 : 0;
+        if (start == token.size()) {
+            return false;
+        }
+        for (size_t i = start; i < token.size(); ++i) {
+            if (token[i] < '0' || token[i] > '9') {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // path := key ('.' key | '[' index ']')*
+    template <size_t N>
+    static constexpr void compilePath(JsonPathProgram<N>& program, std::string_view expression,
+                                      size_t& pos, int depth)
+    {
+        program.depth = std::max(program.depth, depth);
+
+        for (;;) {
+            size_t tokenPos = pos;
+            std::string_view key = readToken(expression, pos);
+            if (key.empty()) {
+                return fail(program, JsonPathProgram<N>::Error::ExpectedKey, tokenPos);
+            }
+            if (isIntegerLiteral(key)) {
+                return fail(program, JsonPathProgram<N>::Error::IntegerKey, tokenPos);
+            }
+
+            JsonPathStep& step = program.steps[program.count++];
+            step.op = JsonPathStep::Op::Key;
+            step.position = tokenPos;
+            step.keyOffset = tokenPos;
+            step.keyLength = key.size();
+            step.keyHash = JsonKeyHash::Hash(key);
+
+            while (pos < expression.size() && expression[pos] == '[') {
+                size_t bracket = pos++;
+                size_t indexPos = pos;
+
+                // index := integer | path
+                size_t literalEnd = pos;
+                std::string_view token = readToken(expression, literalEnd);
+                if (isIntegerLiteral(token)) {
+                    if (token[0] == '-') {
+                        return fail(program, JsonPathProgram<N>::Error::NegativeIndex, indexPos);
+                    }
+                    long long value = 0;
+                    for (char ch : token) {
+                        value = value * 10 + (ch - '0');
+                        if (value > INT32_MAX) {
+                            return fail(program, JsonPathProgram<N>::Error::IndexOutOfRange, indexPos);
+                        }
+                    }
+                    JsonPathStep& index = program.steps[program.count++];
+                    index.op = JsonPathStep::Op::Index;
+                    index.position = indexPos;
+                    index.bracket = bracket;
+                    index.index = int(value);
+                    pos = literalEnd;
+                } else {
+                    JsonPathStep& begin = program.steps[program.count++];
+                    begin.op = JsonPathStep::Op::BeginNested;
+                    begin.position = indexPos;
+                    begin.bracket = bracket;
+
+                    compilePath(program, expression, pos, depth + 1);
+                    if (!program.valid()) {
+                        return;
+                    }
+
+                    JsonPathStep& end = program.steps[program.count++];
+                    end.op = JsonPathStep::Op::EndNested;
+                    end.position = indexPos;
+                    end.bracket = bracket;
+                }
+
+                if (pos >= expression.size() || expression[pos] != ']') {
+                    return fail(program, JsonPathProgram<N>::Error::ExpectedClosingBracket, pos);
+                }
+                ++pos;
+            }
+
+            if (pos >= expression.size() || expression[pos] != '.') {
+                return;
+            }
+            ++pos;
+        }
+    }
+};
+
+template <JsonPathLiteral Expression>
+class JsonPath {
+public:
+    static constexpr std::string_view expression() {
+        return Expression.view();
+    }
+
+    // Returns a node of the tree rooted at `root`, valid as long as the tree
+    // is. Elements of packed arrays are not nodes and are rejected.
+    static JsonResult<const JsonValue*> Query(const JsonValue& root) {
+        State state{ &root, &root, {}, 0, JsonNumber(0), {} };
+        if (!run(state)) {
+            return std::move(state.error);
+        }
+        if (state.current == &state.number) {
+            return JsonError{ "Element of a packed array is not a node, use TryEvaluateExpression().", 0 };
+        }
+        return state.current;
+    }
+
+    // Like Query, but the result shares ownership of the tree
+    static JsonResult<std::shared_ptr<const JsonValue>> TryEvaluateExpression(const std::shared_ptr<const JsonValue>& root) {
+        State state{ root.get(), root.get(), {}, 0, JsonNumber(0), {} };
+        if (!run(state)) {
+            return std::move(state.error);
+        }
+        if (state.current == &state.number) {
+            return std::shared_ptr<const JsonValue>(std::make_shared<JsonNumber>(state.number));
+        }
+        return std::shared_ptr<const JsonValue>(root, state.current);
+    }
+
+    // Throwing wrapper of TryEvaluateExpression
+    static std::shared_ptr<const JsonValue> EvaluateExpression(const std::shared_ptr<const JsonValue>& root) {
+        auto result = TryEvaluateExpression(root);
+        if (!result) {
+            throw std::runtime_error(result.error().what());
+        }
+        return *result;
+    }
+
+private:
+    static constexpr auto s_program = JsonPathCompiler::CompileOrFail<Expression.view().size()>(Expression.view());
+
+    struct State {
+        const JsonValue* root;
+        const JsonValue* current;
+
+        // Outer positions saved while a nested subscript path is evaluated
+        const JsonValue* saved[s_program.depth + 1] = {};
+        int depth = 0;
+
+        // The current element of a packed array. A number ends the path or is
+        // used as an index right away, so one is enough.
+        JsonNumber number;
+
+        JsonError error;
+    };
+
+    static bool run(State& state) {
+        return [&]<size_t... I>(std::index_sequence<I...>) {
+            return (step<I>(state) && ...);
+        }(std::make_index_sequence<s_program.count>());
+    }
+
+    template <size_t I>
+    static bool step(State& state) {
+        constexpr JsonPathStep step = s_program.steps[I];
+        using Op = JsonPathStep::Op;
+
+        if constexpr (step.op == Op::Key) {
+            constexpr std::string_view key = Expression.view().substr(step.keyOffset, step.keyLength);
+
+            if (state.current->type() != JsonType::Object) {
+                state.error = JsonError{ "Token preceding '.' must be a JSON object.", step.position };
+                return false;
+            }
+            JSON_STATS_ADD(hashLookups, 1);
+            state.current = static_cast<const JsonObject*>(state.current)->find(JsonHashedKey{ key, step.keyHash });
+            if (!state.current) {
+                state.error = JsonError{ "Key \"" + std::string(key) + "\" was not found in parent object.", step.position };
+                return false;
+            }
+            return true;
+        } else if constexpr (step.op == Op::BeginNested) {
+            if (state.current->type() != JsonType::Array) {
+                state.error = JsonError{ "Token preceding '[' must be a JSON array.", step.bracket };
+                return false;
+            }
+            state.saved[state.depth++] = state.current;
+            state.current = state.root;
+            return true;
+        } else {
+            int index = step.index;
+            if constexpr (step.op == Op::EndNested) {
+                const JsonValue* value = state.current;
+                if (value->type() != JsonType::Number) {
+                    state.error = JsonError{ "Expected number value as index in JSON array.", step.position };
+                    return false;
+                }
+                const JsonNumber* number = static_cast<const JsonNumber*>(value);
+                if (!number->isInteger()) {
+                    state.error = JsonError{ "Expected integer index in JSON array.", step.position };
+                    return false;
+                }
+                index = int(*number);
+                state.current = state.saved[--state.depth];
+            } else if (state.current->type() != JsonType::Array) {
+                state.error = JsonError{ "Token preceding '[' must be a JSON array.", step.bracket };
+                return false;
+            }
+
+            // Negative indices wrap around to huge values and fail the range check
+            const JsonArray* array = static_cast<const JsonArray*>(state.current);
+            if (size_t(index) >= array->size()) {
+                state.error = JsonError{ "Index '" + std::to_string(index) + "' is out of range.", step.position };
+                return false;
+            }
+            if (array->isPacked()) {
+                state.number = array->number(index);
+                state.current = &state.number;
+            } else {
+                state.current = array->at(index);
+            }
+            return true;
+        }
+    }
+};
@@ -0,0 +1,735 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/*
+ * Containers whose copies share storage, behind JsonArray and JsonObject.
+ *
+ * Both are trees of reference counted nodes. Copying a container copies its
+ * root pointer; changing a copy first copies the nodes on the path to the
+ * change, unless the copy is their only owner, and shares every other node
+ * with the original. An edit of a document (see JsonDocument) therefore
+ * copies a bounded number of elements per level instead of the width of
+ * each container on its path.
+ *
+ * Nodes are never changed once shared, so readers of an old version need no
+ * synchronization. Changing one container from several threads is not safe,
+ * as with the standard containers.
+ */
+
+// A value derived from everything below a node (JsonHash stores a partial
+// hash), computed on first use and cached in the node. Copies of a node
+// start out without one, and changing a node forgets it.
+class JsonSummary {
+public:
+    JsonSummary() = default;
+
+    JsonSummary(const JsonSummary&) {}
+
+    JsonSummary& operator=(const JsonSummary&) {
+        forget();
+        return *this;
+    }
+
+    bool get(uint64_t& value) const {
+        if (!_known.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = _value.load(std::memory_order_relaxed);
+        return true;
+    }
+
+    // Shared nodes may be summarized by several threads at once; they all
+    // store the same value
+    void set(uint64_t value) const {
+        _value.store(value, std::memory_order_relaxed);
+        _known.store(true, std::memory_order_release);
+    }
+
+    void forget() {
+        _known.store(false, std::memory_order_relaxed);
+    }
+
+private:
+    mutable std::atomic<uint64_t> _value{ 0 };
+    mutable std::atomic<bool> _known{ false };
+};
+
+
+/*
+ * Sequence of T. Up to LeafSize elements it is a plain std::vector; beyond
+ * that, a B+ tree of leaves of up to LeafSize elements and branches of up
+ * to BranchSize children, each node counting the elements below it. Access
+ * by index and every change take O(log n); appending fills the last leaf,
+ * erasing may leave leaves less than full.
+ */
+template <typename T>
+class JsonVector {
+public:
+    static constexpr size_t LeafSize = std::max<size_t>(8192 / sizeof(T), 8);
+    static constexpr size_t BranchSize = 32;
+
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = T;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const T*;
+        using reference = const T&;
+
+        const_iterator() = default;
+
+        reference operator*() const {
+            return *_at;
+        }
+
+        pointer operator->() const {
+            return _at;
+        }
+
+        const_iterator& operator++() {
+            ++_index;
+            if (++_at == _end) {
+                load();
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            const_iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            return _index == other._index;
+        }
+
+    private:
+        friend class JsonVector;
+
+        const_iterator(const JsonVector* vector, size_t index)
+            : _vector(vector), _index(index) {
+            load();
+        }
+
+        // Moves on to the leaf holding _index
+        void load() {
+            if (_index < _vector->size()) {
+                _end = _vector->block(_index, _at);
+            }
+        }
+
+        const JsonVector* _vector = nullptr;
+        size_t _index = 0;
+        const T* _at = nullptr;
+        const T* _end = nullptr;
+    };
+
+    size_t size() const {
+        return _root ? _root->size : _small.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // Elements that fit without allocating, while the vector is flat
+    size_t capacity() const {
+        return _root ? size() : _small.capacity();
+    }
+
+    void reserve(size_t size) {
+        if (!_root) {
+            _small.reserve(std::min(size, LeafSize));
+        }
+    }
+
+    void clear() {
+        _small.clear();
+        _root.reset();
+    }
+
+    const T& operator[](size_t index) const {
+        if (!_root) {
+            return _small[index];
+        }
+        const Node* leaf = leafOf(_root.get(), index);
+        return leaf->elements[index];
+    }
+
+    const_iterator begin() const {
+        return const_iterator(this, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(this, size());
+    }
+
+    void push_back(T value) {
+        if (!_root) {
+            if (_small.size() < LeafSize) {
+                _small.push_back(std::move(value));
+                return;
+            }
+            auto leaf = std::make_shared<Node>();
+            leaf->size = _small.size();
+            leaf->elements = std::move(_small);
+            _small = std::vector<T>();
+            _root = std::move(leaf);
+        }
+        if (isFull(*_root)) {
+            auto root = std::make_shared<Node>();
+            root->height = _root->height + 1;
+            root->size = _root->size + 1;
+            root->children.reserve(BranchSize);
+            root->children.push_back(std::move(_root));
+            root->children.push_back(chain(root->height - 1, std::move(value)));
+            _root = std::move(root);
+            return;
+        }
+        append(own(_root), std::move(value));
+    }
+
+    void set(size_t index, T value) {
+        if (!_root) {
+            _small[index] = std::move(value);
+            return;
+        }
+        Node* node = &own(_root);
+        while (node->height > 0) {
+            node = &own(childOf(*node, index));
+        }
+        node->elements[index] = std::move(value);
+    }
+
+    void erase(size_t index) {
+        if (!_root) {
+            _small.erase(_small.begin() + index);
+            return;
+        }
+        eraseAt(own(_root), index);
+
+        while (_root->height > 0 && _root->children.size() == 1) {
+            std::shared_ptr<Node> child = _root->children.front();
+            _root = std::move(child);
+        }
+        if (_root->height == 0) {
+            // Flat again
+            _small = _root.use_count() == 1 ? std::move(_root->elements) : _root->elements;
+            _root.reset();
+        }
+    }
+
+    // Folds the elements into one value: `leaf(const T* elements, size_t count)`
+    // summarizes a run of elements, `join(left, right, rightCount)` two adjacent
+    // runs. Nodes cache their result, so one vector must always be summarized
+    // with the same functions, and an unchanged part costs nothing the second
+    // time.
+    template <typename Leaf, typename Join>
+    uint64_t summarize(const Leaf& leaf, const Join& join) const {
+        if (!_root) {
+            return leaf(_small.data(), _small.size());
+        }
+        return summarize(*_root, leaf, join);
+    }
+
+    // Heap bytes of the storage, as counted by `node(objectSize)` for a node
+    // and `buffer(size)` for the buffer of a std::vector
+    template <typename NodeBytes, typename BufferBytes>
+    uint64_t storageBytes(const NodeBytes& node, const BufferBytes& buffer) const {
+        if (!_root) {
+            return buffer(_small.capacity() * sizeof(T));
+        }
+        return storageBytes(*_root, node, buffer);
+    }
+
+private:
+    struct Node {
+        int height = 0;  // 0 for a leaf
+        size_t size = 0; // elements below
+        std::vector<T> elements;                     // of a leaf
+        std::vector<std::shared_ptr<Node>> children; // of a branch
+        JsonSummary summary;
+    };
+
+    // The node, copied first if it is shared
+    static Node& own(std::shared_ptr<Node>& node) {
+        if (node.use_count() != 1) {
+            node = std::make_shared<Node>(*node);
+        }
+        node->summary.forget();
+        return *node;
+    }
+
+    // The child of a branch holding element `index`, made relative to it
+    template <typename N>
+    static auto& childOf(N& branch, size_t& index) {
+        for (auto& child : branch.children) {
+            if (index < child->size) {
+                return child;
+            }
+            index -= child->size;
+        }
+        return branch.children.back(); // not reached for an index in range
+    }
+
+    static const Node* leafOf(const Node* node, size_t& index) {
+        while (node->height > 0) {
+            node = childOf(*node, index).get();
+        }
+        return node;
+    }
+
+    // Points `at` to element `index` and returns the end of its leaf
+    const T* block(size_t index, const T*& at) const {
+        if (!_root) {
+            at = _small.data() + index;
+            return _small.data() + _small.size();
+        }
+        const Node* leaf = leafOf(_root.get(), index);
+        at = leaf->elements.data() + index;
+        return leaf->elements.data() + leaf->elements.size();
+    }
+
+    static bool isFull(const Node& node) {
+        if (node.height == 0) {
+            return node.elements.size() >= LeafSize;
+        }
+        return node.children.size() >= BranchSize && isFull(*node.children.back());
+    }
+
+    // New subtree of `height` holding only `value`
+    static std::shared_ptr<Node> chain(int height, T&& value) {
+        auto node = std::make_shared<Node>();
+        node->height = height;
+        node->size = 1;
+        if (height == 0) {
+            node->elements.reserve(LeafSize);
+            node->elements.push_back(std::move(value));
+        } else {
+            node->children.reserve(BranchSize);
+            node->children.push_back(chain(height - 1, std::move(value)));
+        }
+        return node;
+    }
+
+    // Appends to a node that is not full
+    static void append(Node& node, T&& value) {
+        ++node.size;
+        if (node.height == 0) {
+            node.elements.push_back(std::move(value));
+            return;
+        }
+        std::shared_ptr<Node>& last = node.children.back();
+        if (isFull(*last)) {
+            node.children.push_back(chain(node.height - 1, std::move(value)));
+        } else {
+            append(own(last), std::move(value));
+        }
+    }
+
+    static void eraseAt(Node& node, size_t index) {
+        --node.size;
+        if (node.height == 0) {
+            node.elements.erase(node.elements.begin() + index);
+            return;
+        }
+        std::shared_ptr<Node>& child = childOf(node, index);
+        if (child->size == 1) {
+            node.children.erase(node.children.begin() + (&child - node.children.data()));
+        } else {
+            eraseAt(own(child), index);
+        }
+    }
+
+    template <typename Leaf, typename Join>
+    static uint64_t summarize(const Node& node, const Leaf& leaf, const Join& join) {
+        uint64_t value;
+        if (node.summary.get(value)) {
+            return value;
+        }
+        if (node.height == 0) {
+            value = leaf(node.elements.data(), node.elements.size());
+        } else {
+            value = summarize(*node.children.front(), leaf, join);
+            for (size_t i = 1; i < node.children.size(); ++i) {
+                const Node& child = *node.children[i];
+                value = join(value, summarize(child, leaf, join), child.size);
+            }
+        }
+        node.summary.set(value);
+        return value;
+    }
+
+    template <typename NodeBytes, typename BufferBytes>
+    static uint64_t storageBytes(const Node& node, const NodeBytes& nodeBytes, const BufferBytes& buffer) {
+        uint64_t bytes = nodeBytes(sizeof(Node)) + buffer(node.elements.capacity() * sizeof(T))
+            + buffer(node.children.capacity() * sizeof(std::shared_ptr<Node>));
+        for (const auto& child : node.children) {
+            bytes += storageBytes(*child, nodeBytes, buffer);
+        }
+        return bytes;
+    }
+
+    std::vector<T> _small;       // while there is no _root
+    std::shared_ptr<Node> _root;
+};
+
+
+/*
+ * Map from strings to V: a hash array mapped trie in the compressed (CHAMP)
+ * layout. Each node takes 5 bits of a key's hash and keeps, in the order of
+ * those bits, the members that end there and the child nodes for bits that
+ * several keys share. Keys whose whole hash is equal end up together in a
+ * node below the last level. Finding, setting and erasing a key visit one
+ * node per level, O(log n); members are visited in hash order.
+ *
+ * Up to FlatSize members, the root is a single node holding them unordered,
+ * searched by comparing keys, as most objects are small and a trie would
+ * spend more on nodes than on members.
+ *
+ * `Hash` must be callable with a std::string_view; the hash passed to the
+ * members below must be the one it returns.
+ */
+template <typename V, typename Hash>
+class JsonMap {
+public:
+    using Member = std::pair<std::string, V>;
+
+    static constexpr size_t FlatSize = 8;
+
+private:
+    static constexpr unsigned s_bits = 5;
+    static constexpr unsigned s_hashBits = sizeof(size_t) * 8;
+    static constexpr int s_maxDepth = (s_hashBits + s_bits - 1) / s_bits + 1;
+
+    struct Node {
+        uint32_t memberMap = 0; // hash fragments ending at a member
+        uint32_t childMap = 0;  // hash fragments continuing in a child
+        std::vector<Member> members;
+        std::vector<std::shared_ptr<Node>> children;
+        JsonSummary summary;
+    };
+
+public:
+    class const_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Member;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Member*;
+        using reference = const Member&;
+
+        const_iterator() = default;
+
+        reference operator*() const {
+            return _stack[_depth].node->members[_member];
+        }
+
+        pointer operator->() const {
+            return &**this;
+        }
+
+        const_iterator& operator++() {
+            ++_member;
+            settle();
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            const_iterator copy = *this;
+            ++*this;
+            return copy;
+        }
+
+        bool operator==(const const_iterator& other) const {
+            if (_depth < 0 || other._depth < 0) {
+                return _depth == other._depth;
+            }
+            return &**this == &*other;
+        }
+
+    private:
+        friend class JsonMap;
+
+        explicit const_iterator(const Node* root) {
+            if (root) {
+                _stack[0] = { root, 0 };
+                _depth = 0;
+                settle();
+            }
+        }
+
+        // Members of a node come before those of its children
+        void settle() {
+            while (_depth >= 0) {
+                Level& level = _stack[_depth];
+                if (_member < level.node->members.size()) {
+                    return;
+                }
+                if (level.child < level.node->children.size()) {
+                    _stack[++_depth] = { level.node->children[level.child++].get(), 0 };
+                    _member = 0;
+                } else if (--_depth >= 0) {
+                    _member = _stack[_depth].node->members.size();
+                }
+            }
+        }
+
+        struct Level {
+            const Node* node;
+            size_t child; // next one to visit
+        };
+
+        Level _stack[s_maxDepth + 1] = {};
+        int _depth = -1; // -1 at the end
+        size_t _member = 0;
+    };
+
+    JsonMap() = default;
+
+    JsonMap(const JsonMap&) = default;
+
+    JsonMap(JsonMap&& other) noexcept
+        : _root(std::move(other._root)), _size(std::exchange(other._size, 0)) {}
+
+    JsonMap& operator=(const JsonMap&) = default;
+
+    JsonMap& operator=(JsonMap&& other) noexcept {
+        _root = std::move(other._root);
+        _size = std::exchange(other._size, 0);
+        return *this;
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    bool empty() const {
+        return _size == 0;
+    }
+
+    const_iterator begin() const {
+        return const_iterator(_root.get());
+    }
+
+    const_iterator end() const {
+        return const_iterator();
+    }
+
+    const V* find(std::string_view key, size_t hash) const {
+        const Node* node = _root.get();
+        for (unsigned shift = rootShift(); node; shift += s_bits) {
+            if (shift >= s_hashBits) {
+                for (const Member& member : node->members) {
+                    if (member.first == key) {
+                        return &member.second;
+                    }
+                }
+                return nullptr;
+            }
+            uint32_t bit = bitOf(hash, shift);
+            if (node->memberMap & bit) {
+                const Member& member = node->members[indexOf(node->memberMap, bit)];
+                return member.first == key ? &member.second : nullptr;
+            }
+            if (!(node->childMap & bit)) {
+                return nullptr;
+            }
+            node = node->children[indexOf(node->childMap, bit)].get();
+        }
+        return nullptr;
+    }
+
+    const V* find(std::string_view key) const {
+        return find(key, Hash()(key));
+    }
+
+    // Adds the member or replaces its value
+    void set(std::string_view key, V value, size_t hash) {
+        if (!_root) {
+            _root = std::make_shared<Node>();
+        }
+        if (insert(own(_root), rootShift(), hash, key, std::move(value)) && ++_size == FlatSize + 1) {
+            rebuild();
+        }
+    }
+
+    void set(std::string_view key, V value) {
+        set(key, std::move(value), Hash()(key));
+    }
+
+    bool erase(std::string_view key, size_t hash) {
+        if (!_root || !find(key, hash)) {
+            return false;
+        }
+        remove(own(_root), rootShift(), hash, key);
+        if (--_size == 0) {
+            _root.reset();
+        } else if (_size == FlatSize) {
+            rebuild();
+        }
+        return true;
+    }
+
+    bool erase(std::string_view key) {
+        return erase(key, Hash()(key));
+    }
+
+    // Sum of `member(const Member&)` over all members, wrapping around. Nodes
+    // cache their sums, see JsonVector::summarize().
+    template <typename MemberSummary>
+    uint64_t summarize(const MemberSummary& member) const {
+        return _root ? summarize(*_root, member) : 0;
+    }
+
+    // See JsonVector::storageBytes()
+    template <typename NodeBytes, typename BufferBytes>
+    uint64_t storageBytes(const NodeBytes& node, const BufferBytes& buffer) const {
+        return _root ? storageBytes(*_root, node, buffer) : 0;
+    }
+
+private:
+    // A flat root is searched like a node below the last level
+    unsigned rootShift() const {
+        return _size <= FlatSize ? s_hashBits : 0;
+    }
+
+    // Moves the members into a root of the layout rootShift() now calls for
+    void rebuild() {
+        std::vector<Member> members(begin(), end());
+        auto root = std::make_shared<Node>();
+        for (Member& member : members) {
+            size_t hash = Hash()(member.first);
+            insert(*root, rootShift(), hash, member.first, std::move(member.second));
+        }
+        _root = std::move(root);
+    }
+
+    static uint32_t bitOf(size_t hash, unsigned shift) {
+        return uint32_t(1) << ((hash >> shift) & ((1u << s_bits) - 1));
+    }
+
+    // Position of the entry for `bit` among those present in `map`
+    static size_t indexOf(uint32_t map, uint32_t bit) {
+        return size_t(std::popcount(map & (bit - 1)));
+    }
+
+    static Node& own(std::shared_ptr<Node>& node) {
+        if (node.use_count() != 1) {
+            node = std::make_shared<Node>(*node);
+        }
+        node->summary.forget();
+        return *node;
+    }
+
+    // Returns whether a member was added rather than replaced
+    static bool insert(Node& node, unsigned shift, size_t hash, std::string_view key, V&& value) {
+        if (shift >= s_hashBits) {
+            for (Member& member : node.members) {
+                if (member.first == key) {
+                    member.second = std::move(value);
+                    return false;
+                }
+            }
+            node.members.emplace_back(std::string(key), std::move(value));
+            return true;
+        }
+
+        uint32_t bit = bitOf(hash, shift);
+        if (node.memberMap & bit) {
+            size_t index = indexOf(node.memberMap, bit);
+            Member& member = node.members[index];
+            if (member.first == key) {
+                member.second = std::move(value);
+                return false;
+            }
+            // Both continue one level down
+            auto child = std::make_shared<Node>();
+            size_t otherHash = Hash()(member.first);
+            insert(*child, shift + s_bits, otherHash, member.first, std::move(member.second));
+            insert(*child, shift + s_bits, hash, key, std::move(value));
+            node.members.erase(node.members.begin() + index);
+            node.memberMap &= ~bit;
+            node.childMap |= bit;
+            node.children.insert(node.children.begin() + indexOf(node.childMap, bit), std::move(child));
+            return true;
+        }
+        if (node.childMap & bit) {
+            return insert(own(node.children[indexOf(node.childMap, bit)]), shift + s_bits, hash, key, std::move(value));
+        }
+        node.memberMap |= bit;
+        node.members.emplace(node.members.begin() + indexOf(node.memberMap, bit), std::string(key), std::move(value));
+        return true;
+    }
+
+    // `key` is known to be present
+    static void remove(Node& node, unsigned shift, size_t hash, std::string_view key) {
+        if (shift >= s_hashBits) {
+            auto it = std::find_if(node.members.begin(), node.members.end(),
+                                   [&](const Member& member) { return member.first == key; });
+            node.members.erase(it);
+            return;
+        }
+
+        uint32_t bit = bitOf(hash, shift);
+        if (node.memberMap & bit) {
+            node.members.erase(node.members.begin() + indexOf(node.memberMap, bit));
+            node.memberMap &= ~bit;
+            return;
+        }
+
+        size_t index = indexOf(node.childMap, bit);
+        Node& child = own(node.children[index]);
+        remove(child, shift + s_bits, hash, key);
+        if (child.children.empty() && child.members.size() == 1) {
+            // The last member of the child moves up
+            Member member = std::move(child.members.front());
+            node.children.erase(node.children.begin() + index);
+            node.childMap &= ~bit;
+            node.memberMap |= bit;
+            node.members.insert(node.members.begin() + indexOf(node.memberMap, bit), std::move(member));
+        }
+    }
+
+    template <typename MemberSummary>
+    static uint64_t summarize(const Node& node, const MemberSummary& member) {
+        uint64_t value;
+        if (node.summary.get(value)) {
+            return value;
+        }
+        value = 0;
+        for (const Member& m : node.members) {
+            value += member(m);
+        }
+        for (const auto& child : node.children) {
+            value += summarize(*child, member);
+        }
+        node.summary.set(value);
+        return value;
+    }
+
+    template <typename NodeBytes, typename BufferBytes>
+    static uint64_t storageBytes(const Node& node, const NodeBytes& nodeBytes, const BufferBytes& buffer) {
+        uint64_t bytes = nodeBytes(sizeof(Node)) + buffer(node.members.capacity() * sizeof(Member))
+            + buffer(node.children.capacity() * sizeof(std::shared_ptr<Node>));
+        for (const auto& child : node.children) {
+            bytes += storageBytes(*child, nodeBytes, buffer);
+        }
+        return bytes;
+    }
+
+    std::shared_ptr<Node> _root;
+    size_t _size = 0;
+};
@@ -0,0 +1,139 @@
+#include "json_reader.h"
+#include <cerrno>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#endif
+
+JsonReadAheadBuffer::JsonReadAheadBuffer(const std::string& path)
+    : JsonReadAheadBuffer(path, Options()) {}
+
+JsonReadAheadBuffer::JsonReadAheadBuffer(const std::string& path, const Options& options)
+    : _options(options)
+{
+    if (_options.blocks < 2) {
+        _options.blocks = 2;
+    }
+
+    if (path == "-") {
+        _file = stdin;
+    } else {
+        _file = std::fopen(path.c_str(), "rb");
+        _ownsFile = true;
+    }
+    if (!_file) {
+        return;
+    }
+
+    _blocks.resize(_options.blocks);
+    for (Block& block : _blocks) {
+        block.data.reset(new char[_options.blockSize]);
+    }
+
+    adviseSequential();
+
+    _reader = std::thread(&JsonReadAheadBuffer::readLoop, this);
+}
+
+JsonReadAheadBuffer::~JsonReadAheadBuffer() {
+    if (_reader.joinable()) {
+        // Wake the reader if it is waiting for a free block
+        _stop.store(true, std::memory_order_release);
+        _consumed.fetch_add(1, std::memory_order_release);
+        _consumed.notify_one();
+        _reader.join();
+    }
+    if (_file && _ownsFile) {
+        std::fclose(_file);
+    }
+}
+
+void JsonReadAheadBuffer::readLoop() {
+    uint64_t offset = 0;
+
+    for (;;) {
+        size_t produced = _produced.load(std::memory_order_relaxed);
+
+        // Wait for the consumer to release a block
+        size_t consumed = _consumed.load(std::memory_order_acquire);
+        while (produced - consumed == _options.blocks && !_stop.load(std::memory_order_acquire)) {
+            _consumed.wait(consumed, std::memory_order_acquire);
+            consumed = _consumed.load(std::memory_order_acquire);
+        }
+        if (_stop.load(std::memory_order_acquire)) {
+            return;
+        }
+
+        adviseWillNeed(offset);
+
+        Block& block = _blocks[produced % _options.blocks];
+        block.size = std::fread(block.data.get(), 1, _options.blockSize, _file);
+        offset += block.size;
+
+        if (block.size < _options.blockSize && std::ferror(_file)) {
+            _error = std::strerror(errno);
+            _failed.store(true, std::memory_order_release);
+            block.size = 0;
+        }
+
+        _produced.store(produced + 1, std::memory_order_release);
+        _produced.notify_one();
+
+        // A short block is followed by an empty one (fread keeps returning 0)
+        if (block.size == 0) {
+            return;
+        }
+    }
+}
+
+JsonReadAheadBuffer::int_type JsonReadAheadBuffer::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+    if (_eof || !_file) {
+        return traits_type::eof();
+    }
+
+    size_t consumed = _consumed.load(std::memory_order_relaxed);
+    if (_holding) {
+        // Hand the block we just finished back to the reader
+        ++consumed;
+        _consumed.store(consumed, std::memory_order_release);
+        _consumed.notify_one();
+    }
+
+    size_t produced = _produced.load(std::memory_order_acquire);
+    while (produced == consumed) {
+        _produced.wait(produced, std::memory_order_acquire);
+        produced = _produced.load(std::memory_order_acquire);
+    }
+
+    Block& block = _blocks[consumed % _options.blocks];
+    _holding = true;
+
+    if (block.size == 0) {
+        _eof = true;
+        setg(nullptr, nullptr, nullptr);
+        return traits_type::eof();
+    }
+
+    setg(block.data.get(), block.data.get(), block.data.get() + block.size);
+    return traits_type::to_int_type(*gptr());
+}
+
+void JsonReadAheadBuffer::adviseSequential() {
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fileno(_file), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+void JsonReadAheadBuffer::adviseWillNeed(uint64_t offset) {
+#if defined(POSIX_FADV_WILLNEED)
+    // Ask the kernel to start on the blocks after the one being read
+    posix_fadvise(fileno(_file), offset + _options.blockSize,
+                  _options.blockSize * (_options.blocks - 1), POSIX_FADV_WILLNEED);
+#else
+    (void)offset;
+#endif
+}
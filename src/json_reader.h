@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+ * Read-ahead stream buffer: a dedicated thread reads fixed-size blocks from a
+ * file or pipe into a small ring while the parser consumes earlier blocks, so
+ * disk or pipe stalls overlap with parsing instead of adding to it.
+ *
+ * The ring is single-producer/single-consumer and lock-free. The two sides
+ * only block (C++20 atomic wait) when the ring is full or empty.
+ */
+class JsonReadAheadBuffer : public std::streambuf {
+public:
+    struct Options {
+        size_t blockSize = 1 << 20;
+        size_t blocks = 3; // triple buffered
+    };
+
+    // Opens `path`, or standard input if `path` is "-"
+    JsonReadAheadBuffer(const std::string& path);
+
+    JsonReadAheadBuffer(const std::string& path, const Options& options);
+
+    ~JsonReadAheadBuffer();
+
+    JsonReadAheadBuffer(const JsonReadAheadBuffer&) = delete;
+    JsonReadAheadBuffer& operator=(const JsonReadAheadBuffer&) = delete;
+
+    bool is_open() const {
+        return _file != nullptr;
+    }
+
+    // Set if reading failed before the end of the input. Safe to call while
+    // the reader is still running, e.g. after the parser gave up early.
+    const std::string& error() const {
+        static const std::string none;
+        return _failed.load(std::memory_order_acquire) ? _error : none;
+    }
+
+protected:
+    int_type underflow() override;
+
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size = 0; // 0 marks the end of the input
+    };
+
+    void readLoop();
+
+    void adviseSequential();
+
+    void adviseWillNeed(uint64_t offset);
+
+    Options _options;
+
+    std::FILE* _file = nullptr;
+    bool _ownsFile = false;
+
+    std::vector<Block> _blocks;
+
+    // Monotonic block counters; their difference is the number of filled blocks
+    std::atomic<size_t> _produced{ 0 };
+    std::atomic<size_t> _consumed{ 0 };
+    std::atomic<bool> _stop{ false };
+    std::atomic<bool> _failed{ false }; // publishes _error
+
+    bool _holding = false; // consumer has a block in the get area
+    bool _eof = false;
+
+    std::string _error; // written once by the reader, before _failed
+
+    std::thread _reader;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <variant>
+
+/*
+ * Error reporting for the parser and the evaluator without exceptions.
+ *
+ * JsonResult<T> is a minimal std::expected-style type (the project targets
+ * C++20): it holds either a value or a JsonError. Exceptions are only thrown
+ * by the convenience wrappers at the public API boundary.
+ */
+
+struct JsonError {
+    std::string message;
+
+    size_t position = 0; // offset into the expression, or byte offset into the document
+
+    // Set for document errors only
+    int line = 0;
+    int column = 0;
+
+    std::string what() const {
+        if (line > 0) {
+            return "[Line: " + std::to_string(line) + "] [Column: " + std::to_string(column) + "]: " + message;
+        }
+        return "[Position: " + std::to_string(position) + "]: " + message;
+    }
+};
+
+template <typename T>
+class JsonResult {
+public:
+    JsonResult(const T& value) : _data(std::in_place_index<0>, value) {}
+    JsonResult(T&& value) : _data(std::in_place_index<0>, std::move(value)) {}
+
+    JsonResult(const JsonError& error) : _data(std::in_place_index<1>, error) {}
+    JsonResult(JsonError&& error) : _data(std::in_place_index<1>, std::move(error)) {}
+
+    bool has_value() const {
+        return _data.index() == 0;
+    }
+
+    explicit operator bool() const {
+        return has_value();
+    }
+
+    T& value() { return std::get<0>(_data); }
+    const T& value() const { return std::get<0>(_data); }
+
+    T& operator*() { return value(); }
+    const T& operator*() const { return value(); }
+
+    T* operator->() { return &value(); }
+    const T* operator->() const { return &value(); }
+
+    const JsonError& error() const {
+        return std::get<1>(_data);
+    }
+
+private:
+    std::variant<T, JsonError> _data;
+};
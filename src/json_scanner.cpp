@@ -0,0 +1,185 @@
+#include "json_scanner.h"
+#include "json_utf8.h"
+#include <cctype>
+
+bool JsonScanner::expect(char expected) {
+    int ch = peekToken();
+    if (ch != expected) {
+        if (ch == End) {
+            return fail("End of file reached");
+        }
+        return fail(std::string("Expected '") + expected + "' but found '" + char(ch) + "'");
+    }
+    get();
+    return true;
+}
+
+bool JsonScanner::nextItem(char closer, bool& more) {
+    int ch = peekToken();
+    if (ch == ',') {
+        get();
+        more = true;
+        return true;
+    }
+    if (ch == closer) {
+        get();
+        more = false;
+        return true;
+    }
+    if (ch == End) {
+        return fail("End of file reached");
+    }
+    return fail(std::string("Expected ',' or '") + closer + "'");
+}
+
+bool JsonScanner::readString(std::string& out) {
+    out.clear();
+
+    if (!expect('"')) {
+        return false;
+    }
+
+    for (;;) {
+        int ch = get();
+        switch (ch) {
+            case End:
+                return fail("End of file reached");
+            case '"':
+                return true;
+            case '\\':
+                ch = get();
+                switch (ch) {
+                    case '"': out += '"'; break;
+                    case '\\': out += '\\'; break;
+                    case '/': out += '/'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u': {
+                        // Same decoding as JsonParser::parseString
+                        uint32_t code;
+                        if (!readHex(code)) {
+                            return false;
+                        }
+                        if (JsonUtf8::IsHighSurrogate(code)) {
+                            uint32_t low;
+                            if (get() != '\\' || get() != 'u') {
+                                return fail("High surrogate must be followed by a low surrogate");
+                            }
+                            if (!readHex(low)) {
+                                return false;
+                            }
+                            if (!JsonUtf8::IsLowSurrogate(low)) {
+                                return fail("High surrogate must be followed by a low surrogate");
+                            }
+                            code = JsonUtf8::CombineSurrogates(code, low);
+                        } else if (JsonUtf8::IsLowSurrogate(code)) {
+                            return fail("Low surrogate without a preceding high surrogate");
+                        }
+                        JsonUtf8::Append(out, code);
+                        break;
+                    }
+                    default:
+                        return fail("Invalid escape sequence");
+                }
+                break;
+            default:
+                if (ch < 0x20) {
+                    return fail("Invalid control character in string");
+                }
+                out += char(ch);
+                break;
+        }
+    }
+}
+
+bool JsonScanner::readHex(uint32_t& code) {
+    code = 0;
+    for (int i = 0; i < 4; ++i) {
+        int digit = JsonUtf8::HexValue(get());
+        if (digit < 0) {
+            return fail("Invalid unicode hex digit");
+        }
+        code = code * 16 + digit;
+    }
+    return true;
+}
+
+bool JsonScanner::captureValue(std::string& out) {
+    out.clear();
+    _capture = &out;
+    bool ok = skipValue();
+    _capture = nullptr;
+    return ok;
+}
+
+bool JsonScanner::skipString() {
+    take(); // opening '"'
+    for (;;) {
+        int ch = take();
+        if (ch == End) {
+            return fail("End of file reached");
+        }
+        if (ch == '"') {
+            return true;
+        }
+        if (ch == '\\' && take() == End) {
+            return fail("End of file reached");
+        }
+    }
+}
+
+bool JsonScanner::skipValue() {
+    // Closing brackets of the containers we are in; only grows for nested input
+    std::string closers;
+
+    do {
+        int ch = peekToken();
+        switch (ch) {
+            case End:
+                return fail("End of file reached");
+            case '{':
+                take();
+                closers += '}';
+                break;
+            case '[':
+                take();
+                closers += ']';
+                break;
+            case '}':
+            case ']':
+                if (closers.empty() || closers.back() != ch) {
+                    return fail(std::string("Unexpected '") + char(ch) + "'");
+                }
+                take();
+                closers.pop_back();
+                break;
+            case ',':
+            case ':':
+                if (closers.empty()) {
+                    return fail(std::string("Unexpected '") + char(ch) + "'");
+                }
+                take();
+                break;
+            case '"':
+                if (!skipString()) {
+                    return false;
+                }
+                break;
+            default:
+                // Number or literal
+                if (!std::isalnum(ch) && ch != '-') {
+                    return fail(std::string("Unexpected '") + char(ch) + "'");
+                }
+                do {
+                    take();
+                    ch = peek();
+                } while (ch != End && (std::isalnum(ch) || ch == '-' || ch == '+' || ch == '.'));
+                break;
+        }
+    } while (!closers.empty());
+
+    return true;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+
+#include "json_result.h"
+
+/*
+ * Forward-only scanner over a JSON byte stream that never builds nodes.
+ *
+ * It knows byte offsets, so callers can remember where a value starts and
+ * later seek back and hand that range to JsonParser. Values that are not
+ * interesting are skipped without allocation.
+ */
+class JsonScanner {
+public:
+    static constexpr int End = std::char_traits<char>::eof();
+
+    // `in` must be positioned at `offset`
+    JsonScanner(std::istream& in, uint64_t offset = 0)
+        : _buf(in.rdbuf()), _offset(offset) {}
+
+    uint64_t offset() const {
+        return _offset;
+    }
+
+    int peek() {
+        return _buf->sgetc();
+    }
+
+    int get() {
+        int ch = _buf->sbumpc();
+        if (ch != End) {
+            ++_offset;
+        }
+        return ch;
+    }
+
+    // Skips whitespace and returns the next character without consuming it
+    int peekToken() {
+        int ch = peek();
+        while (ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t') {
+            get();
+            ch = peek();
+        }
+        return ch;
+    }
+
+    // Consumes `expected` after optional whitespace
+    bool expect(char expected);
+
+    // Reads a string token (escapes decoded) starting at '"'
+    bool readString(std::string& out);
+
+    // Skips one complete value of any type
+    bool skipValue();
+
+    // Skips one value like skipValue, storing its text in `out` with the
+    // whitespace between tokens left out
+    bool captureValue(std::string& out);
+
+    // Consumes the ',' or the `closer` that follows an item of a container.
+    // `more` tells whether another item follows.
+    bool nextItem(char closer, bool& more);
+
+    bool fail(const std::string& message) {
+        if (!_failed) {
+            _failed = true;
+            _error = JsonError{ message, _offset };
+        }
+        return false;
+    }
+
+    const JsonError& error() const {
+        return _error;
+    }
+
+private:
+    // get() that also appends to the capture, if any
+    int take() {
+        int ch = get();
+        if (_capture && ch != End) {
+            _capture->push_back(char(ch));
+        }
+        return ch;
+    }
+
+    bool skipString();
+
+    // Reads the 4 hex digits of a \u escape
+    bool readHex(uint32_t& code);
+
+    std::streambuf* _buf;
+    uint64_t _offset;
+
+    std::string* _capture = nullptr;
+
+    bool _failed = false;
+    JsonError _error;
+};
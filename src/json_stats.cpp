@@ -0,0 +1,96 @@
+#include "json_stats.h"
+#include <mutex>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+namespace {
+
+std::mutex s_totalMutex;
+JsonStats::Counters s_total;
+
+// Folds a thread's counters into the global total when the thread exits.
+struct ThreadCounters {
+    JsonStats::Counters counters;
+
+    ~ThreadCounters() {
+        std::lock_guard<std::mutex> lock(s_totalMutex);
+        s_total.merge(counters);
+    }
+};
+
+thread_local ThreadCounters t_counters;
+
+const char* s_phaseNames[] = { "open", "parse", "eval", "print", "destroy" };
+const char* s_nodeNames[] = { "object", "array", "string", "number", "boolean", "null" };
+
+} // namespace
+
+
+void JsonStats::Counters::merge(const Counters& other) {
+    bytesRead += other.bytesRead;
+    for (int i = 0; i < (int)Node::Count; ++i) {
+        nodes[i] += other.nodes[i];
+    }
+    stringsAllocated += other.stringsAllocated;
+    keysAllocated += other.keysAllocated;
+    hashLookups += other.hashLookups;
+    for (int i = 0; i < (int)Phase::Count; ++i) {
+        phaseNs[i] += other.phaseNs[i];
+    }
+}
+
+JsonStats::Counters& JsonStats::Local() {
+    return t_counters.counters;
+}
+
+void JsonStats::Report(std::ostream& os) {
+    Counters total;
+    {
+        std::lock_guard<std::mutex> lock(s_totalMutex);
+        s_total.merge(t_counters.counters);
+        t_counters.counters = Counters();
+        total = s_total;
+    }
+
+    os << "{\"phases_ms\": {";
+    for (int i = 0; i < (int)Phase::Count; ++i) {
+        os << (i ? ", " : "") << "\"" << s_phaseNames[i] << "\": " << total.phaseNs[i] / 1e6;
+    }
+    os << "}, \"bytes_read\": " << total.bytesRead << ", \"nodes\": {";
+    for (int i = 0; i < (int)Node::Count; ++i) {
+        os << (i ? ", " : "") << "\"" << s_nodeNames[i] << "\": " << total.nodes[i];
+    }
+    os << "}, \"strings_allocated\": " << total.stringsAllocated
+       << ", \"keys_allocated\": " << total.keysAllocated
+       << ", \"hash_lookups\": " << total.hashLookups
+       << ", \"peak_memory_bytes\": " << PeakMemory()
+       << "}" << std::endl;
+}
+
+uint64_t JsonStats::PeakMemory() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+        return pmc.PeakWorkingSetSize;
+    }
+    return 0;
+#elif defined(__unix__) || defined(__APPLE__)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return usage.ru_maxrss; // bytes on macOS
+#else
+    return (uint64_t)usage.ru_maxrss * 1024; // kilobytes on Linux
+#endif
+#else
+    return 0;
+#endif
+}
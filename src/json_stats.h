@@ -0,0 +1,89 @@
+#pragma once
+
+#include <iostream>
+#include <chrono>
+#include <cstdint>
+
+/*
+ * Low-overhead instrumentation for the --stats flag.
+ *
+ * Everything here is compiled out unless JSON_EVAL_STATS is defined (see the
+ * JSON_EVAL_STATS option in CMakeLists.txt). Code outside this header should
+ * only use the JSON_STATS_* macros so that disabled builds carry no cost.
+ *
+ * Counters are kept per thread and merged into a global total when a thread
+ * exits or when Report() is called, so hot paths never touch shared cache lines.
+ */
+
+class JsonStats {
+public:
+    enum class Phase {
+        Open,
+        Parse,
+        Eval,
+        Print,
+        Destroy,
+        Count
+    };
+
+    enum class Node {
+        Object,
+        Array,
+        String,
+        Number,
+        Boolean,
+        Null,
+        Count
+    };
+
+    struct Counters {
+        uint64_t bytesRead = 0;
+        uint64_t nodes[(int)Node::Count] = {};
+        uint64_t stringsAllocated = 0; // string values with heap text: long, not interned
+        uint64_t keysAllocated = 0;
+        uint64_t hashLookups = 0;
+
+        uint64_t phaseNs[(int)Phase::Count] = {};
+
+        void merge(const Counters& other);
+    };
+
+    class ScopedPhase {
+    public:
+        ScopedPhase(Phase phase)
+            : _phase(phase), _start(std::chrono::steady_clock::now()) {}
+
+        ~ScopedPhase() {
+            auto elapsed = std::chrono::steady_clock::now() - _start;
+            Local().phaseNs[(int)_phase] +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        }
+
+    private:
+        Phase _phase;
+        std::chrono::steady_clock::time_point _start;
+    };
+
+    // Counters of the calling thread.
+    static Counters& Local();
+
+    // Merges the calling thread's counters and writes the totals as JSON.
+    static void Report(std::ostream& os);
+
+    // Peak resident set size of the process in bytes, 0 if unknown.
+    static uint64_t PeakMemory();
+};
+
+#ifdef JSON_EVAL_STATS
+#define JSON_STATS_CONCAT_IMPL(a, b) a##b
+#define JSON_STATS_CONCAT(a, b) JSON_STATS_CONCAT_IMPL(a, b)
+
+#define JSON_STATS_ADD(counter, n) (JsonStats::Local().counter += (n))
+#define JSON_STATS_NODE(type) (++JsonStats::Local().nodes[(int)JsonStats::Node::type])
+#define JSON_STATS_PHASE(phase) \
+    JsonStats::ScopedPhase JSON_STATS_CONCAT(_jsonStatsPhase, __LINE__)(JsonStats::Phase::phase)
+#else
+#define JSON_STATS_ADD(counter, n) ((void)0)
+#define JSON_STATS_NODE(type) ((void)0)
+#define JSON_STATS_PHASE(phase) ((void)0)
+#endif
@@ -0,0 +1,221 @@
+#include "json_strings.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JSON_STRINGS_SIMD
+#include <immintrin.h>
+#endif
+
+#if defined(JSON_STRINGS_SIMD) && (defined(__GNUC__) || defined(__clang__))
+#define JSON_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define JSON_TARGET_AVX2
+#endif
+
+namespace {
+
+constexpr size_t npos = std::string_view::npos;
+
+#ifdef JSON_STRINGS_SIMD
+
+// First/last byte filter over 16 candidate positions per step (needles of at
+// least two bytes). Advances `i` past the positions it has ruled out.
+size_t findSse2(const char* s, size_t n, const char* needle, size_t k, size_t& i) {
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[k - 1]);
+    for (; i + k - 1 + 16 <= n; i += 16) {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i + k - 1));
+        unsigned mask = unsigned(_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(first, blockFirst), _mm_cmpeq_epi8(last, blockLast))));
+        while (mask != 0) {
+            size_t at = i + std::countr_zero(mask);
+            if (std::memcmp(s + at + 1, needle + 1, k - 2) == 0) {
+                return at;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return npos;
+}
+
+// Same with 32 positions per step
+JSON_TARGET_AVX2
+size_t findAvx2(const char* s, size_t n, const char* needle, size_t k, size_t& i) {
+    const __m256i first = _mm256_set1_epi8(needle[0]);
+    const __m256i last = _mm256_set1_epi8(needle[k - 1]);
+    for (; i + k - 1 + 32 <= n; i += 32) {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(s + i + k - 1));
+        unsigned mask = unsigned(_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast))));
+        while (mask != 0) {
+            size_t at = i + std::countr_zero(mask);
+            if (std::memcmp(s + at + 1, needle + 1, k - 2) == 0) {
+                return at;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return npos;
+}
+
+bool hasAvx2() {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+#endif // JSON_STRINGS_SIMD
+
+bool isContinuation(char ch) {
+    return ((unsigned char)ch & 0xC0) == 0x80;
+}
+
+// End of the code point starting at `pos`
+size_t nextCodePoint(std::string_view text, size_t pos) {
+    unsigned char lead = (unsigned char)text[pos];
+    size_t length = lead < 0xC0 ? 1 : lead < 0xE0 ? 2 : lead < 0xF0 ? 3 : 4;
+    return std::min(pos + length, text.size());
+}
+
+// End of the match of a '*'-free pattern segment starting at `pos`, or npos
+size_t matchSegment(std::string_view text, size_t pos, std::string_view segment) {
+    for (char ch : segment) {
+        if (pos >= text.size()) {
+            return npos;
+        }
+        if (ch == '?') {
+            pos = nextCodePoint(text, pos);
+        } else if (text[pos] == ch) {
+            ++pos;
+        } else {
+            return npos;
+        }
+    }
+    return pos;
+}
+
+// End of the leftmost match of a segment at or after `pos`, or npos. A
+// segment covers a fixed number of code points, so the leftmost match also
+// ends first, which is all the segments after it need.
+size_t findSegment(std::string_view text, size_t pos, std::string_view segment) {
+    if (segment.find('?') == npos) {
+        size_t at = JsonStrings::Find(text.substr(pos), segment);
+        return at == npos ? npos : pos + at + segment.size();
+    }
+    for (size_t start = pos; start < text.size(); ++start) {
+        if (isContinuation(text[start])) {
+            continue;
+        }
+        size_t end = matchSegment(text, start, segment);
+        if (end != npos) {
+            return end;
+        }
+    }
+    return npos;
+}
+
+} // namespace
+
+
+size_t JsonStrings::Find(std::string_view haystack, std::string_view needle) {
+    const char* s = haystack.data();
+    size_t n = haystack.size();
+    size_t k = needle.size();
+
+    if (k == 0) {
+        return 0;
+    }
+    if (k > n) {
+        return npos;
+    }
+    if (k == 1) {
+        const void* at = std::memchr(s, needle[0], n);
+        return at ? size_t(static_cast<const char*>(at) - s) : npos;
+    }
+
+    size_t i = 0;
+#ifdef JSON_STRINGS_SIMD
+    static const bool s_avx2 = hasAvx2();
+    size_t found = s_avx2 ? findAvx2(s, n, needle.data(), k, i)
+                          : findSse2(s, n, needle.data(), k, i);
+    if (found != npos) {
+        return found;
+    }
+#endif
+    // Positions too close to the end for a full block
+    size_t at = haystack.substr(i).find(needle);
+    return at == npos ? npos : i + at;
+}
+
+bool JsonStrings::Match(std::string_view text, std::string_view pattern) {
+    size_t firstStar = pattern.find('*');
+    if (firstStar == npos) {
+        return matchSegment(text, 0, pattern) == text.size();
+    }
+
+    // Before the first '*': anchored at the start
+    size_t pos = matchSegment(text, 0, pattern.substr(0, firstStar));
+    if (pos == npos) {
+        return false;
+    }
+
+    // Between stars: leftmost match each
+    size_t lastStar = pattern.rfind('*');
+    for (size_t i = firstStar + 1; i <= lastStar;) {
+        size_t next = pattern.find('*', i);
+        std::string_view segment = pattern.substr(i, next - i);
+        i = next + 1;
+        if (!segment.empty()) {
+            pos = findSegment(text, pos, segment);
+            if (pos == npos) {
+                return false;
+            }
+        }
+    }
+
+    // After the last '*': anchored at the end, past everything matched so far
+    std::string_view tail = pattern.substr(lastStar + 1);
+    if (tail.find('?') == npos) {
+        return text.size() - pos >= tail.size() && EndsWith(text, tail);
+    }
+    for (size_t start = pos; start <= text.size(); ++start) {
+        if (start < text.size() && isContinuation(text[start])) {
+            continue;
+        }
+        if (matchSegment(text, start, tail) == text.size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string JsonStrings::Lower(std::string_view text) {
+    std::string result(text);
+    char* p = result.data();
+    size_t n = result.size();
+    size_t i = 0;
+#ifdef JSON_STRINGS_SIMD
+    // Signed compares keep bytes >= 0x80 out of the 'A'..'Z' range
+    const __m128i belowA = _mm_set1_epi8('A' - 1);
+    const __m128i aboveZ = _mm_set1_epi8('Z' + 1);
+    const __m128i bit = _mm_set1_epi8(0x20);
+    for (; i + 16 <= n; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(chunk, belowA), _mm_cmplt_epi8(chunk, aboveZ));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(p + i), _mm_or_si128(chunk, _mm_and_si128(upper, bit)));
+    }
+#endif
+    for (; i < n; ++i) {
+        if (p[i] >= 'A' && p[i] <= 'Z') {
+            p[i] = char(p[i] | 0x20);
+        }
+    }
+    return result;
+}
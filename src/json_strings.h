@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+/*
+ * String intrinsics of JsonEval: contains, startsWith, endsWith, lower and
+ * glob matching.
+ *
+ * Substring search compares the first and the last byte of the needle
+ * against 16 (SSE2) or 32 (AVX2) positions of the haystack at once and only
+ * verifies the positions where both match, so the common case of a rare
+ * match costs about one pass over the bytes. AVX2 is picked at run time.
+ */
+class JsonStrings {
+public:
+    // Byte offset of the first occurrence of `needle`, or npos
+    static size_t Find(std::string_view haystack, std::string_view needle);
+
+    static bool Contains(std::string_view text, std::string_view needle) {
+        return Find(text, needle) != std::string_view::npos;
+    }
+
+    static bool StartsWith(std::string_view text, std::string_view prefix) {
+        return text.substr(0, prefix.size()) == prefix;
+    }
+
+    static bool EndsWith(std::string_view text, std::string_view suffix) {
+        return text.size() >= suffix.size() && text.substr(text.size() - suffix.size()) == suffix;
+    }
+
+    // Whole-string glob match: '*' matches any sequence, '?' one character
+    // (a UTF-8 code point), everything else itself
+    static bool Match(std::string_view text, std::string_view pattern);
+
+    // ASCII letters lowered, all other bytes kept
+    static std::string Lower(std::string_view text);
+};
@@ -2,22 +2,42 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <memory>
+#include <variant>
 #include <assert.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include "json_persistent.h"
 
 // #define JSON_VALUE_PRINT_NL
 
+enum class JsonType {
+    Object,
+    Array,
+    String,
+    Number,
+    Boolean,
+    Null
+};
+
 class JsonValue {
 public:
     
     virtual void print(std::ostream& os) const = 0;
 
+    virtual JsonType type() const = 0;
+
     virtual ~JsonValue() = default;
 
 protected:
-    static int s_LogDepth;
+    // Per thread, so that results can be printed concurrently
+    static thread_local int s_LogDepth;
 
 #ifdef JSON_VALUE_PRINT_NL    
     static inline std::string NLSep() {
@@ -40,149 +60,124 @@ protected:
     }
 };
 
-class JsonString;
-
-
-class JsonObject : public JsonValue {
+/*
+ * Text of up to ShortLength bytes is stored in the object itself, longer text
+ * in a heap buffer of exactly its size. That keeps a JsonString as small as a
+ * JsonNumber, so neither makes a JsonSlot any larger than the other.
+ */
+class JsonString : public JsonValue {
 public:
-    void add(const std::string& key, std::shared_ptr<JsonValue> value) {
-        _map[key] = value;
-    }
+    static constexpr size_t ShortLength = 15;
 
-    std::shared_ptr<JsonValue> get(const std::string& key) const {
-        auto it = _map.find(key);
-        if (it != _map.end()) {
-            return it->second;
-        }
-        return nullptr;
+    JsonString() {
+        setShort(0);
     }
 
-    void remove(const std::string& key) {
-        _map.erase(key);
+    JsonString(std::string_view value) {
+        assign(value);
     }
 
-    bool contains(const std::string& key) const {
-        return _map.find(key) != _map.end();
-    }
-
-    void print(std::ostream& os) const override {
-        ++s_LogDepth;
-        os << "{" << NLSep();
-        
-        for (auto it = _map.begin(); it != _map.end(); ++it) {
-            if (it != _map.begin()) {
-                os << "," << NLSep();
-            }
-            os << "\"" << it->first << "\": ";
+    JsonString(const std::string& value) : JsonString(std::string_view(value)) {}
 
-            std::shared_ptr<JsonString> strPtr = std::dynamic_pointer_cast<JsonString>(it->second);
-            if (strPtr) { // if is string enclose in double quotes
-                os << "\"" << *(it->second) << "\"";
-            } else {
-                os << *(it->second);
-            }
-        }
-        --s_LogDepth;
-        os << NLSep() << "}";
+    JsonString(const JsonString& other) : JsonValue() {
+        assign(other.value());
     }
 
-private:
-    std::unordered_map<std::string, std::shared_ptr<JsonValue>> _map;
-};
-
+    JsonString(JsonString&& other) noexcept : JsonValue() {
+        take(other);
+    }
 
-class JsonArray : public JsonValue {
-public:
-    void add(std::shared_ptr<JsonValue> value) {
-        _array.push_back(value);
+    ~JsonString() override {
+        release();
     }
 
-    std::shared_ptr<JsonValue> get(size_t index) const {
-        if (index < _array.size()) {
-            return _array[index];
+    JsonString& operator=(const JsonString& other) {
+        if (this != &other) {
+            release();
+            assign(other.value());
         }
-        return nullptr;
+        return *this;
     }
 
-    void remove(size_t index) {
-        if (index < _array.size()) {
-            _array.erase(_array.begin() + index);
+    JsonString& operator=(JsonString&& other) noexcept {
+        if (this != &other) {
+            release();
+            take(other);
         }
+        return *this;
     }
 
-    size_t size() const {
-        return _array.size();
+    JsonType type() const override {
+        return JsonType::String;
     }
 
     void print(std::ostream& os) const override {
-        ++s_LogDepth;
-        os << "[" << NLSep();
-        
-        for (size_t i = 0; i < _array.size(); ++i) {
-            if (i > 0) {
-                os << "," << NLSep();
-            }
-
-            std::shared_ptr<JsonString> strPtr = std::dynamic_pointer_cast<JsonString>(_array[i]);
-            if (strPtr) { // if is string enclose in double quotes
-                os << "\"" << *(_array[i]) << "\"";
-            } else {
-                os << *(_array[i]);
-            }
-            
-        }
-        --s_LogDepth;
-        os << NLSep() << "]";
+        os << value();
     }
 
-private:
-    std::vector<std::shared_ptr<JsonValue>> _array;
-};
-
-
-class JsonString : public JsonValue {
-public:
-    JsonString() = default;
-
-    JsonString(const std::string& value) : _value(value) {}
+    bool empty() const {
+        return value().empty();
+    }
 
-    
-    JsonString(const JsonString& other) : _value(other._value) {}
+    operator std::string() const {
+        return std::string(value());
+    }
 
-   
-    JsonString& operator=(const JsonString& other) {
-        if (this != &other) {
-            _value = other._value;
+    std::string_view value() const {
+        if (!isLong()) {
+            return std::string_view(_bytes, (unsigned char)_bytes[ShortLength]);
         }
-        return *this;
+        char* data;
+        uint32_t size;
+        std::memcpy(&data, _bytes, sizeof(data));
+        std::memcpy(&size, _bytes + sizeof(data), sizeof(size));
+        return std::string_view(data, size);
     }
 
-    // += operator
-    JsonString& operator+=(const std::string& other) {
-        _value += other;
-        return *this;
-    }
+private:
+    // Short: the text, and its size in the last byte.
+    // Long: the buffer and its size, and s_long in the last byte.
+    static constexpr unsigned char s_long = 0xFF;
+    static_assert(sizeof(char*) + sizeof(uint32_t) <= ShortLength);
 
-    JsonString& operator+=(char ch) {
-        _value += ch;
-        return *this;
+    bool isLong() const {
+        return (unsigned char)_bytes[ShortLength] == s_long;
     }
 
+    void setShort(size_t size) {
+        _bytes[ShortLength] = char(size);
+    }
 
-    void print(std::ostream& os) const override {
-        os << _value;
+    void assign(std::string_view value) {
+        if (value.size() <= ShortLength) {
+            std::copy(value.begin(), value.end(), _bytes);
+            setShort(value.size());
+            return;
+        }
+        if (value.size() > UINT32_MAX) {
+            throw std::length_error("String exceeds 4 GiB");
+        }
+        char* data = new char[value.size()];
+        std::copy(value.begin(), value.end(), data);
+        uint32_t size = uint32_t(value.size());
+        std::memcpy(_bytes, &data, sizeof(data));
+        std::memcpy(_bytes + sizeof(data), &size, sizeof(size));
+        _bytes[ShortLength] = char(s_long);
     }
 
-    bool empty() {
-        return _value.empty();
+    void take(JsonString& other) {
+        std::memcpy(_bytes, other._bytes, sizeof(_bytes));
+        other.setShort(0);
     }
 
-    operator std::string() const {
-        return _value;
+    void release() {
+        if (isLong()) {
+            delete[] value().data();
+            setShort(0);
+        }
     }
 
-private:
-    std::string _value;
+    alignas(char*) char _bytes[ShortLength + 1];
 };
 
 
@@ -197,6 +192,10 @@ public:
     JsonNumber(double value) 
         : _value(value), _isInteger(false) {}
 
+    JsonType type() const override {
+        return JsonType::Number;
+    }
+
     void print(std::ostream& os) const override {
         if (_isInteger) {
             os << int(_value);
@@ -205,7 +204,7 @@ public:
         }
     }
 
-    bool isInteger() {
+    bool isInteger() const {
         return _isInteger;
     }
 
@@ -213,6 +212,10 @@ public:
         return _value;
     }
 
+    double value() const {
+        return _value;
+    }
+
 private:
     bool _isInteger;
 
@@ -224,10 +227,30 @@ class JsonBoolean : public JsonValue {
 public:
     JsonBoolean(bool value) : _value(value) {}
 
+    // Immutable shared instances. The returned pointers own nothing, so copying
+    // them never touches a reference count.
+    static std::shared_ptr<JsonValue> True() {
+        static JsonBoolean s_true(true);
+        return std::shared_ptr<JsonValue>(std::shared_ptr<JsonValue>(), &s_true);
+    }
+
+    static std::shared_ptr<JsonValue> False() {
+        static JsonBoolean s_false(false);
+        return std::shared_ptr<JsonValue>(std::shared_ptr<JsonValue>(), &s_false);
+    }
+
+    JsonType type() const override {
+        return JsonType::Boolean;
+    }
+
     void print(std::ostream& os) const override {
         os << (_value ? "true" : "false");
     }
 
+    bool value() const {
+        return _value;
+    }
+
 private:
     bool _value;
 };
@@ -235,7 +258,450 @@ private:
 
 class JsonNull : public JsonValue {
 public:
+    JsonType type() const override {
+        return JsonType::Null;
+    }
+
+    // Immutable shared instance, see JsonBoolean::True()
+    static std::shared_ptr<JsonValue> Instance() {
+        static JsonNull s_null;
+        return std::shared_ptr<JsonValue>(std::shared_ptr<JsonValue>(), &s_null);
+    }
+
     void print(std::ostream& os) const override {
         os << "null";
     }
-};
\ No newline at end of file
+};
+
+
+// Element of JsonObject and JsonArray. Numbers and strings are stored inline
+// (strings of up to JsonString::ShortLength bytes entirely so) instead of as
+// separate heap nodes with their own shared_ptr control block. Either takes
+// 24 bytes, as a JsonValue that get() can point to, so a slot is 32 bytes
+// with the tag.
+class JsonSlot {
+public:
+    JsonSlot() = default;
+
+    JsonSlot(std::shared_ptr<JsonValue> value) : _value(std::move(value)) {}
+
+    JsonSlot(const JsonNumber& number) : _value(number) {}
+
+    JsonSlot(JsonString&& str) : _value(std::move(str)) {}
+
+    // Borrowed pointer, valid as long as the slot is
+    const JsonValue* get() const {
+        if (auto node = std::get_if<std::shared_ptr<JsonValue>>(&_value)) {
+            return node->get();
+        }
+        if (auto number = std::get_if<JsonNumber>(&_value)) {
+            return number;
+        }
+        return &std::get<JsonString>(_value);
+    }
+
+    // Owning pointer. Inline values are copied into a new node.
+    std::shared_ptr<JsonValue> share() const {
+        if (auto node = std::get_if<std::shared_ptr<JsonValue>>(&_value)) {
+            return *node;
+        }
+        if (auto number = std::get_if<JsonNumber>(&_value)) {
+            return std::make_shared<JsonNumber>(*number);
+        }
+        return std::make_shared<JsonString>(std::get<JsonString>(_value));
+    }
+
+    bool isInline() const {
+        return !std::holds_alternative<std::shared_ptr<JsonValue>>(_value);
+    }
+
+    // The number stored inline, or null
+    const JsonNumber* number() const {
+        return std::get_if<JsonNumber>(&_value);
+    }
+
+    const JsonValue& operator*() const {
+        return *get();
+    }
+
+    const JsonValue* operator->() const {
+        return get();
+    }
+
+private:
+    std::variant<std::shared_ptr<JsonValue>, JsonNumber, JsonString> _value;
+};
+
+
+// Key whose hash was computed ahead of time, e.g. by a compile-time JsonPath
+struct JsonHashedKey {
+    std::string_view key;
+    size_t hash;
+
+    friend bool operator==(const std::string& lhs, const JsonHashedKey& rhs) {
+        return lhs == rhs.key;
+    }
+};
+
+// Lets JsonObject be searched by std::string_view without building a std::string key.
+// FNV-1a, so key hashes can also be computed at compile time.
+struct JsonKeyHash {
+    using is_transparent = void;
+
+    static constexpr size_t Hash(std::string_view key) {
+        uint64_t hash = 14695981039346656037ull;
+        for (char ch : key) {
+            hash = (hash ^ (unsigned char)ch) * 1099511628211ull;
+        }
+        return size_t(hash);
+    }
+
+    size_t operator()(std::string_view key) const {
+        return Hash(key);
+    }
+
+    size_t operator()(const JsonHashedKey& key) const {
+        return key.hash;
+    }
+};
+
+
+/*
+ * Members are kept in a JsonMap, so copies of an object share their storage
+ * until one of them changes (see JsonDocument).
+ */
+class JsonObject : public JsonValue {
+public:
+    using Members = JsonMap<JsonSlot, JsonKeyHash>;
+
+    JsonType type() const override {
+        return JsonType::Object;
+    }
+
+    void add(const std::string& key, std::shared_ptr<JsonValue> value) {
+        add(key, JsonSlot(std::move(value)));
+    }
+
+    void add(const std::string& key, JsonSlot&& value) {
+        _map.set(key, std::move(value));
+        _hash = 0;
+    }
+
+    std::shared_ptr<JsonValue> get(const std::string& key) const {
+        const JsonSlot* slot = _map.find(key);
+        return slot ? slot->share() : nullptr;
+    }
+
+    // Borrowed pointer, no reference counting. Valid as long as the object is.
+    const JsonValue* find(std::string_view key) const {
+        const JsonSlot* slot = _map.find(key);
+        return slot ? slot->get() : nullptr;
+    }
+
+    const JsonValue* find(const JsonHashedKey& key) const {
+        const JsonSlot* slot = _map.find(key.key, key.hash);
+        return slot ? slot->get() : nullptr;
+    }
+
+    void remove(const std::string& key) {
+        if (_map.erase(key)) {
+            _hash = 0;
+        }
+    }
+
+    bool contains(const std::string& key) const {
+        return _map.find(key) != nullptr;
+    }
+
+    size_t size() const {
+        return _map.size();
+    }
+
+    // Iterates (key, slot) pairs
+    const Members& members() const {
+        return _map;
+    }
+
+    // Structural hash stored by the parser or JsonHash, 0 if not computed.
+    // Any change to the members clears it.
+    uint64_t hash() const {
+        return _hash;
+    }
+
+    void setHash(uint64_t hash) {
+        _hash = hash;
+    }
+
+    void print(std::ostream& os) const override {
+        ++s_LogDepth;
+        os << "{" << NLSep();
+        
+        for (auto it = _map.begin(); it != _map.end(); ++it) {
+            if (it != _map.begin()) {
+                os << "," << NLSep();
+            }
+            os << "\"" << it->first << "\": ";
+
+            if (it->second->type() == JsonType::String) { // if is string enclose in double quotes
+                os << "\"" << *(it->second) << "\"";
+            } else {
+                os << *(it->second);
+            }
+        }
+        --s_LogDepth;
+        os << NLSep() << "}";
+    }
+
+private:
+    Members _map;
+
+    uint64_t _hash = 0;
+};
+
+
+/*
+ * Arrays of numbers only are stored packed: as int32_t while every element is
+ * an integer (JsonNumber integers are ints), as double once one is not. That
+ * is 4 or 8 bytes per element instead of a JsonSlot, in leaves of up to 8 KiB
+ * that numeric code can scan directly.
+ * Adding or setting anything but a number moves the array to general storage
+ * for good. Either way the elements are kept in a JsonVector, so copies of an
+ * array share their storage until one of them changes.
+ *
+ * Every element keeps the integer-ness it was parsed with, as in general
+ * storage: [1, 2.5] is stored as doubles plus a flag that the first one is an
+ * integer, and [1.0] stays a double. Packed elements are not nodes:
+ * number() returns them by value and at() has no pointer to hand out, so
+ * readers that need one box the number in storage of their own (see
+ * JsonEval::Cursor).
+ */
+class JsonArray : public JsonValue {
+public:
+    enum class Storage {
+        Slots,    // elements()
+        Integers, // integers()
+        Doubles   // doubles()
+    };
+
+    JsonArray() = default;
+
+    JsonType type() const override {
+        return JsonType::Array;
+    }
+
+    void add(std::shared_ptr<JsonValue> value) {
+        add(JsonSlot(std::move(value)));
+    }
+
+    void add(JsonSlot&& value) {
+        const JsonNumber* number = value.number();
+        if (auto slots = std::get_if<JsonVector<JsonSlot>>(&_elements)) {
+            if (number && slots->empty()) {
+                pack(*number, slots->capacity());
+            } else {
+                slots->push_back(std::move(value));
+            }
+        } else if (!number) {
+            unpack().push_back(std::move(value));
+        } else if (auto integers = std::get_if<JsonVector<int32_t>>(&_elements); integers && number->isInteger()) {
+            integers->push_back(int(*number));
+        } else {
+            toDoubles().push_back(number->value());
+            setInteger(size() - 1, number->isInteger());
+        }
+        changed();
+    }
+
+    void reserve(size_t size) {
+        std::visit([size](auto& elements) { elements.reserve(size); }, _elements);
+    }
+
+    std::shared_ptr<JsonValue> get(size_t index) const {
+        if (index >= size()) {
+            return nullptr;
+        }
+        if (auto slots = std::get_if<JsonVector<JsonSlot>>(&_elements)) {
+            return (*slots)[index].share();
+        }
+        return std::make_shared<JsonNumber>(number(index));
+    }
+
+    // Borrowed pointer, no reference counting. Valid as long as the array is.
+    // Null if `index` is out of range or the array is packed, see number().
+    const JsonValue* at(size_t index) const {
+        auto slots = std::get_if<JsonVector<JsonSlot>>(&_elements);
+        if (!slots || index >= slots->size()) {
+            return nullptr;
+        }
+        return (*slots)[index].get();
+    }
+
+    // Element `index` of a packed array, by value
+    JsonNumber number(size_t index) const {
+        if (auto integers = std::get_if<JsonVector<int32_t>>(&_elements)) {
+            return JsonNumber(int((*integers)[index]));
+        }
+        double value = std::get<JsonVector<double>>(_elements)[index];
+        return isInteger(index) ? JsonNumber(int(value)) : JsonNumber(value);
+    }
+
+    void set(size_t index, JsonSlot&& value) {
+        if (index >= size()) {
+            return;
+        }
+        const JsonNumber* number = value.number();
+        if (auto slots = std::get_if<JsonVector<JsonSlot>>(&_elements)) {
+            slots->set(index, std::move(value));
+        } else if (!number) {
+            unpack().set(index, std::move(value));
+        } else if (auto integers = std::get_if<JsonVector<int32_t>>(&_elements); integers && number->isInteger()) {
+            integers->set(index, int(*number));
+        } else {
+            toDoubles().set(index, number->value());
+            setInteger(index, number->isInteger());
+        }
+        changed();
+    }
+
+    void remove(size_t index) {
+        if (index < size()) {
+            std::visit([index](auto& elements) { elements.erase(index); }, _elements);
+            if (!_integers.empty()) {
+                _integers.erase(index);
+            }
+            changed();
+        }
+    }
+
+    size_t size() const {
+        return std::visit([](const auto& elements) { return elements.size(); }, _elements);
+    }
+
+    Storage storage() const {
+        return Storage(_elements.index());
+    }
+
+    bool isPacked() const {
+        return storage() != Storage::Slots;
+    }
+
+    // The elements in general storage. Throws std::bad_variant_access for a
+    // packed array, see storage().
+    const JsonVector<JsonSlot>& elements() const {
+        return std::get<JsonVector<JsonSlot>>(_elements);
+    }
+
+    // The packed elements, or null if the array is stored differently
+    const JsonVector<int32_t>* integers() const {
+        return std::get_if<JsonVector<int32_t>>(&_elements);
+    }
+
+    const JsonVector<double>* doubles() const {
+        return std::get_if<JsonVector<double>>(&_elements);
+    }
+
+    // Heap bytes of the element storage, see JsonVector::storageBytes()
+    template <typename NodeBytes, typename BufferBytes>
+    uint64_t storageBytes(const NodeBytes& node, const BufferBytes& buffer) const {
+        return std::visit([&](const auto& elements) { return elements.storageBytes(node, buffer); }, _elements)
+            + _integers.storageBytes(node, buffer);
+    }
+
+    // See JsonObject::hash()
+    uint64_t hash() const {
+        return _hash;
+    }
+
+    void setHash(uint64_t hash) {
+        _hash = hash;
+    }
+
+    void print(std::ostream& os) const override {
+        ++s_LogDepth;
+        os << "[" << NLSep();
+        
+        const auto* slots = std::get_if<JsonVector<JsonSlot>>(&_elements);
+        for (size_t i = 0; i < size(); ++i) {
+            if (i > 0) {
+                os << "," << NLSep();
+            }
+
+            if (!slots) {
+                number(i).print(os);
+            } else if ((*slots)[i]->type() == JsonType::String) { // if is string enclose in double quotes
+                os << "\"" << *(*slots)[i] << "\"";
+            } else {
+                os << *(*slots)[i];
+            }
+            
+        }
+        --s_LogDepth;
+        os << NLSep() << "]";
+    }
+
+private:
+    // The first number of an empty array picks the packed storage
+    void pack(const JsonNumber& number, size_t capacity) {
+        if (number.isInteger()) {
+            JsonVector<int32_t> integers;
+            integers.reserve(capacity);
+            integers.push_back(int(number));
+            _elements = std::move(integers);
+        } else {
+            JsonVector<double> doubles;
+            doubles.reserve(capacity);
+            doubles.push_back(number.value());
+            _elements = std::move(doubles);
+            _integers.clear();
+        }
+    }
+
+    JsonVector<JsonSlot>& unpack() {
+        JsonVector<JsonSlot> slots;
+        slots.reserve(size());
+        for (size_t i = 0; i < size(); ++i) {
+            slots.push_back(JsonSlot(number(i)));
+        }
+        _integers.clear();
+        return _elements.emplace<JsonVector<JsonSlot>>(std::move(slots));
+    }
+
+    JsonVector<double>& toDoubles() {
+        if (auto integers = std::get_if<JsonVector<int32_t>>(&_elements)) {
+            JsonVector<double> doubles;
+            doubles.reserve(integers->size());
+            _integers.clear();
+            for (int32_t integer : *integers) {
+                doubles.push_back(double(integer));
+                _integers.push_back(true);
+            }
+            return _elements.emplace<JsonVector<double>>(std::move(doubles));
+        }
+        return std::get<JsonVector<double>>(_elements);
+    }
+
+    // Element `index` of a double array is an integer
+    bool isInteger(size_t index) const {
+        return !_integers.empty() && _integers[index];
+    }
+
+    void setInteger(size_t index, bool integer) {
+        if (integer || !_integers.empty()) {
+            while (_integers.size() < size()) {
+                _integers.push_back(false);
+            }
+            _integers.set(index, integer);
+        }
+    }
+
+    void changed() {
+        _hash = 0;
+    }
+
+    std::variant<JsonVector<JsonSlot>, JsonVector<int32_t>, JsonVector<double>> _elements;
+
+    // Of a double array, which elements are integers; empty while none is
+    JsonVector<uint8_t> _integers;
+
+    uint64_t _hash = 0;
+};
@@ -0,0 +1,255 @@
+#include "json_utf8.h"
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define JSON_UTF8_SIMD
+#include <immintrin.h>
+#endif
+
+#if defined(JSON_UTF8_SIMD) && (defined(__GNUC__) || defined(__clang__))
+#define JSON_TARGET_SSSE3 __attribute__((target("ssse3")))
+#else
+#define JSON_TARGET_SSSE3
+#endif
+
+namespace {
+
+#ifdef JSON_UTF8_SIMD
+
+// Error classes of a byte pair (Keiser and Lemire, table 8). A pair is invalid
+// if the three lookups below share a bit.
+constexpr char TooShort = 1 << 0;   // 11______ 0_______ or 11______ 11______
+constexpr char TooLong = 1 << 1;    // 0_______ 10______
+constexpr char Overlong3 = 1 << 2;  // 11100000 100_____
+constexpr char TooLarge = 1 << 3;   // 11110100 1001____, 11110100 101_____, 11110101+
+constexpr char Surrogate = 1 << 4;  // 11101101 101_____
+constexpr char Overlong2 = 1 << 5;  // 1100000_ 10______
+constexpr char TooLarge1000 = 1 << 6; // 11110101+ 1000____
+constexpr char Overlong4 = 1 << 6;  // 11110000 1000____
+constexpr char TwoConts = char(1 << 7); // 10______ 10______ (unless a 3rd/4th byte)
+constexpr char Carry = TooShort | TooLong | TwoConts;
+
+JSON_TARGET_SSSE3
+inline __m128i highNibbles(__m128i bytes) {
+    return _mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x0F));
+}
+
+JSON_TARGET_SSSE3
+inline __m128i checkChunk(__m128i input, __m128i previous) {
+    const __m128i byte1HighTable = _mm_setr_epi8(
+        TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong, TooLong,
+        TwoConts, TwoConts, TwoConts, TwoConts,
+        TooShort | Overlong2,
+        TooShort,
+        TooShort | Overlong3 | Surrogate,
+        TooShort | TooLarge | TooLarge1000 | Overlong4);
+
+    const __m128i byte1LowTable = _mm_setr_epi8(
+        Carry | Overlong3 | Overlong2 | Overlong4,
+        Carry | Overlong2,
+        Carry,
+        Carry,
+        Carry | TooLarge,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000 | Surrogate,
+        Carry | TooLarge | TooLarge1000,
+        Carry | TooLarge | TooLarge1000);
+
+    const __m128i byte2HighTable = _mm_setr_epi8(
+        TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort, TooShort,
+        TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge1000 | Overlong4,
+        TooLong | Overlong2 | TwoConts | Overlong3 | TooLarge,
+        TooLong | Overlong2 | TwoConts | Surrogate | TooLarge,
+        TooLong | Overlong2 | TwoConts | Surrogate | TooLarge,
+        TooShort, TooShort, TooShort, TooShort);
+
+    __m128i prev1 = _mm_alignr_epi8(input, previous, 15);
+    __m128i special = _mm_and_si128(
+        _mm_and_si128(_mm_shuffle_epi8(byte1HighTable, highNibbles(prev1)),
+                      _mm_shuffle_epi8(byte1LowTable, _mm_and_si128(prev1, _mm_set1_epi8(0x0F)))),
+        _mm_shuffle_epi8(byte2HighTable, highNibbles(input)));
+
+    // Third and fourth bytes of a sequence must be continuations; these are the
+    // only continuation bytes allowed to follow another continuation
+    __m128i prev2 = _mm_alignr_epi8(input, previous, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, previous, 13);
+    __m128i isThird = _mm_subs_epu8(prev2, _mm_set1_epi8(char(0xE0 - 0x80)));
+    __m128i isFourth = _mm_subs_epu8(prev3, _mm_set1_epi8(char(0xF0 - 0x80)));
+    __m128i must23 = _mm_and_si128(_mm_or_si128(isThird, isFourth), _mm_set1_epi8(char(0x80)));
+
+    return _mm_xor_si128(must23, special);
+}
+
+// Non-zero where the chunk ends inside a sequence
+JSON_TARGET_SSSE3
+inline __m128i incomplete(__m128i input) {
+    const __m128i max = _mm_setr_epi8(
+        char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF),
+        char(0xFF), char(0xFF), char(0xFF), char(0xFF), char(0xFF),
+        char(0xF0 - 1), char(0xE0 - 1), char(0xC0 - 1));
+    return _mm_subs_epu8(input, max);
+}
+
+// Validates whole 16-byte chunks; a sequence may remain open at the end
+JSON_TARGET_SSSE3
+bool validateChunks(const unsigned char* data, size_t size, const unsigned char* previousBytes) {
+    __m128i previous = _mm_loadu_si128(reinterpret_cast<const __m128i*>(previousBytes));
+    __m128i previousIncomplete = incomplete(previous);
+    __m128i error = _mm_setzero_si128();
+
+    for (size_t i = 0; i < size; i += 16) {
+        __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        if (_mm_movemask_epi8(input) == 0) {
+            // ASCII only: valid unless the previous chunk left a sequence open
+            error = _mm_or_si128(error, previousIncomplete);
+            previousIncomplete = _mm_setzero_si128();
+        } else {
+            error = _mm_or_si128(error, checkChunk(input, previous));
+            previousIncomplete = incomplete(input);
+        }
+        previous = input;
+    }
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, _mm_setzero_si128())) == 0xFFFF;
+}
+
+bool hasSsse3() {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_cpu_supports("ssse3");
+#else
+    return true; // every x86-64 CPU that runs current MSVC builds has it
+#endif
+}
+
+#endif // JSON_UTF8_SIMD
+
+} // namespace
+
+
+void JsonUtf8::Append(std::string& out, uint32_t code) {
+    if (code < 0x80) {
+        out += char(code);
+    } else if (code < 0x800) {
+        out += char(0xC0 | (code >> 6));
+        out += char(0x80 | (code & 0x3F));
+    } else if (code < 0x10000) {
+        out += char(0xE0 | (code >> 12));
+        out += char(0x80 | ((code >> 6) & 0x3F));
+        out += char(0x80 | (code & 0x3F));
+    } else {
+        out += char(0xF0 | (code >> 18));
+        out += char(0x80 | ((code >> 12) & 0x3F));
+        out += char(0x80 | ((code >> 6) & 0x3F));
+        out += char(0x80 | (code & 0x3F));
+    }
+}
+
+JsonUtf8::Validator::Validator() {
+#ifdef JSON_UTF8_SIMD
+    _simd = hasSsse3();
+#endif
+}
+
+size_t JsonUtf8::Validator::check(State& state, const unsigned char* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        unsigned char byte = data[i];
+
+        if (state.pending > 0) {
+            if (byte < state.lower || byte > state.upper) {
+                return i;
+            }
+            --state.pending;
+            state.lower = 0x80;
+            state.upper = 0xBF;
+            continue;
+        }
+
+        if (byte < 0x80) {
+            continue;
+        }
+        if (byte < 0xC2) { // continuation without a lead, or overlong 2-byte form
+            return i;
+        }
+        if (byte < 0xE0) {
+            state.pending = 1;
+        } else if (byte < 0xF0) {
+            state.pending = 2;
+            if (byte == 0xE0) {
+                state.lower = 0xA0; // overlong
+            } else if (byte == 0xED) {
+                state.upper = 0x9F; // surrogates
+            }
+        } else if (byte < 0xF5) {
+            state.pending = 3;
+            if (byte == 0xF0) {
+                state.lower = 0x90; // overlong
+            } else if (byte == 0xF4) {
+                state.upper = 0x8F; // above U+10FFFF
+            }
+        } else {
+            return i;
+        }
+    }
+    return size;
+}
+
+JsonUtf8::Validator::State JsonUtf8::Validator::stateAfter(const unsigned char* last) {
+    // Find the lead of the final sequence within the last 3 bytes
+    for (int k = 1; k <= 3; ++k) {
+        unsigned char byte = last[16 - k];
+        if ((byte & 0xC0) == 0x80) {
+            continue;
+        }
+
+        State state;
+        if (k == 1) {
+            // Only the lead was seen; it also restricts the next byte
+            check(state, &byte, 1);
+            return state;
+        }
+        int length = byte < 0x80 ? 1 : byte < 0xE0 ? 2 : byte < 0xF0 ? 3 : 4;
+        state.pending = length > k ? length - k : 0;
+        return state;
+    }
+    return State();
+}
+
+bool JsonUtf8::Validator::Feed(const char* data, size_t size) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+    _blockStart = _state;
+
+    size_t chunked = 0;
+#ifdef JSON_UTF8_SIMD
+    if (_simd && size >= 16) {
+        chunked = size & ~size_t(15);
+        if (!validateChunks(bytes, chunked, _previous)) {
+            return false;
+        }
+        _state = stateAfter(bytes + chunked - 16);
+    }
+#endif
+
+    if (check(_state, bytes + chunked, size - chunked) != size - chunked) {
+        return false;
+    }
+
+    if (size >= 16) {
+        std::memcpy(_previous, bytes + size - 16, 16);
+    } else {
+        std::memmove(_previous, _previous + size, 16 - size);
+        std::memcpy(_previous + 16 - size, bytes, size);
+    }
+    return true;
+}
+
+size_t JsonUtf8::Validator::FindError(const char* data, size_t size) const {
+    State state = _blockStart;
+    return check(state, reinterpret_cast<const unsigned char*>(data), size);
+}
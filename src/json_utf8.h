@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * UTF-8 helpers shared by the parser, the scanner and the validator.
+ */
+class JsonUtf8 {
+public:
+    // Appends the code point `code` encoded as UTF-8
+    static void Append(std::string& out, uint32_t code);
+
+    static bool IsHighSurrogate(uint32_t code) {
+        return code >= 0xD800 && code <= 0xDBFF;
+    }
+
+    static bool IsLowSurrogate(uint32_t code) {
+        return code >= 0xDC00 && code <= 0xDFFF;
+    }
+
+    static uint32_t CombineSurrogates(uint32_t high, uint32_t low) {
+        return 0x10000 + ((high - 0xD800) << 10) + (low - 0xDC00);
+    }
+
+    static int HexValue(int ch) {
+        if (ch >= '0' && ch <= '9') return ch - '0';
+        if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+        if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+        return -1;
+    }
+
+    /*
+     * Streaming UTF-8 validation; blocks may split a multi-byte sequence.
+     *
+     * On x86-64 CPUs with SSSE3 whole 16-byte chunks are checked with the
+     * lookup-table algorithm of Keiser and Lemire ("Validating UTF-8 In Less
+     * Than One Instruction Per Byte"), pure ASCII chunks cost a single compare.
+     * Other targets, and the bytes left over at the end of a block, use a
+     * scalar state machine.
+     */
+    class Validator {
+    public:
+        Validator();
+
+        // Returns false if the block contains invalid UTF-8
+        bool Feed(const char* data, size_t size);
+
+        // Returns false if the input ended inside a multi-byte sequence
+        bool Finish() const {
+            return _state.pending == 0;
+        }
+
+        // Offset of the first invalid byte of the block that Feed() rejected
+        size_t FindError(const char* data, size_t size) const;
+
+    private:
+        // Continuation bytes still expected and the allowed range of the next one
+        struct State {
+            int pending = 0;
+            unsigned char lower = 0x80;
+            unsigned char upper = 0xBF;
+        };
+
+        static size_t check(State& state, const unsigned char* data, size_t size);
+
+        // State after `last`, the final 16 bytes of a valid input
+        static State stateAfter(const unsigned char* last);
+
+        State _state;
+        State _blockStart; // state before the last block passed to Feed()
+
+        // Last 16 bytes of the input, looked back at by the first SIMD chunk
+        unsigned char _previous[16] = {};
+
+        bool _simd = false;
+    };
+};
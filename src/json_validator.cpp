@@ -0,0 +1,652 @@
+#include "json_validator.h"
+#include "json_stats.h"
+
+#include <bit>
+#include <memory>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// First '"', '\\' or control character in [p, end); string contents between
+// them need no grammar check (UTF-8 is validated separately)
+const char* findStringSpecial(const char* p, const char* end) {
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1F);
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        __m128i special = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+            _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk)); // unsigned chunk <= 0x1F
+        unsigned mask = unsigned(_mm_movemask_epi8(special));
+        if (mask != 0) {
+            return p + std::countr_zero(mask);
+        }
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '"' && *p != '\\' && (unsigned char)*p >= 0x20) {
+        ++p;
+    }
+    return p;
+}
+
+// Newlines in [p, end), for error positions
+struct Newlines {
+    int count = 0;
+    const char* lineStart = nullptr; // after the last one, if any
+};
+
+Newlines findNewlines(const char* p, const char* end) {
+    Newlines newlines;
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i newline = _mm_set1_epi8('\n');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        unsigned mask = unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+        if (mask != 0) {
+            newlines.count += std::popcount(mask);
+            newlines.lineStart = p + 32 - std::countl_zero(mask);
+        }
+        p += 16;
+    }
+#endif
+    for (; p < end; ++p) {
+        if (*p == '\n') {
+            ++newlines.count;
+            newlines.lineStart = p + 1;
+        }
+    }
+    return newlines;
+}
+
+// Bits set for the matching bytes of 64
+struct Bitmaps {
+    uint64_t quote = 0;
+    uint64_t backslash = 0;
+    uint64_t control = 0; // below 0x20
+    uint64_t space = 0;
+    uint64_t structural = 0; // {}[]:,
+    uint64_t digit = 0;
+};
+
+Bitmaps classify(const char* p) {
+    Bitmaps bitmaps;
+#if defined(__SSE2__) || defined(_M_X64)
+    auto mask = [](__m128i matches, int shift) {
+        return uint64_t(unsigned(_mm_movemask_epi8(matches))) << shift;
+    };
+    for (int i = 0; i < 64; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        auto is = [&](char ch) {
+            return _mm_cmpeq_epi8(chunk, _mm_set1_epi8(ch));
+        };
+        // '[' and ']' are '{' and '}' without the 0x20 bit
+        __m128i folded = _mm_or_si128(chunk, _mm_set1_epi8(0x20));
+        __m128i brace = _mm_or_si128(_mm_cmpeq_epi8(folded, _mm_set1_epi8('{')),
+                                     _mm_cmpeq_epi8(folded, _mm_set1_epi8('}')));
+
+        bitmaps.quote |= mask(is('"'), i);
+        bitmaps.backslash |= mask(is('\\'), i);
+        bitmaps.control |= mask(_mm_cmpeq_epi8(_mm_min_epu8(chunk, _mm_set1_epi8(0x1F)), chunk), i);
+        bitmaps.space |= mask(_mm_or_si128(_mm_or_si128(is(' '), is('\n')), _mm_or_si128(is('\r'), is('\t'))), i);
+        bitmaps.structural |= mask(_mm_or_si128(brace, _mm_or_si128(is(':'), is(','))), i);
+        __m128i offset = _mm_sub_epi8(chunk, _mm_set1_epi8('0'));
+        bitmaps.digit |= mask(_mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8(9)), offset), i);
+    }
+#else
+    for (int i = 0; i < 64; ++i) {
+        unsigned char ch = (unsigned char)p[i];
+        uint64_t bit = uint64_t(1) << i;
+        bitmaps.quote |= ch == '"' ? bit : 0;
+        bitmaps.backslash |= ch == '\\' ? bit : 0;
+        bitmaps.control |= ch < 0x20 ? bit : 0;
+        bitmaps.space |= (ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t') ? bit : 0;
+        bitmaps.structural |= (ch == '{' || ch == '}' || ch == '[' || ch == ']' || ch == ':' || ch == ',') ? bit : 0;
+        bitmaps.digit |= (ch >= '0' && ch <= '9') ? bit : 0;
+    }
+#endif
+    return bitmaps;
+}
+
+// Bit i is the parity of the bits up to and including i: with quotes as
+// input, set from an opening quote up to its closing one
+uint64_t prefixXor(uint64_t bits) {
+    for (int shift = 1; shift < 64; shift *= 2) {
+        bits ^= bits << shift;
+    }
+    return bits;
+}
+
+// Bits below `count`, which may be 64
+uint64_t below(size_t count) {
+    return count >= 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+}
+
+bool isSpace(char ch) {
+    return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t';
+}
+
+bool isDigit(char ch) {
+    return ch >= '0' && ch <= '9';
+}
+
+// Whether [p, p + size) is a complete number or literal
+bool isScalar(const char* p, size_t size) {
+    switch (*p) {
+        case 't':
+            return std::string_view(p, size) == "true";
+        case 'f':
+            return std::string_view(p, size) == "false";
+        case 'n':
+            return std::string_view(p, size) == "null";
+        default:
+            break;
+    }
+
+    const char* end = p + size;
+    auto digits = [&]() {
+        const char* start = p;
+        while (p < end && isDigit(*p)) {
+            ++p;
+        }
+        return p != start;
+    };
+
+    if (p < end && *p == '-') {
+        ++p;
+    }
+    if (p < end && *p == '0') {
+        ++p;
+    } else if (!digits()) {
+        return false;
+    }
+    if (p < end && *p == '.') {
+        ++p;
+        if (!digits()) {
+            return false;
+        }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        ++p;
+        if (p < end && (*p == '+' || *p == '-')) {
+            ++p;
+        }
+        if (!digits()) {
+            return false;
+        }
+    }
+    return p == end;
+}
+
+} // namespace
+
+
+JsonResult<uint64_t> JsonValidator::Validate(std::istream& in, size_t blockSize) {
+    JsonValidator validator;
+
+    std::unique_ptr<char[]> block(new char[blockSize]);
+    std::streambuf* buf = in.rdbuf();
+    for (;;) {
+        std::streamsize size = buf->sgetn(block.get(), std::streamsize(blockSize));
+        if (size <= 0) {
+            break;
+        }
+        if (!validator.Feed(block.get(), size_t(size))) {
+            return validator.error();
+        }
+    }
+    if (!validator.Finish()) {
+        return validator.error();
+    }
+
+    JSON_STATS_ADD(bytesRead, validator.offset());
+
+    return validator.offset();
+}
+
+bool JsonValidator::Feed(const char* data, size_t size) {
+    if (_failed) {
+        return false;
+    }
+
+    // The grammar is checked up to the first invalid UTF-8 byte, so whichever
+    // error comes first is reported
+    size_t valid = size;
+    if (!_utf8.Feed(data, size)) {
+        valid = _utf8.FindError(data, size);
+    }
+    if (parse(data, valid) != valid) {
+        return false;
+    }
+    if (valid != size) {
+        return fail("Invalid UTF-8 sequence", valid, data);
+    }
+
+    Newlines newlines = findNewlines(data, data + size);
+    _line += newlines.count;
+    if (newlines.lineStart) {
+        _lineStart = _offset + (newlines.lineStart - data);
+    }
+    _offset += size;
+
+    return true;
+}
+
+bool JsonValidator::Finish() {
+    if (_failed) {
+        return false;
+    }
+    if (!_utf8.Finish()) {
+        return fail("Input ends inside a UTF-8 sequence", 0, nullptr);
+    }
+
+    bool complete = false;
+    switch (_state) {
+        case State::Next:
+        case State::Zero:
+        case State::Integer:
+        case State::Fraction:
+        case State::ExponentDigits:
+            complete = _stack.empty();
+            break;
+        default:
+            break;
+    }
+    if (!complete) {
+        return fail("Unexpected end of input", 0, nullptr);
+    }
+    return true;
+}
+
+bool JsonValidator::fail(const std::string& message, size_t position, const char* block) {
+    _failed = true;
+
+    int line = _line;
+    uint64_t lineStart = _lineStart;
+    if (block) {
+        Newlines newlines = findNewlines(block, block + position);
+        line += newlines.count;
+        if (newlines.lineStart) {
+            lineStart = _offset + (newlines.lineStart - block);
+        }
+    }
+
+    uint64_t offset = _offset + position;
+    _error = JsonError{ message, size_t(offset), line, int(offset - lineStart) + 1 };
+    return false;
+}
+
+size_t JsonValidator::parse(const char* data, size_t size) {
+    const char* p = data;
+    const char* end = data + size;
+
+    auto failAt = [&](const std::string& message) {
+        fail(message, p - data, data);
+        return size_t(p - data);
+    };
+
+    while (p < end) {
+        if (_state <= State::String && end - p >= 64) {
+            const char* next = skim(p);
+            if (next != p) {
+                p = next;
+                continue;
+            }
+        }
+
+        char ch = *p;
+
+        switch (_state) {
+            case State::String:
+                p = findStringSpecial(p, end);
+                if (p == end) {
+                    return size;
+                }
+                if (*p == '"') {
+                    _state = _key ? State::Colon : State::Next;
+                } else if (*p == '\\') {
+                    _state = State::Escape;
+                } else {
+                    return failAt("Invalid control character in string");
+                }
+                break;
+
+            case State::Value:
+            case State::ValueOrClose:
+                if (isSpace(ch)) {
+                    break;
+                }
+                if (ch == ']' && _state == State::ValueOrClose) {
+                    _stack.pop_back();
+                    endValue();
+                    break;
+                }
+                switch (ch) {
+                    case '{':
+                        _stack += '{';
+                        _state = State::KeyOrClose;
+                        break;
+                    case '[':
+                        _stack += '[';
+                        _state = State::ValueOrClose;
+                        break;
+                    case '"':
+                        _key = false;
+                        _state = State::String;
+                        break;
+                    case '-':
+                        _state = State::Minus;
+                        break;
+                    case '0':
+                        _state = State::Zero;
+                        break;
+                    case 't':
+                        _literal = "rue";
+                        _state = State::Literal;
+                        break;
+                    case 'f':
+                        _literal = "alse";
+                        _state = State::Literal;
+                        break;
+                    case 'n':
+                        _literal = "ull";
+                        _state = State::Literal;
+                        break;
+                    default:
+                        if (!isDigit(ch)) {
+                            return failAt(std::string("Unexpected character '") + ch + "', expected a value");
+                        }
+                        _state = State::Integer;
+                        break;
+                }
+                break;
+
+            case State::Key:
+            case State::KeyOrClose:
+                if (isSpace(ch)) {
+                    break;
+                }
+                if (ch == '}' && _state == State::KeyOrClose) {
+                    _stack.pop_back();
+                    endValue();
+                    break;
+                }
+                if (ch != '"') {
+                    return failAt("Object key must be a string");
+                }
+                _key = true;
+                _state = State::String;
+                break;
+
+            case State::Colon:
+                if (isSpace(ch)) {
+                    break;
+                }
+                if (ch != ':') {
+                    return failAt("Expected ':' after object key");
+                }
+                _state = State::Value;
+                break;
+
+            case State::Next:
+                if (isSpace(ch)) {
+                    break;
+                }
+                if (_stack.empty()) {
+                    return failAt("Unexpected data after the root value");
+                }
+                if (ch == ',') {
+                    _state = _stack.back() == '{' ? State::Key : State::Value;
+                } else if (ch == (_stack.back() == '{' ? '}' : ']')) {
+                    _stack.pop_back();
+                    endValue();
+                } else {
+                    return failAt(_stack.back() == '{' ? "Missing comma between members"
+                                                       : "Missing comma between elements");
+                }
+                break;
+
+            case State::Escape:
+                switch (ch) {
+                    case '"': case '\\': case '/':
+                    case 'b': case 'f': case 'n': case 'r': case 't':
+                        _state = State::String;
+                        break;
+                    case 'u':
+                        _code = 0;
+                        _digits = 0;
+                        _state = State::Unicode;
+                        break;
+                    default:
+                        return failAt(std::string("Invalid escape sequence '\\") + ch + "'");
+                }
+                break;
+
+            case State::Unicode: {
+                int digit = JsonUtf8::HexValue((unsigned char)ch);
+                if (digit < 0) {
+                    return failAt(std::string("Invalid unicode hex digit '") + ch + "'");
+                }
+                _code = _code * 16 + digit;
+                if (++_digits < 4) {
+                    break;
+                }
+                if (_high != 0) {
+                    if (!JsonUtf8::IsLowSurrogate(_code)) {
+                        return failAt("High surrogate must be followed by a low surrogate");
+                    }
+                    _high = 0;
+                    _state = State::String;
+                } else if (JsonUtf8::IsHighSurrogate(_code)) {
+                    _high = _code;
+                    _state = State::LowBackslash;
+                } else if (JsonUtf8::IsLowSurrogate(_code)) {
+                    return failAt("Low surrogate without a preceding high surrogate");
+                } else {
+                    _state = State::String;
+                }
+                break;
+            }
+
+            case State::LowBackslash:
+            case State::LowU:
+                if (ch != (_state == State::LowBackslash ? '\\' : 'u')) {
+                    return failAt("High surrogate must be followed by a low surrogate");
+                }
+                if (_state == State::LowU) {
+                    _code = 0;
+                    _digits = 0;
+                    _state = State::Unicode;
+                } else {
+                    _state = State::LowU;
+                }
+                break;
+
+            case State::Literal:
+                if (ch != *_literal) {
+                    return failAt("Invalid literal");
+                }
+                if (*++_literal == '\0') {
+                    endValue();
+                }
+                break;
+
+            // Numbers end at the first character that cannot continue them,
+            // which is then looked at again in the Next state
+            case State::Minus:
+                if (ch == '0') {
+                    _state = State::Zero;
+                } else if (isDigit(ch)) {
+                    _state = State::Integer;
+                } else {
+                    return failAt("Expected a digit after '-'");
+                }
+                break;
+
+            case State::Zero:
+            case State::Integer:
+                if (isDigit(ch)) {
+                    if (_state == State::Zero) {
+                        return failAt("Leading zeros are not allowed");
+                    }
+                } else if (ch == '.') {
+                    _state = State::Dot;
+                } else if (ch == 'e' || ch == 'E') {
+                    _state = State::Exponent;
+                } else {
+                    endValue();
+                    continue;
+                }
+                break;
+
+            case State::Dot:
+                if (!isDigit(ch)) {
+                    return failAt("Expected a digit after the decimal point");
+                }
+                _state = State::Fraction;
+                break;
+
+            case State::Fraction:
+                if (ch == 'e' || ch == 'E') {
+                    _state = State::Exponent;
+                } else if (!isDigit(ch)) {
+                    endValue();
+                    continue;
+                }
+                break;
+
+            case State::Exponent:
+                if (ch == '+' || ch == '-') {
+                    _state = State::ExponentSign;
+                    break;
+                }
+                [[fallthrough]];
+            case State::ExponentSign:
+                if (!isDigit(ch)) {
+                    return failAt("Expected a digit in the exponent");
+                }
+                _state = State::ExponentDigits;
+                break;
+
+            case State::ExponentDigits:
+                if (!isDigit(ch)) {
+                    endValue();
+                    continue;
+                }
+                break;
+        }
+
+        ++p;
+    }
+
+    return size;
+}
+
+const char* JsonValidator::skim(const char* p) {
+    Bitmaps bitmaps = classify(p);
+
+    // Up to the first backslash every quote opens or closes a string. The
+    // bytes from there on, and control characters in strings, are left to
+    // the state machine.
+    uint64_t inString = prefixXor(bitmaps.quote) ^ (_state == State::String ? ~uint64_t(0) : 0);
+    uint64_t stop = bitmaps.backslash | (bitmaps.control & inString);
+    size_t limit = stop ? size_t(std::countr_zero(stop)) : 64;
+    uint64_t quotes = bitmaps.quote & below(limit);
+
+    // Kept in a local while skimming, written back on the way out
+    State state = _state;
+    auto leave = [&](size_t at) {
+        _state = state;
+        return p + at;
+    };
+
+    size_t from = 0;
+    if (state == State::String) {
+        if (!quotes) {
+            return p + limit;
+        }
+        from = size_t(std::countr_zero(quotes)) + 1;
+        state = _key ? State::Colon : State::Next;
+    }
+
+    // Numbers and literals are runs of anything else outside strings
+    uint64_t scalar = ~(bitmaps.space | bitmaps.structural | bitmaps.quote | inString);
+    uint64_t scalarStart = scalar & ~(scalar << 1);
+    uint64_t tokens = ((bitmaps.structural & ~inString) | (quotes & inString) | scalarStart) & below(limit) & ~below(from);
+
+    while (tokens) {
+        size_t at = size_t(std::countr_zero(tokens));
+        tokens &= tokens - 1;
+        char ch = p[at];
+        bool value = state == State::Value || state == State::ValueOrClose;
+
+        if (scalarStart & (uint64_t(1) << at)) {
+            size_t length = size_t(std::countr_one(scalar >> at));
+            if (!value || at + length >= limit) {
+                return leave(at);
+            }
+            // Integers, the common case, are checked on the bitmaps
+            size_t first = at + (ch == '-');
+            uint64_t digits = below(at + length) & ~below(first);
+            bool integer = digits && (bitmaps.digit & digits) == digits && (p[first] != '0' || first + 1 == at + length);
+            if (!integer && !isScalar(p + at, length)) {
+                return leave(at);
+            }
+            state = State::Next;
+            continue;
+        }
+
+        switch (ch) {
+            case '"':
+                if (value) {
+                    _key = false;
+                } else if (state == State::Key || state == State::KeyOrClose) {
+                    _key = true;
+                } else {
+                    return leave(at);
+                }
+                if (!(quotes & ~below(at + 1))) {
+                    state = State::String;
+                    return leave(limit);
+                }
+                state = _key ? State::Colon : State::Next;
+                break;
+            case '{':
+            case '[':
+                if (!value) {
+                    return leave(at);
+                }
+                _stack += ch;
+                state = ch == '{' ? State::KeyOrClose : State::ValueOrClose;
+                break;
+            case ':':
+                if (state != State::Colon) {
+                    return leave(at);
+                }
+                state = State::Value;
+                break;
+            case ',':
+                if (state != State::Next || _stack.empty()) {
+                    return leave(at);
+                }
+                state = _stack.back() == '{' ? State::Key : State::Value;
+                break;
+            default: // '}' or ']'
+                if (_stack.empty() || ch != (_stack.back() == '{' ? '}' : ']')
+                    || !(state == State::Next || state == (ch == '}' ? State::KeyOrClose : State::ValueOrClose))) {
+                    return leave(at);
+                }
+                _stack.pop_back();
+                state = State::Next;
+                break;
+        }
+    }
+
+    return leave(limit);
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <cstdint>
+
+#include "json_result.h"
+#include "json_utf8.h"
+
+/*
+ * Validation-only pass: checks the full JSON grammar (RFC 8259, any value at
+ * the root) and UTF-8 encoding without building nodes or decoding strings.
+ *
+ * Input is pushed in blocks of any size, so a value, string or escape may span
+ * a block boundary. Only a stack of open containers is kept. The first error
+ * is reported with its byte offset, line and column.
+ *
+ * Between tokens and inside strings, 64 bytes at a time are classified into
+ * bitmaps of quotes, backslashes, control characters, whitespace and
+ * structural characters, and only the tokens they locate are looked at:
+ * whitespace and string contents are skipped in bulk and numbers and
+ * literals are checked whole. Escapes, tokens crossing the 64 bytes and
+ * anything invalid go through a byte-by-byte state machine, which reports
+ * the error.
+ */
+class JsonValidator {
+public:
+    // Validates the whole stream, returning the number of bytes checked
+    static JsonResult<uint64_t> Validate(std::istream& in, size_t blockSize = 1 << 20);
+
+    // Returns false once an error is found; further input is ignored
+    bool Feed(const char* data, size_t size);
+
+    // Checks that the input ended after a complete value
+    bool Finish();
+
+    const JsonError& error() const {
+        return _error;
+    }
+
+    uint64_t offset() const {
+        return _offset;
+    }
+
+private:
+    // The states up to String are between tokens or in a string's contents,
+    // where skim() takes over
+    enum class State : uint8_t {
+        Value,        // a value is required
+        ValueOrClose, // after '['
+        Key,          // after ',' in an object
+        KeyOrClose,   // after '{'
+        Colon,
+        Next,         // after a value: ',', a closer or the end
+        String,
+        Escape,
+        Unicode,      // \uXXXX digits
+        LowBackslash, // a high surrogate must be followed by "\u" + low surrogate
+        LowU,
+        Minus,
+        Zero,
+        Integer,
+        Dot,
+        Fraction,
+        Exponent,
+        ExponentSign,
+        ExponentDigits,
+        Literal,
+    };
+
+    // Returns the offset in the block where the grammar is violated, or `size`
+    size_t parse(const char* data, size_t size);
+
+    // Follows the grammar through the 64 bytes at `p` using their bitmaps and
+    // returns where the byte-by-byte state machine has to continue
+    const char* skim(const char* p);
+
+    bool fail(const std::string& message, size_t position, const char* block);
+
+    // Moves to the state after a complete value
+    void endValue() {
+        _state = State::Next;
+    }
+
+    State _state = State::Value;
+
+    std::string _stack; // '{' or '[' per open container
+    bool _key = false;  // the current string is an object key
+
+    // \u escape in progress
+    uint32_t _code = 0;
+    int _digits = 0;
+    uint32_t _high = 0; // pending high surrogate
+
+    const char* _literal = nullptr; // remaining characters of true/false/null
+
+    JsonUtf8::Validator _utf8;
+
+    // Position of the current block for error reporting
+    uint64_t _offset = 0;
+    int _line = 1;
+    uint64_t _lineStart = 0;
+
+    bool _failed = false;
+    JsonError _error;
+};
@@ -1,54 +1,344 @@
+#include <csignal>
+#include <iomanip>
 #include <iostream>
 #include <fstream>
 #include <memory>
 #include <sstream>
+#include <cstring>
+#include <string>
+#include <vector>
 
 #include "json_parser.h"
 #include "json_eval.h"
+#include "json_extract.h"
+#include "json_hash.h"
+#include "json_index.h"
+#include "json_intern.h"
+#include "json_lines.h"
+#include "json_memory.h"
+#include "json_reader.h"
+#include "json_stats.h"
+#include "json_validator.h"
+
+// Set while --follow runs, so that Ctrl+C ends it cleanly
+static JsonLines* s_following = nullptr;
+
+static void stopFollowing(int) {
+    if (s_following) {
+        s_following->Stop();
+    }
+}
 
 int main(int argc, char* argv[]) {
-    
-    int base_arg_num = 3;
-    int max_args = 4;
 
     bool verbose = false;
+    bool stats = false;
+    bool lines = false;
+    bool memory = false;
+    bool use_index = false;
+    bool validate = false;
+    bool hash = false;
+    bool extract = false;
+    bool dedup = false;
+    bool follow = false;
 
-    if (argc != base_arg_num) {
-        std::cerr << "Usage: " << argv[0] << " <json_file> <expression>" << std::endl;
-        return 1;
-    }
+    JsonIndex::Options index_options;
+
+    JsonLines::Options lines_options;
+
+    JsonParser::Limits limits;
+
+    std::vector<std::string> positional;
 
-    for (int i = base_arg_num - 1; i < max_args - 1; ++i) {
+    for (int i = 1; i < argc; ++i) {
         char* carg = argv[i];
-        char ch0 = carg[0];
 
         if (strlen(carg) < 1) {
             continue;
         }
 
-        if (ch0 == '-') {
+        if (carg[0] == '-' && strlen(carg) > 1) {
             std::string arg_substr = std::string(carg).substr(1); // Get substring starting from the second letter
             if (arg_substr == "v" || arg_substr == "-verbose") {
                 verbose = true;
+            } else if (arg_substr == "-stats") {
+                stats = true;
+            } else if (arg_substr == "-memory") {
+                memory = true;
+            } else if (arg_substr == "-hash") {
+                hash = true;
+            } else if (arg_substr == "-dedup") {
+                dedup = true;
+            } else if (arg_substr == "-extract") {
+                extract = true;
+            } else if (arg_substr == "-validate") {
+                validate = true;
+            } else if (arg_substr == "-index") {
+                use_index = true;
+            } else if (arg_substr.starts_with("-index-stride=") || arg_substr.starts_with("-index-depth=")) {
+                use_index = true;
+                try {
+                    size_t value = std::stoul(arg_substr.substr(arg_substr.find('=') + 1));
+                    if (arg_substr.starts_with("-index-stride=")) {
+                        index_options.stride = value;
+                    } else {
+                        index_options.depth = int(value);
+                    }
+                } catch (...) {
+                    std::cerr << "Invalid value " << carg << std::endl;
+                    return 1;
+                }
+            } else if (arg_substr.starts_with("-max-depth=") || arg_substr.starts_with("-max-size=")
+                       || arg_substr.starts_with("-max-string=")) {
+                try {
+                    uint64_t value = std::stoull(arg_substr.substr(arg_substr.find('=') + 1));
+                    if (arg_substr.starts_with("-max-depth=")) {
+                        limits.maxDepth = size_t(value);
+                    } else if (arg_substr.starts_with("-max-size=")) {
+                        limits.maxDocumentSize = value;
+                    } else {
+                        limits.maxStringLength = size_t(value);
+                    }
+                } catch (...) {
+                    std::cerr << "Invalid value " << carg << std::endl;
+                    return 1;
+                }
+            } else if (arg_substr == "-lines") {
+                lines = true;
+            } else if (arg_substr == "-follow") {
+                follow = true;
+            } else if (arg_substr == "-unordered") {
+                lines_options.ordered = false;
+            } else if (arg_substr.starts_with("-threads=")) {
+                try {
+                    lines_options.threads = std::stoul(arg_substr.substr(9));
+                } catch (...) {
+                    std::cerr << "Invalid thread count " << carg << std::endl;
+                    return 1;
+                }
+            } else {
+                std::cerr << "Unknown option " << carg << std::endl;
+                return 1;
             }
+        } else {
+            positional.push_back(carg);
         }
     }
 
-    if (argc > 3 && std::string(argv[3]) == "-v") { // verbose
+    // --validate takes no expression
+    if (positional.size() != (validate ? 1 : 2)) {
+        std::cerr << "Usage: " << argv[0] << " <json_file|-> <expression> [-v|--verbose] [--stats] [--memory] [--hash] [--dedup]"
+                  << " [--index [--index-stride=N] [--index-depth=N]]"
+                  << " [--lines [--unordered] [--threads=N] | --follow]"
+                  << " [--max-depth=N] [--max-size=BYTES] [--max-string=BYTES]\n"
+                  << "       " << argv[0] << " <json_file|-> <path>[,<path>...] --extract [--stats]\n"
+                  << "       " << argv[0] << " <json_file|-> --validate [--stats]" << std::endl;
+        return 1;
+    }
+
+#ifndef JSON_EVAL_STATS
+    if (stats) {
+        std::cerr << "Warning: built without JSON_EVAL_STATS, --stats has no effect" << std::endl;
+        stats = false;
+    }
+#endif
+
+    if (verbose) {
         std::cout << "Running...\n";
     }
-    
 
-    std::ifstream json_file(argv[1]);
-    if (!json_file.is_open()) {
-        std::cerr << "Error: Could not open file " << argv[1] << std::endl;
+    const std::string& json_path = positional[0];
+
+    if (use_index && !validate && !extract) {
+        if (json_path == "-") {
+            std::cerr << "Error: --index needs a seekable file" << std::endl;
+            return 1;
+        }
+
+        std::string expr = positional[1];
+        std::erase(expr, '"');
+
+        JsonResult<JsonIndex> index = JsonIndex::Load(json_path);
+        if (!index) {
+            if (verbose) {
+                std::cout << "[JSON index] " << index.error().message << ", building..." << std::endl;
+            }
+            {
+                JSON_STATS_PHASE(Parse);
+                index = JsonIndex::Build(json_path, index_options);
+            }
+            if (!index) {
+                std::cerr << "[JSON index] Error: " << index.error().what() << std::endl;
+                return 1;
+            }
+            if (!index->Save(json_path)) {
+                std::cerr << "Warning: could not write " << JsonIndex::SidecarPath(json_path) << std::endl;
+            }
+        }
+
+        std::ifstream binary_file(json_path, std::ios::binary);
+
+        JsonResult<std::shared_ptr<JsonValue>> result = JsonError{};
+        {
+            JSON_STATS_PHASE(Eval);
+            result = index->Query(binary_file, expr);
+        }
+        if (!result) {
+            std::cerr << "[JSON index] Error: " << result.error().what() << std::endl;
+            return 1;
+        }
+
+        {
+            JSON_STATS_PHASE(Print);
+            std::cout << **result << std::flush;
+        }
+
+        if (stats) {
+            JsonStats::Report(std::cerr);
+        }
+
+        return 0;
+    }
+
+    if (follow && !validate && !extract) {
+        if (json_path == "-") {
+            std::cerr << "Error: --follow needs a file" << std::endl;
+            return 1;
+        }
+
+        std::string expr = positional[1];
+        std::erase(expr, '"');
+
+        lines_options.limits = limits;
+        JsonLines driver(expr, lines_options);
+
+        s_following = &driver;
+        std::signal(SIGINT, stopFollowing);
+        std::signal(SIGTERM, stopFollowing);
+        JsonResult<size_t> failed = driver.Follow(json_path, std::cout, std::cerr);
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGTERM, SIG_DFL);
+        s_following = nullptr;
+
+        if (!failed) {
+            std::cerr << "[JSON lines] Error: " << failed.error().what() << std::endl;
+            return 1;
+        }
+
+        if (stats) {
+            JsonStats::Report(std::cerr);
+        }
+
+        return *failed ? 1 : 0;
+    }
+
+    // Reading runs on its own thread, ahead of the parser
+    std::unique_ptr<JsonReadAheadBuffer> json_buffer;
+    {
+        JSON_STATS_PHASE(Open);
+        json_buffer = std::make_unique<JsonReadAheadBuffer>(json_path);
+    }
+    if (!json_buffer->is_open()) {
+        std::cerr << "Error: Could not open file " << json_path << std::endl;
         return 1;
     }
+    std::istream json_file(json_buffer.get());
 
-    if (verbose) {
-        std::ifstream json_file(argv[1]);
+    if (validate) {
+        JsonResult<uint64_t> result = JsonError{};
+        {
+            JSON_STATS_PHASE(Parse);
+            result = JsonValidator::Validate(json_file);
+        }
+        if (!json_buffer->error().empty()) {
+            std::cerr << "Error: reading " << json_path << " failed: " << json_buffer->error() << std::endl;
+            return 1;
+        }
+        if (!result) {
+            std::cerr << "[JSON validator] Error: " << result.error().what() << std::endl;
+            return 1;
+        }
+        std::cout << "Valid JSON (" << *result << " bytes)" << std::endl;
+
+        if (stats) {
+            JsonStats::Report(std::cerr);
+        }
+
+        return 0;
+    }
+
+    if (extract) {
+        std::string expr = positional[1];
+        std::erase(expr, '"');
+
+        // Comma separated paths, all extracted in one pass
+        std::vector<std::string> paths;
+        for (size_t start = 0;;) {
+            size_t comma = expr.find(',', start);
+            paths.push_back(expr.substr(start, comma - start));
+            if (comma == std::string::npos) {
+                break;
+            }
+            start = comma + 1;
+        }
+
+        auto extractor = JsonExtractor::Compile(paths);
+        if (!extractor) {
+            std::cerr << "[JSON extract] Error: " << extractor.error().what() << std::endl;
+            return 1;
+        }
+
+        JsonResult<JsonExtractor::Record> record = JsonError{};
+        {
+            JSON_STATS_PHASE(Parse);
+            record = extractor->Extract(json_file);
+        }
+        if (!json_buffer->error().empty()) {
+            std::cerr << "Error: reading " << json_path << " failed: " << json_buffer->error() << std::endl;
+            return 1;
+        }
+        if (!record) {
+            std::cerr << "[JSON extract] Error: " << record.error().what() << std::endl;
+            return 1;
+        }
+
+        {
+            JSON_STATS_PHASE(Print);
+            extractor->Write(std::cout, *record);
+            std::cout << std::endl;
+        }
+
+        if (stats) {
+            JsonStats::Report(std::cerr);
+        }
+
+        return 0;
+    }
+
+    if (lines) {
+        std::string expr = positional[1];
+        std::erase(expr, '"');
+
+        lines_options.limits = limits;
+        JsonLines driver(expr, lines_options);
+        size_t failed = driver.Run(json_file, std::cout, std::cerr);
+
+        if (!json_buffer->error().empty()) {
+            std::cerr << "Error: reading " << json_path << " failed: " << json_buffer->error() << std::endl;
+            failed = 1;
+        }
+
+        if (stats) {
+            JsonStats::Report(std::cerr);
+        }
+
+        return failed ? 1 : 0;
+    }
+
+    if (verbose && json_path != "-") {
+        std::ifstream json_file(json_path);
         if (!json_file.is_open()) {
-            std::cerr << "Error: Could not open file " << argv[1] << std::endl;
+            std::cerr << "Error: Could not open file " << json_path << std::endl;
             return 1;
         }
         std::stringstream buffer;
@@ -60,56 +350,89 @@ int main(int argc, char* argv[]) {
     }
 
     JsonParser parser(verbose);
+    parser.EnableHashing(hash);
+    parser.SetLimits(limits);
+
+    std::shared_ptr<JsonInternTable> intern_table;
+    if (dedup) {
+        intern_table = std::make_shared<JsonInternTable>();
+        parser.SetInternTable(intern_table);
+    }
 
     std::shared_ptr<JsonValue> root;
 
-    try {
-        root = parser.Parse(json_file);
-        if (verbose) {
-            std::cout << "[JSON parser] success." << std::endl;
+    {
+        JSON_STATS_PHASE(Parse);
+        auto parsed = parser.TryParse(json_file);
+        if (!parsed && !json_buffer->error().empty()) {
+            std::cerr << "Error: reading " << json_path << " failed: " << json_buffer->error() << std::endl;
+            return 1;
         }
-    } catch (const std::runtime_error& e) {
-        std::cerr << "[JSON parser] Runtime error: " << e.what() << std::endl;
-        return 1;
-    } catch (const std::exception& e) {
-        std::cerr << "[JSON parser] Exception: " << e.what() << std::endl;
-        return 1;
-    } catch (...) {
-        std::cerr << "[JSON parser] An unknown error occurred." << std::endl;
-        return 1;
+        if (!parsed) {
+            std::cerr << "[JSON parser] Error: " << parsed.error().what() << std::endl;
+            return 1;
+        }
+        root = std::move(*parsed);
+    }
+    if (verbose) {
+        std::cout << "[JSON parser] success." << std::endl;
     }
 
     if (verbose) {
         std::cout << *root << std::endl;
     }
+
+    if (memory) {
+        JsonMemory::Print(JsonMemory::Measure(*root), std::cerr);
+    }
+
+    if (dedup) {
+        JsonInternTable::Print(intern_table->stats(), std::cerr);
+    }
     
 
-    JsonEval evaluator(root);
+    JsonEval evaluator(std::move(root));
 
-    std::shared_ptr<JsonValue> expressionResult{};
+    std::shared_ptr<const JsonValue> expressionResult;
 
-    std::string expr = argv[2];
+    std::string expr = positional[1];
 
     std::erase(expr, '"');
 
-    try {
-        expressionResult = evaluator.EvaluateExpression(root, expr);
-    } catch (const std::runtime_error& e) {
-        std::cerr << "[JSON eval] Runtime error: " << e.what() << std::endl;
-        return 1;
-    } catch (const std::exception& e) {
-        std::cerr << "[JSON eval] Exception: " << e.what() << std::endl;
-        return 1;
-    } catch (...) {
-        std::cerr << "[JSON eval] An unknown error occurred." << std::endl;
-        return 1;
+    {
+        JSON_STATS_PHASE(Eval);
+        auto evaluated = evaluator.TryEvaluateExpression(expr);
+        if (!evaluated) {
+            std::cerr << "[JSON eval] Error: " << evaluated.error().what() << std::endl;
+            return 1;
+        }
+        expressionResult = std::move(*evaluated);
     }
 
     if (verbose) {
         std::cout << "EXPRESSION RESULT:\n";
     }
 
-    std::cout << *expressionResult;
+    {
+        JSON_STATS_PHASE(Print);
+        if (hash) {
+            // Structural hash of the result instead of the result itself
+            std::cout << std::hex << std::setw(16) << std::setfill('0')
+                      << JsonHash::Of(*expressionResult) << std::dec << std::endl;
+        } else {
+            std::cout << *expressionResult << std::flush;
+        }
+    }
+
+    {
+        JSON_STATS_PHASE(Destroy);
+        expressionResult.reset();
+        evaluator = JsonEval(nullptr);
+    }
+
+    if (stats) {
+        JsonStats::Report(std::cerr);
+    }
 
     return 0;
 }